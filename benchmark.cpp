@@ -0,0 +1,980 @@
+#include "include/hash_table.hpp"
+#include "include/dictionary.hpp"
+#include "include/art.hpp"
+#include "include/cuckoo_table.hpp"
+#include "include/sharded_hash_table.hpp"
+#include "include/parallel_build.hpp"
+#include "include/access_profile.hpp"
+#include "include/hash_cache.hpp"
+#include "include/sorted_index.hpp"
+#include "include/latency_histogram.hpp"
+#include "include/compact_table.hpp"
+#include "include/bench_report.hpp"
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <thread>
+#include <cmath>
+
+#ifndef BENCH_COUNT
+#define BENCH_COUNT 100
+#endif
+
+#ifndef ZIPF_S
+#define ZIPF_S 1.0
+#endif
+
+#ifndef PREFIX_LIMIT
+#define PREFIX_LIMIT 10
+#endif
+
+/* -D BUILD_WORDS=10000000 adds build of such big generated dictionary */
+
+const size_t PREFIX_QUERY_LEN = 3;
+const size_t BUILD_WORD_LEN   = 16;
+const char  *ZIPF_LOG_PATH    = "src/zipf_queries.log";
+const double CACHE_SHARES[]   = {0.01, 0.05, 0.2};
+const size_t SMALL_SIZES[]    = {1000, 10000};
+const size_t SHARDS_PER_THREAD = 4;
+const unsigned BENCH_SEED     = 42;
+const size_t BENCH_GATE_TRIALS     = 10;
+const size_t BENCH_GATE_GET_PASSES = 10;
+
+typedef ValueType* (*GetFunction)(void *engine, KeyType key);
+
+struct BenchEngine
+{
+    const char *name;
+    void       *engine;
+    GetFunction get;
+};
+
+//-----------------------------------------------------------------------------
+
+ValueType* BenchGet_HashTable(void *engine, KeyType key)
+{
+    return HashTable_get((HashTable *)engine, key);
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* BenchGet_ArtTree(void *engine, KeyType key)
+{
+    return ArtTree_get((ArtTree *)engine, key);
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* BenchGet_CuckooTable(void *engine, KeyType key)
+{
+    return CuckooTable_get((CuckooTable *)engine, key);
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* BenchGet_SortedIndex(void *engine, KeyType key)
+{
+    return SortedIndex_get((SortedIndex *)engine, key);
+}
+
+//-----------------------------------------------------------------------------
+
+/* CompactTable gives value itself, there's no ValueType stored in it */
+ValueType* BenchGet_CompactTable(void *engine, KeyType key)
+{
+    static ValueType value = NULL;
+    value = CompactTable_get((CompactTable *)engine, key);
+
+    return (value != NULL) ? &value : NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Lookups go in random order, so neighbour keys don't share cache lines */
+KeyType* GetShuffledKeys(DoubleWord *translates, size_t words_count)
+{
+    KeyType *keys = (KeyType *)calloc(words_count, sizeof(KeyType));
+
+    for (size_t i = 0; i < words_count; i++)
+        keys[i] = translates[i].primary_word;
+
+    srand(BENCH_SEED);
+    for (size_t i = words_count - 1; i > 0; i--)
+    {
+        size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+        KeyType tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    return keys;
+}
+
+//-----------------------------------------------------------------------------
+
+double BenchGet(BenchEngine *bench, KeyType *keys, size_t words_count)
+{
+    clock_t start = clock();
+
+    for (int j = 0; j < BENCH_COUNT; j++)
+    for (size_t i = 0; i < words_count; i++)
+        if (bench->get(bench->engine, keys[i]) == NULL)
+        {
+            printf("%s: get returned NULL for %s\n", bench->name, keys[i]);
+            return -1;
+        }
+
+    clock_t end = clock();
+
+    return 1000.0 * (end - start) / CLOCKS_PER_SEC;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Returns -1 if counters aren't available (no permission, virtual machine) */
+int PerfCounter_open(unsigned long long cache_result)
+{
+    perf_event_attr attr = {};
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.size           = sizeof(perf_event_attr);
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (cache_result << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long PerfCounter_read(int counter)
+{
+    unsigned long long value = 0;
+    if (read(counter, &value, sizeof(value)) != sizeof(value))
+        return 0;
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+void BenchTlb(BenchEngine *bench, KeyType *keys, size_t words_count)
+{
+    int loads  = PerfCounter_open(PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+    int misses = PerfCounter_open(PERF_COUNT_HW_CACHE_RESULT_MISS);
+
+    if (loads >= 0 && misses >= 0)
+    {
+        ioctl(loads,  PERF_EVENT_IOC_RESET,  0);
+        ioctl(misses, PERF_EVENT_IOC_RESET,  0);
+        ioctl(loads,  PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(misses, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    double time = BenchGet(bench, keys, words_count);
+
+    if (loads >= 0 && misses >= 0)
+    {
+        ioctl(loads,  PERF_EVENT_IOC_DISABLE, 0);
+        ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+
+        unsigned long long loads_count  = PerfCounter_read(loads);
+        unsigned long long misses_count = PerfCounter_read(misses);
+
+        printf("%-24s %10.3f ms, dTLB load misses: %llu of %llu (%.3f%%)\n", bench->name, time, misses_count, loads_count,
+               (loads_count) ? 100.0 * misses_count / loads_count : 0.0);
+    }
+    else
+        printf("%-24s %10.3f ms, dTLB load misses: n/a\n", bench->name, time);
+
+    if (loads  >= 0) close(loads);
+    if (misses >= 0) close(misses);
+}
+
+//-----------------------------------------------------------------------------
+
+void BenchHugePages(DoubleWord *translates, size_t words_count, KeyType *keys)
+{
+    HashTable tables[3] = {};
+    const char *names[3] = {"get calloc", "get packed", "get packed huge pages"};
+
+    for (int i = 0; i < 3; i++)
+    {
+        HashTable_construct(&tables[i], words_count / LoadFactor + 1, (i == 2) ? HASH_ALLOC_HUGE_PAGES : HASH_ALLOC_DEFAULT);
+        for (size_t j = 0; j < words_count; j++)
+            HashTable_put(&tables[i], translates[j].primary_word, translates[j].translated_word);
+
+        if (i != 0)
+            HashTable_pack(&tables[i]);
+    }
+
+    static const char *kinds[] = {"calloc", "MAP_HUGETLB", "transparent huge pages"};
+    printf("huge pages: buckets in %s, entries in %s\n",
+           kinds[tables[2].buckets_block.kind], kinds[tables[2].entries_block.kind]);
+
+    for (int i = 0; i < 3; i++)
+    {
+        BenchEngine bench = {names[i], &tables[i], BenchGet_HashTable};
+        BenchTlb(&bench, keys, words_count);
+        HashTable_destruct(&tables[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Build from empty table: put in one pass against the old way with get and then add */
+void BenchPut(DoubleWord *translates, size_t words_count)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        HashTable hash_table = {};
+        HashTable_construct(&hash_table, 100);
+
+        clock_t start = clock();
+
+        for (size_t j = 0; j < words_count; j++)
+        {
+            if (i == 0)
+                HashTable_put(&hash_table, translates[j].primary_word, translates[j].translated_word);
+            else if (HashTable_get(&hash_table, translates[j].primary_word) == NULL)
+                HashTable_add(&hash_table, translates[j].primary_word, translates[j].translated_word);
+        }
+
+        clock_t end = clock();
+
+        printf("%-24s %10.3f ms\n", (i == 0) ? "put single pass" : "put get + add", 1000.0 * (end - start) / CLOCKS_PER_SEC);
+
+        HashTable_destruct(&hash_table);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* One key at a time against HASH_LANES independent crc32 chains from HashingFunction_batch */
+void BenchHashBatch(KeyType *keys, size_t words_count)
+{
+    unsigned long long *scalar  = (unsigned long long *)calloc(words_count, sizeof(unsigned long long));
+    unsigned long long *batched = (unsigned long long *)calloc(words_count, sizeof(unsigned long long));
+
+    clock_t start = clock();
+    for (int i = 0; i < BENCH_COUNT; i++)
+        for (size_t j = 0; j < words_count; j++)
+            scalar[j] = HashingFunction(keys[j]);
+    clock_t middle = clock();
+    for (int i = 0; i < BENCH_COUNT; i++)
+        for (size_t j = 0; j < words_count; j += HASH_BATCH_MAX)
+            HashingFunction_batch(keys + j, (words_count - j < HASH_BATCH_MAX) ? words_count - j : HASH_BATCH_MAX,
+                                  batched + j);
+    clock_t end = clock();
+
+    bool equal = memcmp(scalar, batched, words_count * sizeof(unsigned long long)) == 0;
+
+    printf("%-24s %10.3f ms\n", "hash single key", 1000.0 * (middle - start) / CLOCKS_PER_SEC);
+    printf("%-24s %10.3f ms (%s)\n", "hash batch", 1000.0 * (end - middle) / CLOCKS_PER_SEC,
+           equal ? "equal" : "DIFFERS");
+
+    free(batched);
+    free(scalar);
+}
+
+//-----------------------------------------------------------------------------
+
+void ShardedPutWorker(ShardedHashTable *table, DoubleWord *translates, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; i++)
+        ShardedHashTable_put(table, translates[i].primary_word, translates[i].translated_word);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Parallel build from empty table: one shard is the same as one table under one lock */
+void BenchSharded(DoubleWord *translates, size_t words_count)
+{
+    size_t threads_count = (std::thread::hardware_concurrency()) ? std::thread::hardware_concurrency() : 1;
+    size_t shards[2] = {1, threads_count * SHARDS_PER_THREAD};
+
+    for (int i = 0; i < 2; i++)
+    {
+        ShardedHashTable table = {};
+        ShardedHashTable_construct(&table, shards[i], 100);
+
+        std::thread *threads = new std::thread[threads_count];
+        timespec start = {}, end = {};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (size_t j = 0; j < threads_count; j++)
+            threads[j] = std::thread(ShardedPutWorker, &table, translates,
+                                     words_count * j / threads_count, words_count * (j + 1) / threads_count);
+
+        for (size_t j = 0; j < threads_count; j++)
+            threads[j].join();
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        delete[] threads;
+
+        printf("put sharded %3zu shards   %10.3f ms (%zu threads, %zu words)\n", shards[i],
+               (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, threads_count,
+               ShardedHashTable_size(&table));
+
+        ShardedHashTable_destruct(&table);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+double BenchBuildTime(HashTable *hash_table, DoubleWord *translates, size_t words_count, size_t threads_count)
+{
+    timespec start = {}, end = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (threads_count == 0)
+        HashTable_build(hash_table, translates, words_count);
+    else
+        HashTable_build_parallel(hash_table, translates, words_count, threads_count);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Sequential build against parallel one with 1, 2, 4... threads up to count of cores */
+void BenchBuild(DoubleWord *translates, size_t words_count)
+{
+    size_t max_threads = (std::thread::hardware_concurrency()) ? std::thread::hardware_concurrency() : 1;
+
+    HashTable sequential_table = {};
+    printf("%-24s %10.3f ms (%zu words)\n", "build sequential",
+           BenchBuildTime(&sequential_table, translates, words_count, 0), words_count);
+
+    for (size_t threads_count = 1; ; threads_count *= 2)
+    {
+        if (threads_count > max_threads)
+            threads_count = max_threads;
+
+        HashTable hash_table = {};
+        double time = BenchBuildTime(&hash_table, translates, words_count, threads_count);
+
+        printf("build parallel %3zu thr    %10.3f ms (%s)\n", threads_count, time,
+               HashTable_equal(&hash_table, &sequential_table) ? "equal" : "DIFFERS");
+
+        HashTable_destruct(&hash_table);
+
+        if (threads_count == max_threads)
+            break;
+    }
+
+    HashTable_destruct(&sequential_table);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Random padded words, translation is the same word */
+DoubleWord* GenerateWords(size_t words_count, char **buffer)
+{
+    *buffer = (char *)calloc(words_count, BUILD_WORD_LEN);
+    DoubleWord *translates = (DoubleWord *)calloc(words_count, sizeof(DoubleWord));
+
+    srand(BENCH_SEED);
+    for (size_t i = 0; i < words_count; i++)
+    {
+        char *word = *buffer + i * BUILD_WORD_LEN;
+
+        for (size_t j = 0; j < BUILD_WORD_LEN / 2; j++)
+            word[j] = 'a' + rand() % 26;
+
+        translates[i].primary_word    = word;
+        translates[i].translated_word = word;
+    }
+
+    return translates;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Word of rank r is asked with probability ~ 1 / r^ZIPF_S, ranks go in order of keys (they are shuffled) */
+KeyType* GetZipfQueries(KeyType *keys, size_t words_count, size_t queries_count)
+{
+    double *cdf = (double *)calloc(words_count, sizeof(double));
+    KeyType *queries = (KeyType *)calloc(queries_count, sizeof(KeyType));
+
+    double sum = 0;
+    for (size_t i = 0; i < words_count; i++)
+    {
+        sum += 1 / pow(i + 1, ZIPF_S);
+        cdf[i] = sum;
+    }
+
+    srand(BENCH_SEED);
+    for (size_t i = 0; i < queries_count; i++)
+    {
+        double point = sum * ((double)rand() * RAND_MAX + rand()) / ((double)RAND_MAX * RAND_MAX + RAND_MAX + 1);
+
+        size_t left = 0, right = words_count - 1;
+        while (left < right)
+        {
+            size_t middle = (left + right) / 2;
+            if (cdf[middle] < point) left  = middle + 1;
+            else                     right = middle;
+        }
+
+        queries[i] = keys[left];
+    }
+
+    free(cdf);
+    return queries;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Share of queries found on the first compare, nodes are compared in the same order as in get.asm.
+   If get is given, it's called after every check, so order may change on the way */
+double FirstCompareShare(HashTable *hash_table, KeyType *queries, size_t queries_count, GetFunction get = NULL)
+{
+    size_t first_count = 0;
+
+    for (size_t i = 0; i < queries_count; i++)
+    {
+        My_list<HashTableEl> *bucket = &hash_table->buckets[hash_table->hash_function(queries[i]) % hash_table->capacity];
+        if (bucket->size != 0 && !strcmp(bucket->data[0].value.key, queries[i]))
+            first_count++;
+
+        if (get != NULL)
+            get(hash_table, queries[i]);
+    }
+
+    return (double)first_count / queries_count;
+}
+
+//-----------------------------------------------------------------------------
+
+double BenchQueries(HashTable *hash_table, KeyType *queries, size_t queries_count, GetFunction get)
+{
+    clock_t start = clock();
+
+    for (size_t i = 0; i < queries_count; i++)
+        get(hash_table, queries[i]);
+
+    clock_t end = clock();
+    return 1000.0 * (end - start) / CLOCKS_PER_SEC;
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* BenchGet_HashTableMtf(void *engine, KeyType key)
+{
+    return HashTable_get_mtf((HashTable *)engine, key);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Zipf traffic: table in insertion order, sorted by recorded log of the first half of trace,
+   and with move to front. Second half of trace is measured */
+void BenchAccessProfile(DoubleWord *translates, size_t words_count, KeyType *keys)
+{
+    size_t queries_count = words_count * BENCH_COUNT / 10;
+    KeyType *queries = GetZipfQueries(keys, words_count, 2 * queries_count);
+    KeyType *measured = queries + queries_count;
+
+    QueryLog query_log = {};
+    remove(ZIPF_LOG_PATH);
+    QueryLog_open(&query_log, ZIPF_LOG_PATH);
+    for (size_t i = 0; i < queries_count; i++)
+        QueryLog_write(&query_log, queries[i]);
+    QueryLog_close(&query_log);
+
+    HashTable hash_table = {};
+    HashTable_build(&hash_table, translates, words_count);
+    HashTable_pack(&hash_table);
+
+    printf("%-24s %10.3f ms (first compare %.3f)\n", "zipf insertion order",
+           BenchQueries(&hash_table, measured, queries_count, BenchGet_HashTable),
+           FirstCompareShare(&hash_table, measured, queries_count));
+
+    char  *log_buffer = NULL;
+    size_t log_count  = 0;
+    KeyType *log_queries = QueryLog_read(ZIPF_LOG_PATH, &log_count, &log_buffer);
+
+    HashTable_reorder(&hash_table, log_queries, log_count);
+
+    printf("%-24s %10.3f ms (first compare %.3f, %zu logged)\n", "zipf profile reorder",
+           BenchQueries(&hash_table, measured, queries_count, BenchGet_HashTable),
+           FirstCompareShare(&hash_table, measured, queries_count), log_count);
+
+    HashTable_destruct(&hash_table);
+
+    HashTable_build(&hash_table, translates, words_count);
+    HashTable_pack(&hash_table);
+
+    BenchQueries(&hash_table, queries, queries_count, BenchGet_HashTableMtf);
+    double mtf_share = FirstCompareShare(&hash_table, measured, queries_count, BenchGet_HashTableMtf);
+    printf("%-24s %10.3f ms (first compare %.3f)\n", "zipf move to front",
+           BenchQueries(&hash_table, measured, queries_count, BenchGet_HashTableMtf), mtf_share);
+
+    HashTable_destruct(&hash_table);
+
+    free(log_queries);
+    free(log_buffer);
+    free(queries);
+    remove(ZIPF_LOG_PATH);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Cache of some share of words in front of full table, which plays slow storage. Zipf trace */
+void BenchCache(HashTable *storage, KeyType *keys, size_t words_count)
+{
+    size_t queries_count = words_count * BENCH_COUNT / 10;
+    KeyType *queries = GetZipfQueries(keys, words_count, queries_count);
+
+    for (size_t i = 0; i < sizeof(CACHE_SHARES) / sizeof(CACHE_SHARES[0]); i++)
+    for (int policy = CACHE_CLOCK; policy <= CACHE_SLRU; policy++)
+    {
+        HashCache cache = {};
+        HashCache_construct(&cache, words_count * CACHE_SHARES[i], 0, (cache_policy)policy);
+
+        size_t hits = 0;
+        clock_t start = clock();
+
+        for (size_t j = 0; j < queries_count; j++)
+        {
+            if (HashCache_get(&cache, queries[j]) != NULL)
+            {
+                hits++;
+                continue;
+            }
+
+            ValueType *value = HashTable_get(storage, queries[j]);
+            if (value != NULL)
+                HashCache_put(&cache, queries[j], *value);
+        }
+
+        clock_t end = clock();
+
+        printf("cache %-5s %5.1f%% words %10.3f ms (hit ratio %.3f, %zu evictions, %zu KB)\n",
+               (policy == CACHE_CLOCK) ? "CLOCK" : "SLRU", 100 * CACHE_SHARES[i],
+               1000.0 * (end - start) / CLOCKS_PER_SEC, (double)hits / queries_count,
+               cache.evictions, cache.bytes / 1024);
+
+        HashCache_destruct(&cache);
+    }
+
+    free(queries);
+}
+
+//-----------------------------------------------------------------------------
+
+/* What autocomplete does today: linear scan over all words */
+size_t LinearPrefix(DoubleWord *translates, size_t words_count, const char* prefix, HashTableEl *found, size_t limit)
+{
+    size_t prefix_len  = strlen(prefix);
+    size_t found_count = 0;
+
+    for (size_t i = 0; i < words_count && found_count < limit; i++)
+        if (!strncmp(translates[i].primary_word, prefix, prefix_len))
+        {
+            found[found_count].key   = translates[i].primary_word;
+            found[found_count].value = translates[i].translated_word;
+            found_count++;
+        }
+
+    return found_count;
+}
+
+//-----------------------------------------------------------------------------
+
+void BenchPrefix(ArtTree *art, SortedIndex *sorted, DoubleWord *translates, size_t words_count, KeyType *keys)
+{
+    size_t queries_count = (words_count < 10000) ? words_count : 10000;
+    char (*queries)[PREFIX_QUERY_LEN + 1] = (char (*)[PREFIX_QUERY_LEN + 1])calloc(queries_count, PREFIX_QUERY_LEN + 1);
+    HashTableEl found[PREFIX_LIMIT] = {};
+
+    for (size_t i = 0; i < queries_count; i++)
+        strncpy(queries[i], keys[i], PREFIX_QUERY_LEN);
+
+    size_t art_found = 0;
+    clock_t start = clock();
+    for (size_t i = 0; i < queries_count; i++)
+        art_found += ArtTree_prefix(art, queries[i], found, PREFIX_LIMIT);
+    clock_t end = clock();
+    double art_time = 1000.0 * (end - start) / CLOCKS_PER_SEC;
+
+    size_t sorted_found = 0;
+    start = clock();
+    for (size_t i = 0; i < queries_count; i++)
+        sorted_found += SortedIndex_prefix(sorted, queries[i], found, PREFIX_LIMIT);
+    end = clock();
+    double sorted_time = 1000.0 * (end - start) / CLOCKS_PER_SEC;
+
+    size_t linear_found = 0;
+    start = clock();
+    for (size_t i = 0; i < queries_count; i++)
+        linear_found += LinearPrefix(translates, words_count, queries[i], found, PREFIX_LIMIT);
+    end = clock();
+    double linear_time = 1000.0 * (end - start) / CLOCKS_PER_SEC;
+
+    printf("%-24s %10.3f ms (%zu queries, %zu found)\n", "prefix ArtTree", art_time, queries_count, art_found);
+    printf("%-24s %10.3f ms (%zu queries, %zu found)\n", "prefix SortedIndex", sorted_time, queries_count, sorted_found);
+    printf("%-24s %10.3f ms (%zu queries, %zu found)\n", "prefix linear scan", linear_time, queries_count, linear_found);
+
+    free(queries);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Small dictionaries fit to cache, there binary search may beat hashing */
+void BenchSmall(DoubleWord *translates, size_t words_count)
+{
+    for (size_t i = 0; i < sizeof(SMALL_SIZES) / sizeof(SMALL_SIZES[0]); i++)
+    {
+        size_t small_count = (SMALL_SIZES[i] < words_count) ? SMALL_SIZES[i] : words_count;
+        KeyType *keys = GetShuffledKeys(translates, small_count);
+
+        HashTable hash_table = {};
+        HashTable_build(&hash_table, translates, small_count);
+
+        SortedIndex eytzinger = {}, btree = {};
+        SortedIndex_construct(&eytzinger, translates, small_count, SORTED_EYTZINGER);
+        SortedIndex_construct(&btree,     translates, small_count, SORTED_BTREE);
+
+        BenchEngine engines[] = {
+            {"HashTable",   &hash_table, BenchGet_HashTable},
+            {"Eytzinger",   &eytzinger,  BenchGet_SortedIndex},
+            {"B+ tree",     &btree,      BenchGet_SortedIndex}
+        };
+
+        /* The same count of lookups as for the whole dictionary */
+        for (size_t j = 0; j < sizeof(engines) / sizeof(engines[0]); j++)
+        {
+            double time = 0;
+            for (size_t k = 0; k < words_count / small_count; k++)
+                time += BenchGet(&engines[j], keys, small_count);
+
+            printf("small %6zu %-12s %10.3f ms\n", small_count, engines[j].name, time);
+        }
+
+        SortedIndex_destruct(&btree);
+        SortedIndex_destruct(&eytzinger);
+        HashTable_destruct(&hash_table);
+        free(keys);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Tail latency of every operation: puts from small table (with rehash pauses), then gets of all keys
+   and of random words which are missing. Without LATENCY_HISTOGRAMS table doesn't record put and rehash
+   itself, so they are recorded here */
+void BenchLatency(DoubleWord *translates, size_t words_count, KeyType *keys)
+{
+    Latency_reset();
+
+    HashTable hash_table = {};
+    HashTable_construct(&hash_table, 100);
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        size_t rehash_count = hash_table.rehash_count;
+        unsigned long long rehash_time_ns = hash_table.rehash_time_ns;
+
+        unsigned long long start = LatencyNow();
+        HashTable_put(&hash_table, translates[i].primary_word, translates[i].translated_word);
+        unsigned long long end = LatencyNow();
+
+#ifndef LATENCY_HISTOGRAMS
+        Latency_record(LATENCY_PUT, end - start);
+        if (hash_table.rehash_count != rehash_count)
+            Latency_record(LATENCY_REHASH, hash_table.rehash_time_ns - rehash_time_ns);
+#endif
+    }
+
+    char       *missing_buffer = NULL;
+    DoubleWord *missing        = GenerateWords(words_count, &missing_buffer);
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        KeyType key = (i % 2) ? keys[i] : missing[i].primary_word;
+
+        unsigned long long start = LatencyNow();
+        ValueType *value = HashTable_get(&hash_table, key);
+        unsigned long long end = LatencyNow();
+
+        Latency_record((value != NULL) ? LATENCY_GET_HIT : LATENCY_GET_MISS, end - start);
+    }
+
+    Latency_dump(stdout);
+
+    free(missing);
+    free(missing_buffer);
+    HashTable_destruct(&hash_table);
+}
+
+//-----------------------------------------------------------------------------
+
+/* One trial of regression gate: dictionary is parsed from its pristine copy, table is built
+   and filled by puts, then gets and rehash go on the filled table */
+bool BenchGateTrial(BenchReport *report, const char *pristine, size_t buffer_size)
+{
+    char *buffer = (char *)calloc(buffer_size + 1, sizeof(char));
+    if (buffer == NULL)
+        return false;
+
+    memcpy(buffer, pristine, buffer_size);
+
+    double start = BenchNow();
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+    BenchReport_add(report, "parse", BenchNow() - start);
+
+    HashTable built = {};
+    BenchReport_add(report, "build", BenchBuildTime(&built, translates, words_count, 0));
+    HashTable_destruct(&built);
+
+    HashTable hash_table = {};
+    HashTable_construct(&hash_table, 100);
+
+    start = BenchNow();
+    for (size_t i = 0; i < words_count; i++)
+        HashTable_put(&hash_table, translates[i].primary_word, translates[i].translated_word);
+    BenchReport_add(report, "put", BenchNow() - start);
+
+    KeyType *keys = GetShuffledKeys(translates, words_count);
+    bool found = true;
+
+    start = BenchNow();
+    for (size_t j = 0; j < BENCH_GATE_GET_PASSES; j++)
+        for (size_t i = 0; i < words_count; i++)
+            found = found && HashTable_get(&hash_table, keys[i]) != NULL;
+    BenchReport_add(report, "get", BenchNow() - start);
+
+    start = BenchNow();
+    HashTable_rehash(&hash_table, 2 * hash_table.capacity);
+    BenchReport_add(report, "rehash", BenchNow() - start);
+
+    free(keys);
+    HashTable_destruct(&hash_table);
+    free(translates);
+    free(buffer);
+
+    return found;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Trials go one after another with all benchmarks in every one, so slow period of machine
+   spreads over all of them. The first trial warms caches and isn't recorded */
+int BenchRecord(const char *out, size_t trials, const char *dictionary_path)
+{
+    char *pristine = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &pristine);
+    if (pristine == NULL)
+    {
+        printf("Couldn't read database\n");
+        return BENCH_COMPARE_ERROR;
+    }
+
+    BenchReport *report = (BenchReport *)calloc(1, sizeof(BenchReport));
+    BenchReport *warmup = (BenchReport *)calloc(1, sizeof(BenchReport));
+
+    BenchReport_describe_host(report, GetEolCount(pristine, buffer_size));
+
+    bool passed = BenchGateTrial(warmup, pristine, buffer_size);
+    for (size_t i = 0; i < trials && passed; i++)
+        passed = BenchGateTrial(report, pristine, buffer_size);
+
+    if (!passed)
+        printf("get returned NULL\n");
+    else if (BenchReport_write(report, out) != HASH_OK)
+        printf("Couldn't write %s\n", out);
+    else
+        printf("%zu trials of %zu benchmarks are written to %s\n", trials, report->series_count, out);
+
+    bool written = passed && access(out, F_OK) == 0;
+
+    free(warmup);
+    free(report);
+    free(pristine);
+
+    return (written) ? BENCH_COMPARE_SAME : BENCH_COMPARE_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+
+int BenchCompare(const char *baseline_path, const char *current_path, double threshold, double alpha)
+{
+    BenchReport *baseline = (BenchReport *)calloc(1, sizeof(BenchReport));
+    BenchReport *current  = (BenchReport *)calloc(1, sizeof(BenchReport));
+
+    int result = BENCH_COMPARE_ERROR;
+
+    if (BenchReport_read(baseline, baseline_path) != HASH_OK)
+        printf("Couldn't read %s\n", baseline_path);
+    else if (BenchReport_read(current, current_path) != HASH_OK)
+        printf("Couldn't read %s\n", current_path);
+    else
+    {
+        printf("baseline: %s, %s\ncurrent:  %s, %s\n", baseline->date, baseline->cpu, current->date, current->cpu);
+        result = BenchReport_compare(baseline, current, threshold, alpha);
+    }
+
+    free(current);
+    free(baseline);
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/* bench --out results.json [--trials n] [--dict path]
+   bench --compare baseline.json results.json [--threshold 0.05] [--alpha 0.01]
+   Exit code of compare: 0 without regressions, 2 if there is one, 1 on errors */
+int BenchCommand(int argc, char* argv[])
+{
+    const char *out        = NULL;
+    const char *baseline   = NULL;
+    const char *current    = NULL;
+    const char *dictionary = "src/dictionary.dic";
+    size_t trials    = BENCH_GATE_TRIALS;
+    double threshold = BENCH_REPORT_THRESHOLD;
+    double alpha     = BENCH_REPORT_ALPHA;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_arg = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--compare") && i + 2 < argc)
+        {
+            baseline = argv[++i];
+            current  = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--out") && has_arg)       out        = argv[++i];
+        else if (!strcmp(argv[i], "--dict") && has_arg)      dictionary = argv[++i];
+        else if (!strcmp(argv[i], "--trials") && has_arg)    trials     = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threshold") && has_arg) threshold  = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--alpha") && has_arg)     alpha      = atof(argv[++i]);
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return BENCH_COMPARE_ERROR;
+        }
+    }
+
+    if (baseline != NULL)
+        return BenchCompare(baseline, current, threshold, alpha);
+
+    if (out == NULL || trials < 2 || trials > BENCH_REPORT_MAX_TRIALS)
+    {
+        printf("Usage: bench --out results.json [--trials 2..%zu] [--dict path]\n"
+               "       bench --compare baseline.json results.json [--threshold 0.05] [--alpha 0.01]\n",
+               BENCH_REPORT_MAX_TRIALS);
+        return BENCH_COMPARE_ERROR;
+    }
+
+    return BenchRecord(out, trials, dictionary);
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        return BenchCommand(argc, argv);
+
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase("src/dictionary.dic", &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return 0;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+    KeyType    *keys        = GetShuffledKeys(translates, words_count);
+
+    HashTable hash_table = {};
+    HashTable_construct(&hash_table, words_count / LoadFactor + 1);
+    for (size_t i = 0; i < words_count; i++)
+        HashTable_put(&hash_table, translates[i].primary_word, translates[i].translated_word);
+
+    ArtTree art = {};
+    ArtTree_construct(&art);
+    for (size_t i = 0; i < words_count; i++)
+        ArtTree_put(&art, translates[i].primary_word, translates[i].translated_word);
+
+    CuckooTable cuckoo = {};
+    CuckooTable_construct(&cuckoo, words_count);
+    for (size_t i = 0; i < words_count; i++)
+        CuckooTable_put(&cuckoo, translates[i].primary_word, translates[i].translated_word);
+
+    SortedIndex eytzinger = {};
+    SortedIndex_construct(&eytzinger, translates, words_count, SORTED_EYTZINGER);
+
+    SortedIndex btree = {};
+    SortedIndex_construct(&btree, translates, words_count, SORTED_BTREE);
+
+    CompactTable compact = {};
+    CompactTable_build(&compact, translates, words_count);
+
+    BenchEngine engines[] = {
+        {"get HashTable",   &hash_table, BenchGet_HashTable},
+        {"get ArtTree",     &art,        BenchGet_ArtTree},
+        {"get CuckooTable", &cuckoo,     BenchGet_CuckooTable},
+        {"get Eytzinger",   &eytzinger,  BenchGet_SortedIndex},
+        {"get B+ tree",     &btree,      BenchGet_SortedIndex},
+        {"get CompactTable", &compact,   BenchGet_CompactTable}
+    };
+
+    size_t max_chain = 0;
+    for (size_t i = 0; i < hash_table.capacity; i++)
+        if (hash_table.buckets[i].size > max_chain)
+            max_chain = hash_table.buckets[i].size;
+
+    printf("words: %zu, lookups per engine: %zu\n", words_count, words_count * BENCH_COUNT);
+    printf("HashTable max chain: %zu, CuckooTable load: %.3f, stash: %zu\n",
+           max_chain, (double)cuckoo.size / (cuckoo.capacity * CUCKOO_BUCKET_SIZE), cuckoo.stash_size);
+    printf("bytes per word: HashTable %.1f, Eytzinger %.1f, B+ tree %.1f\n",
+           (double)HashTable_bytes(&hash_table) / hash_table.size,
+           (double)SortedIndex_bytes(&eytzinger) / eytzinger.size, (double)SortedIndex_bytes(&btree) / btree.size);
+    printf("bytes per word: CompactTable %.1f (%.1f with copied strings)\n",
+           (double)CompactTable_index_bytes(&compact) / compact.size, (double)CompactTable_bytes(&compact) / compact.size);
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+        printf("%-24s %10.3f ms\n", engines[i].name, BenchGet(&engines[i], keys, words_count));
+
+    BenchPrefix(&art, &eytzinger, translates, words_count, keys);
+    BenchSmall(translates, words_count);
+    BenchHugePages(translates, words_count, keys);
+    BenchHashBatch(keys, words_count);
+    BenchPut(translates, words_count);
+    BenchSharded(translates, words_count);
+    BenchBuild(translates, words_count);
+    BenchAccessProfile(translates, words_count, keys);
+    BenchCache(&hash_table, keys, words_count);
+    BenchLatency(translates, words_count, keys);
+
+#ifdef BUILD_WORDS
+    char       *build_buffer     = NULL;
+    DoubleWord *build_translates = GenerateWords(BUILD_WORDS, &build_buffer);
+
+    BenchBuild(build_translates, BUILD_WORDS);
+
+    free(build_translates);
+    free(build_buffer);
+#endif
+
+    CompactTable_destruct(&compact);
+    SortedIndex_destruct(&btree);
+    SortedIndex_destruct(&eytzinger);
+    CuckooTable_destruct(&cuckoo);
+    ArtTree_destruct(&art);
+    HashTable_destruct(&hash_table);
+    free(keys);
+    free(translates);
+    free(buffer);
+
+    return 0;
+}
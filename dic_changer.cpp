@@ -1,76 +1,809 @@
+#include "include/hash_table.hpp"
+#include "include/dictionary.hpp"
+#include "include/stream_loader.hpp"
+#include "include/compact_table.hpp"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unistd.h>
 
-size_t get_file_size(FILE* file)
+/*
+Dictionary compiler: makes dictionary for get.asm from lines "key=value", key and value are padded
+with zeros to 8, 16 or 32 bytes:
+    ./dic_changer src/dict_old.dic src/dictionary.dic [-p 8] [-j threads] [-m megabytes] [-k] [-b image.bin]
+Input is read by chunks and threads check and convert chunks at the same time, so memory is bounded
+by -m whatever size of input is. Keys are sorted and repeated key keeps its last value (like in
+HashTable_put): every chunk is sorted to its run in one temporary file, then runs are merged.
+Every run is read through its own buffer from the same file, so one descriptor is open however many
+runs there are.
+With -k lines are only converted in order of input. -b also writes image of CompactTable
+(see include/compact_table.hpp), table is built in memory from output.
+*/
+
+const size_t CHANGER_MEMORY      = 256;        /* megabytes */
+const size_t CHANGER_MIN_CHUNK   = 1 << 16;
+const size_t CHANGER_CHUNK_BYTES = 4;          /* chunk, its records and converted lines per byte of chunk */
+const size_t CHANGER_MAX_ERRORS  = 20;         /* printed, the rest are only counted */
+const size_t CHANGER_MIN_READ    = 1 << 12;    /* buffer of run while merging, -m is shared by all of them */
+
+struct Record
+{
+    const char *key;
+    size_t key_len;
+    const char *value;
+    size_t value_len;
+    size_t line;
+};
+
+struct Chunk
+{
+    size_t number;
+    size_t first_line;
+    char *buffer;
+    size_t size;
+};
+
+/* Place of sorted run in runs file */
+struct Run
+{
+    size_t offset;
+    size_t size;
+};
+
+/* Cursor of sorted run, line is the current record. Bytes from begin to filled are read
+   but not used yet, offset is the next byte of run in file */
+struct RunCursor
+{
+    int fd;
+    size_t number;
+    size_t offset;
+    size_t end;
+
+    char *buffer;
+    size_t capacity;
+    size_t begin;
+    size_t filled;
+
+    char *line;
+    size_t len;
+    size_t key_len;
+    bool failed;
+};
+
+struct Changer
+{
+    const char *input_name;
+    size_t pad;
+    bool keep_order;
+
+    BoundedQueue chunks;
+
+    std::mutex lock;
+    std::condition_variable turn;
+    size_t next_to_write;          /* number of chunk which is written next with keep_order */
+    FILE *output;
+
+    FILE *runs_file;               /* all runs one after another */
+    size_t runs_size;
+    Run *runs;                     /* by numbers of chunks */
+    size_t runs_capacity;
+
+    size_t words_count;
+    size_t errors_count;
+    bool failed;
+};
+
+//-----------------------------------------------------------------------------
+
+size_t padded(size_t len, size_t pad)
+{
+    return (len + pad - 1) / pad * pad;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Trailing zeros of padded dictionary aren't part of word */
+size_t word_len(const char* begin, const char* end)
+{
+    while (end > begin && end[-1] == '\0')
+        end--;
+
+    return end - begin;
+}
+
+//-----------------------------------------------------------------------------
+
+int compare_keys(const char *first, size_t first_len, const char *second, size_t second_len)
+{
+    int result = memcmp(first, second, (first_len < second_len) ? first_len : second_len);
+    if (result != 0)
+        return result;
+
+    return (first_len > second_len) - (first_len < second_len);
+}
+
+//-----------------------------------------------------------------------------
+
+/* The same keys stay in order of lines */
+int compare_records(const void *first, const void *second)
+{
+    const Record *a = (const Record *)first;
+    const Record *b = (const Record *)second;
+
+    int result = compare_keys(a->key, a->key_len, b->key, b->key_len);
+    if (result != 0)
+        return result;
+
+    return (a->line > b->line) - (a->line < b->line);
+}
+
+//-----------------------------------------------------------------------------
+
+void report_error(Changer *ths, size_t line, const char *message)
+{
+    std::lock_guard<std::mutex> guard(ths->lock);
+
+    if (ths->errors_count++ < CHANGER_MAX_ERRORS)
+        fprintf(stderr, "%s:%zu: %s\n", ths->input_name, line, message);
+}
+
+//-----------------------------------------------------------------------------
+
+/* NULL if line is right */
+const char* check_line(const char *begin, const char *eq, const char *end, size_t key_len, size_t value_len)
+{
+    if (eq == NULL)
+        return "no '=' in line";
+    if (key_len == 0)
+        return "empty key";
+    if (memchr(begin, '\0', key_len) != NULL)
+        return "zero byte inside key";
+    if (memchr(eq + 1, '\0', value_len) != NULL)
+        return "zero byte inside value";
+    if (memchr(eq + 1, '=', end - eq - 1) != NULL)
+        return "second '=' in line";
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t split_lines(Changer *ths, Chunk *chunk, Record *records)
+{
+    size_t count = 0;
+    size_t line  = chunk->first_line;
+
+    const char *ptr = chunk->buffer;
+    const char *end = chunk->buffer + chunk->size;
+
+    for (; ptr < end; line++)
+    {
+        const char *eol = (const char *)memchr(ptr, '\n', end - ptr);
+        if (eol == NULL)
+            eol = end;
+
+        const char *line_end = (eol > ptr && eol[-1] == '\r') ? eol - 1 : eol;
+
+        if (line_end > ptr)
+        {
+            const char *eq = (const char *)memchr(ptr, '=', line_end - ptr);
+
+            size_t key_len   = (eq == NULL) ? 0 : word_len(ptr, eq);
+            size_t value_len = (eq == NULL) ? 0 : word_len(eq + 1, line_end);
+
+            const char *error = check_line(ptr, eq, line_end, key_len, value_len);
+            if (error != NULL)
+                report_error(ths, line, error);
+            else
+                records[count++] = {ptr, key_len, eq + 1, value_len, line};
+        }
+
+        ptr = eol + 1;
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Repeated keys are together after sort, only the last one is left */
+size_t remove_repeated(Record *records, size_t count)
+{
+    size_t left = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i + 1 < count && !compare_keys(records[i].key, records[i].key_len, records[i + 1].key, records[i + 1].key_len))
+            continue;
+
+        records[left++] = records[i];
+    }
+
+    return left;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t write_records(Changer *ths, Record *records, size_t count, char *output)
+{
+    char *ptr = output;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(ptr, records[i].key, records[i].key_len);
+        ptr += padded(records[i].key_len, ths->pad);
+        *ptr++ = '=';
+
+        memcpy(ptr, records[i].value, records[i].value_len);
+        ptr += padded(records[i].value_len, ths->pad);
+        *ptr++ = '\n';
+    }
+
+    return ptr - output;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Converted chunk goes to output in order of chunks or to its own place in runs file. Place is
+   taken under lock and run is written without it, so threads write runs at the same time.
+   Chunk takes its turn even if it failed, otherwise next chunks would wait forever */
+void emit_chunk(Changer *ths, Chunk *chunk, const char *data, size_t size, size_t words_count)
+{
+    if (ths->keep_order)
+    {
+        std::unique_lock<std::mutex> guard(ths->lock);
+        ths->turn.wait(guard, [ths, chunk] { return ths->next_to_write == chunk->number; });
+
+        if (data == NULL || fwrite(data, 1, size, ths->output) != size)
+            ths->failed = true;
+
+        ths->words_count += words_count;
+        ths->next_to_write++;
+        ths->turn.notify_all();
+        return;
+    }
+
+    size_t offset = 0;
+    {
+        std::lock_guard<std::mutex> guard(ths->lock);
+
+        if (chunk->number >= ths->runs_capacity)
+        {
+            size_t capacity = 2 * chunk->number + 16;
+            Run *runs = (Run *)realloc(ths->runs, capacity * sizeof(Run));
+
+            if (runs == NULL)
+                data = NULL;
+            else
+            {
+                memset(runs + ths->runs_capacity, 0, (capacity - ths->runs_capacity) * sizeof(Run));
+                ths->runs = runs;
+                ths->runs_capacity = capacity;
+            }
+        }
+
+        if (data == NULL)
+        {
+            ths->failed = true;
+            return;
+        }
+
+        offset = ths->runs_size;
+        ths->runs_size += size;
+        ths->runs[chunk->number] = {offset, size};
+    }
+
+    int fd = fileno(ths->runs_file);
+
+    for (size_t done = 0; done < size; )
+    {
+        ssize_t written = pwrite(fd, data + done, size - done, offset + done);
+        if (written <= 0)
+        {
+            std::lock_guard<std::mutex> guard(ths->lock);
+            ths->failed = true;
+            return;
+        }
+
+        done += written;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void convert_chunk(Changer *ths, Chunk *chunk)
+{
+    size_t lines_count = GetEolCount(chunk->buffer, chunk->size) + 1;
+
+    Record *records = (Record *)calloc(lines_count, sizeof(Record));
+    if (records == NULL)
+    {
+        emit_chunk(ths, chunk, NULL, 0, 0);
+        return;
+    }
+
+    size_t count = split_lines(ths, chunk, records);
+
+    if (!ths->keep_order)
+    {
+        qsort(records, count, sizeof(Record), compare_records);
+        count = remove_repeated(records, count);
+    }
+
+    size_t output_size = 0;
+    for (size_t i = 0; i < count; i++)
+        output_size += padded(records[i].key_len, ths->pad) + padded(records[i].value_len, ths->pad) + 2;
+
+    char *output = (char *)calloc(output_size + 1, sizeof(char));
+    if (output != NULL)
+        write_records(ths, records, count, output);
+
+    emit_chunk(ths, chunk, output, output_size, count);
+
+    free(output);
+    free(records);
+}
+
+//-----------------------------------------------------------------------------
+
+void chunk_worker(Changer *ths)
+{
+    Chunk *chunk = NULL;
+
+    while ((chunk = (Chunk *)BoundedQueue_pop(&ths->chunks)) != NULL)
+    {
+        convert_chunk(ths, chunk);
+
+        free(chunk->buffer);
+        free(chunk);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool push_chunk(Changer *ths, size_t number, size_t first_line, char *buffer, size_t size)
+{
+    Chunk *chunk = (Chunk *)calloc(1, sizeof(Chunk));
+    if (chunk == NULL)
+        return false;
+
+    *chunk = {number, first_line, buffer, size};
+    BoundedQueue_push(&ths->chunks, chunk);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Chunks end with whole lines: unfinished last line is moved to the next buffer, buffer grows
+   only for line longer than chunk. Returns number of chunks */
+size_t read_chunks(Changer *ths, FILE *file, size_t chunk_size)
 {
-    size_t size = 0;
-    fseek(file, 0, SEEK_END);
-    size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    size_t number = 0;
+    size_t line   = 1;
+
+    size_t capacity = chunk_size;
+    size_t used     = 0;
+    char *buffer    = (char *)malloc(capacity);
+
+    while (buffer != NULL)
+    {
+        used += fread(buffer + used, 1, capacity - used, file);
+        bool end = (used < capacity);
+
+        const char *last_eol = (const char *)memrchr(buffer, '\n', used);
+        size_t whole = end ? used : (last_eol == NULL) ? 0 : last_eol + 1 - buffer;
+
+        if (whole == 0 && !end)
+        {
+            capacity *= 2;
+            char *bigger = (char *)realloc(buffer, capacity);
+            if (bigger == NULL)
+                break;
+
+            buffer = bigger;
+            continue;
+        }
+
+        size_t tail = used - whole;
+        size_t next_capacity = (2 * tail > chunk_size) ? 2 * tail : chunk_size;
+
+        char *next = end ? NULL : (char *)malloc(next_capacity);
+        if (!end && next == NULL)
+            break;
+        if (next != NULL)
+            memcpy(next, buffer + whole, tail);
+
+        size_t lines_count = GetEolCount(buffer, whole);
+
+        if (whole == 0)
+            free(buffer);
+        else if (!push_chunk(ths, number++, line, buffer, whole))
+        {
+            free(buffer);
+            free(next);
+            next = NULL;
+            end  = false;
+        }
+
+        line  += lines_count;
+        buffer = next;
+        used   = tail;
+        capacity = next_capacity;
+
+        if (end)
+            return number;
+    }
+
+    free(buffer);
+
+    std::lock_guard<std::mutex> guard(ths->lock);
+    ths->failed = true;
 
-    return size;
+    return number;
 }
 
-size_t get_eol_count(const char* buffer)
+//-----------------------------------------------------------------------------
+
+/* Unfinished line is moved to the beginning of buffer before the next read, buffer grows
+   only for line longer than it */
+bool RunCursor_next(RunCursor *ths)
 {
-    size_t eol_count = 0;
+    ths->begin += ths->len;
+    ths->len    = 0;
+
+    const char *eol = NULL;
 
-    while(*buffer != '\0')
+    while ((eol = (const char *)memchr(ths->buffer + ths->begin, '\n', ths->filled - ths->begin)) == NULL)
     {
-        if (*buffer == '\n') eol_count++;
-        buffer++;
+        if (ths->offset == ths->end)
+            return false;
+
+        size_t rest = ths->filled - ths->begin;
+        memmove(ths->buffer, ths->buffer + ths->begin, rest);
+        ths->begin  = 0;
+        ths->filled = rest;
+
+        if (rest == ths->capacity)
+        {
+            char *bigger = (char *)realloc(ths->buffer, 2 * ths->capacity);
+            if (bigger == NULL)
+            {
+                ths->failed = true;
+                return false;
+            }
+
+            ths->buffer    = bigger;
+            ths->capacity *= 2;
+        }
+
+        size_t wanted = ths->capacity - ths->filled;
+        if (wanted > ths->end - ths->offset)
+            wanted = ths->end - ths->offset;
+
+        ssize_t got = pread(ths->fd, ths->buffer + ths->filled, wanted, ths->offset);
+        if (got <= 0)
+        {
+            ths->failed = true;
+            return false;
+        }
+
+        ths->filled += got;
+        ths->offset += got;
     }
 
-    return eol_count;
+    ths->line = ths->buffer + ths->begin;
+    ths->len  = eol + 1 - ths->line;
+
+    const char *eq   = (const char *)memchr(ths->line, '=', ths->len);
+    const char *zero = (const char *)memchr(ths->line, '\0', eq - ths->line);
+    ths->key_len = ((zero == NULL) ? eq : zero) - ths->line;
+
+    return true;
 }
 
-int main()
+//-----------------------------------------------------------------------------
+
+/* Runs of the same key go in order of runs, so the last one has the last value */
+bool cursor_less(RunCursor *first, RunCursor *second)
 {
-    FILE* file = fopen("src/dict_old.dic", "rb");
-    size_t file_size = get_file_size(file);
+    int result = compare_keys(first->line, first->key_len, second->line, second->key_len);
+    if (result != 0)
+        return result < 0;
+
+    return first->number < second->number;
+}
+
+//-----------------------------------------------------------------------------
+
+void heap_push(RunCursor **heap, size_t *size, RunCursor *cursor)
+{
+    size_t i = (*size)++;
+
+    for (; i > 0 && cursor_less(cursor, heap[(i - 1) / 2]); i = (i - 1) / 2)
+        heap[i] = heap[(i - 1) / 2];
+
+    heap[i] = cursor;
+}
+
+//-----------------------------------------------------------------------------
+
+RunCursor* heap_pop(RunCursor **heap, size_t *size)
+{
+    RunCursor *top  = heap[0];
+    RunCursor *last = heap[--(*size)];
+
+    size_t i = 0;
+    while (2 * i + 1 < *size)
+    {
+        size_t child = 2 * i + 1;
+        if (child + 1 < *size && cursor_less(heap[child + 1], heap[child]))
+            child++;
+
+        if (!cursor_less(heap[child], last))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    if (*size > 0)
+        heap[i] = last;
+
+    return top;
+}
+
+//-----------------------------------------------------------------------------
+
+/* k-way merge of sorted runs, only the last record of repeated key is written.
+   Every run is read by buffer of read_size bytes */
+bool merge_runs(Changer *ths, size_t runs_count, size_t read_size)
+{
+    RunCursor *cursors = (RunCursor *)calloc(runs_count + 1, sizeof(RunCursor));
+    RunCursor **heap   = (RunCursor **)calloc(runs_count + 1, sizeof(RunCursor *));
+    size_t heap_size   = 0;
+
+    if (cursors == NULL || heap == NULL)
+    {
+        free(cursors);
+        free(heap);
+        return false;
+    }
+
+    bool written = fflush(ths->runs_file) == 0;
+    int fd = fileno(ths->runs_file);
+
+    for (size_t i = 0; i < runs_count && written; i++)
+    {
+        cursors[i].fd       = fd;
+        cursors[i].number   = i;
+        cursors[i].offset   = ths->runs[i].offset;
+        cursors[i].end      = ths->runs[i].offset + ths->runs[i].size;
+        cursors[i].capacity = read_size;
+        cursors[i].buffer   = (char *)malloc(read_size);
+
+        written = cursors[i].buffer != NULL;
+
+        if (written && RunCursor_next(&cursors[i]))
+            heap_push(heap, &heap_size, &cursors[i]);
+    }
+
+    ths->words_count = 0;
 
-    char *buffer = (char *)calloc(file_size + 1, sizeof(char));
-    fread(buffer, sizeof(char), file_size, file);
-    fclose(file);
+    while (heap_size > 0 && written)
+    {
+        RunCursor *best = heap_pop(heap, &heap_size);
+
+        while (heap_size > 0 && !compare_keys(heap[0]->line, heap[0]->key_len, best->line, best->key_len))
+        {
+            RunCursor *later = heap_pop(heap, &heap_size);
 
-    char* new_buffer = (char *)calloc(file_size * 8 + 1, sizeof(char));
-    size_t eol_count = get_eol_count(buffer);
+            if (RunCursor_next(best))
+                heap_push(heap, &heap_size, best);
+            best = later;
+        }
 
-    char* buf_ptr = buffer;
-    char* new_buf_ptr = new_buffer;
+        written = fwrite(best->line, 1, best->len, ths->output) == best->len;
+        ths->words_count++;
 
-    char* eq = strchr(buf_ptr, '=');
-    file = fopen("src/new_dict_.dic", "wb");
+        if (RunCursor_next(best))
+            heap_push(heap, &heap_size, best);
+    }
 
-    for (int i = 0; i < eol_count; i++)
+    for (size_t i = 0; i < runs_count; i++)
     {
-        memcpy(new_buf_ptr, buf_ptr, eq - buf_ptr);
+        written = written && !cursors[i].failed;
+        free(cursors[i].buffer);
+    }
 
-        new_buf_ptr += eq - buf_ptr;
+    free(cursors);
+    free(heap);
 
-        for (int j = 0; j < (8 - (eq - buf_ptr) % 8) % 8; j++)
-            *(new_buf_ptr++) = 0;
-        
-        *new_buf_ptr++ = '=';
-        buf_ptr = eq + 1;
+    return written;
+}
+
+//-----------------------------------------------------------------------------
 
-        eq = strchr(buf_ptr, '\n');
-        memcpy(new_buf_ptr, buf_ptr, eq - buf_ptr);
-        new_buf_ptr += eq - buf_ptr;
-        
-        for (int j = 0; j < (8 - (eq - buf_ptr) % 8) % 8; j++)
-            *(new_buf_ptr++) = 0;
-        
-        *new_buf_ptr++ = '\n';
-        buf_ptr = eq + 1;
+bool write_image(const char *dictionary_name, const char *image_name)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_name, &buffer);
+    if (buffer == NULL)
+        return false;
 
-        eq = strchr(buf_ptr, '=');
+    size_t words_count = GetEolCount(buffer, buffer_size);
+    if (words_count == 0)
+    {
+        free(buffer);
+        return false;
     }
 
-    fwrite(new_buffer, sizeof(char), new_buf_ptr - new_buffer, file);
-    
-    fclose(file);
-    free(new_buffer);
+    DoubleWord *translates = Parser(buffer, words_count, buffer_size);
+
+    CompactTable table = {};
+    bool written = CompactTable_build(&table, translates, words_count) == HASH_OK &&
+                   CompactTable_save(&table, image_name) == HASH_OK;
+
+    CompactTable_destruct(&table);
+    free(translates);
     free(buffer);
+
+    return written;
+}
+
+//-----------------------------------------------------------------------------
+
+bool parse_number(const char *arg, size_t *number)
+{
+    if (arg == NULL)
+        return false;
+
+    char *end = NULL;
+    *number = strtoul(arg, &end, 10);
+
+    return *end == '\0' && *number > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+int usage(const char *program)
+{
+    printf("Usage: %s input.dic output.dic [-p 8|16|32] [-j threads] [-m megabytes] [-k] [-b image.bin]\n"
+           "    -p  padding of keys and values (8)\n"
+           "    -j  converting threads (all cores)\n"
+           "    -m  memory for chunks (%zu)\n"
+           "    -k  keep order of lines, don't sort and remove repeated keys\n"
+           "    -b  write CompactTable image too\n", program, CHANGER_MEMORY);
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage(argv[0]);
+
+    Changer changer  = {};
+    changer.input_name = argv[1];
+    changer.pad        = 8;
+
+    size_t threads_count = std::thread::hardware_concurrency();
+    size_t memory        = CHANGER_MEMORY;
+    const char *image    = NULL;
+
+    if (threads_count == 0)
+        threads_count = 1;
+
+    for (int i = 3; i < argc; i++)
+    {
+        bool right = true;
+
+        if (!strcmp(argv[i], "-p"))
+            right = parse_number(argv[++i], &changer.pad) && (changer.pad == 8 || changer.pad == 16 || changer.pad == 32);
+        else if (!strcmp(argv[i], "-j"))
+            right = parse_number(argv[++i], &threads_count);
+        else if (!strcmp(argv[i], "-m"))
+            right = parse_number(argv[++i], &memory);
+        else if (!strcmp(argv[i], "-k"))
+            changer.keep_order = true;
+        else if (!strcmp(argv[i], "-b"))
+            right = (image = argv[++i]) != NULL;
+        else
+            right = false;
+
+        if (!right)
+            return usage(argv[0]);
+    }
+
+    size_t chunk_size = (memory << 20) / (CHANGER_CHUNK_BYTES * 2 * threads_count);
+    if (chunk_size < CHANGER_MIN_CHUNK)
+        chunk_size = CHANGER_MIN_CHUNK;
+
+    FILE* input = fopen(argv[1], "rb");
+    if (input == NULL)
+    {
+        printf("Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+
+    changer.output = fopen(argv[2], "wb");
+    if (changer.output == NULL)
+    {
+        printf("Couldn't open %s\n", argv[2]);
+        fclose(input);
+        return 1;
+    }
+
+    posix_fadvise(fileno(input), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (!changer.keep_order)
+        changer.runs_file = tmpfile();
+
+    if (!changer.keep_order && changer.runs_file == NULL)
+    {
+        printf("Couldn't make temporary file\n");
+        fclose(input);
+        fclose(changer.output);
+        remove(argv[2]);
+        return 1;
+    }
+
+    /* Chunks in queue and chunks in threads: 2 * threads_count at most */
+    BoundedQueue_construct(&changer.chunks, threads_count);
+
+    std::thread *threads = new std::thread[threads_count];
+    for (size_t i = 0; i < threads_count; i++)
+        threads[i] = std::thread(chunk_worker, &changer);
+
+    size_t chunks_count = read_chunks(&changer, input, chunk_size);
+    bool read_failed    = ferror(input) != 0;
+
+    BoundedQueue_close(&changer.chunks);
+    for (size_t i = 0; i < threads_count; i++)
+        threads[i].join();
+
+    delete[] threads;
+    BoundedQueue_destruct(&changer.chunks);
+    fclose(input);
+
+    /* Runs were written, memory of chunks is shared by their buffers now */
+    size_t read_size = (memory << 20) / (chunks_count + 1);
+    if (read_size < CHANGER_MIN_READ)
+        read_size = CHANGER_MIN_READ;
+    if (read_size > chunk_size)
+        read_size = chunk_size;
+
+    if (!changer.keep_order && !changer.failed && !read_failed)
+        changer.failed = !merge_runs(&changer, chunks_count, read_size);
+
+    if (changer.runs_file != NULL)
+        fclose(changer.runs_file);
+    free(changer.runs);
+
+    bool failed = fclose(changer.output) != 0 || changer.failed || read_failed || changer.errors_count > 0;
+
+    if (failed)
+    {
+        if (changer.errors_count > 0)
+            printf("%zu wrong lines in %s\n", changer.errors_count, argv[1]);
+        else
+            printf("Couldn't make %s\n", argv[2]);
+
+        remove(argv[2]);
+        return 1;
+    }
+
+    printf("%zu words written to %s\n", changer.words_count, argv[2]);
+
+    if (image != NULL && !write_image(argv[2], image))
+    {
+        printf("Couldn't make image %s\n", image);
+        return 1;
+    }
+
+    return 0;
 }
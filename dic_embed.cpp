@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+Makes header with dictionary embedded to program (see include/embedded_table.hpp):
+    ./dic_embed src/dictionary.dic include/embedded_words.hpp EMBEDDED_WORDS
+Keys are written padded with zeros to 8 bytes, like in dictionary for get.asm
+*/
+
+size_t get_file_size(FILE* file)
+{
+    size_t size = 0;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    return size;
+}
+
+/* Octal escapes always have 3 digits, so next character can't continue them */
+void write_literal(FILE* file, const char* begin, const char* end, size_t padded_len)
+{
+    fputc('"', file);
+
+    for (const char* ptr = begin; ptr < end; ptr++)
+    {
+        unsigned char symbol = *ptr;
+
+        if (symbol == '"' || symbol == '\\' || symbol == '?' || symbol < ' ' || symbol >= 0x7F)
+            fprintf(file, "\\%03o", symbol);
+        else
+            fputc(symbol, file);
+    }
+
+    for (size_t i = end - begin; i < padded_len; i++)
+        fprintf(file, "\\000");
+
+    fputc('"', file);
+}
+
+/* Trailing zeros of padded dictionary aren't part of word */
+const char* word_end(const char* begin, const char* end)
+{
+    const char* zero = (const char *)memchr(begin, '\0', end - begin);
+    return (zero == NULL) ? end : zero;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 4)
+    {
+        printf("Usage: %s input.dic output.hpp NAME\n", argv[0]);
+        return 1;
+    }
+
+    const char* name = argv[3];
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL)
+    {
+        printf("Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+
+    size_t file_size = get_file_size(file);
+    char *buffer = (char *)calloc(file_size + 1, sizeof(char));
+    fread(buffer, sizeof(char), file_size, file);
+    fclose(file);
+
+    file = fopen(argv[2], "wb");
+    if (file == NULL)
+    {
+        printf("Couldn't open %s\n", argv[2]);
+        free(buffer);
+        return 1;
+    }
+
+    fprintf(file, "/* Made by dic_embed from %s, don't edit */\n\n"
+                  "#pragma once\n"
+                  "#include \"embedded_table.hpp\"\n\n"
+                  "constexpr HashTableEl %s_elements[] = {\n", argv[1], name);
+
+    size_t words_count = 0;
+    char* buf_ptr = buffer;
+    char* buf_end = buffer + file_size;
+
+    while (buf_ptr < buf_end)
+    {
+        char* eol = (char *)memchr(buf_ptr, '\n', buf_end - buf_ptr);
+        if (eol == NULL) eol = buf_end;
+
+        char* eq = (char *)memchr(buf_ptr, '=', eol - buf_ptr);
+        if (eq != NULL && eq != buf_ptr)
+        {
+            const char* key_end   = word_end(buf_ptr, eq);
+            const char* value_end = word_end(eq + 1, eol);
+            size_t key_len = key_end - buf_ptr;
+
+            fprintf(file, "    {");
+            write_literal(file, buf_ptr, key_end, (key_len + 7) / 8 * 8);
+            fprintf(file, ", ");
+            write_literal(file, eq + 1, value_end, value_end - (eq + 1));
+            fprintf(file, "},\n");
+
+            words_count++;
+        }
+
+        buf_ptr = eol + 1;
+    }
+
+    if (words_count == 0)
+    {
+        printf("No words in %s\n", argv[1]);
+        fclose(file);
+        free(buffer);
+        return 1;
+    }
+
+    fprintf(file, "};\n\n"
+                  "constexpr size_t %s_capacity = EmbeddedCapacity(%zu);\n\n"
+                  "constexpr EmbeddedNodes<%zu> %s_nodes = EmbeddedNodes_build<%zu, %s_capacity>(%s_elements);\n\n"
+                  "constexpr std::array<My_list<HashTableEl>, %s_capacity> %s_buckets =\n"
+                  "    EmbeddedBuckets_build<%zu, %s_capacity>(%s_nodes);\n\n"
+                  "HashTable %s = EmbeddedTable_build(%s_buckets, %s_nodes);\n",
+                  name, words_count,
+                  words_count, name, words_count, name, name,
+                  name, name, words_count, name, name,
+                  name, name, name);
+
+    fclose(file);
+    free(buffer);
+
+    printf("%zu words written to %s\n", words_count, argv[2]);
+    return 0;
+}
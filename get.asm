@@ -1,5 +1,4 @@
     default rel
-    extern HashingFunction
     global HashTable_get
  
 section .text
@@ -47,7 +46,11 @@ HashTable_get:
     mov r9, rsi ; r9 = char ptr
 
     mov rdi, r9
-    call HashingFunction ; rax = hash
+    push r8
+    push r9
+    call [r8 + 0x18]     ; rax = hash_table->hash_function(key)
+    pop r9
+    pop r8
 
     mov rcx, [r8] ; rcx = capacity
     xor rdx, rdx
@@ -84,6 +87,11 @@ get_loop:
     jmp get_loop
 
 return_ptr:
+%ifdef HASH_TABLE_STATS
+    inc QWORD [r8 + 0x20]      ; counters.gets_hit++
+    lea rax, [rcx + 1]
+    add QWORD [r8 + 0x30], rax ; counters.probes_hit += counter + 1
+%endif
     mov rax, [r10] ; curr bucket
     mov rbx, rcx
     
@@ -95,6 +103,10 @@ return_ptr:
     ret
 
 return_null:
+%ifdef HASH_TABLE_STATS
+    inc QWORD [r8 + 0x28]      ; counters.gets_miss++
+    add QWORD [r8 + 0x38], r11 ; counters.probes_miss += curr size
+%endif
     xor rax, rax
     pop rbx
     ret
@@ -0,0 +1,298 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+#include "cuckoo_table.hpp"
+
+/*
+Ordering of elements by how often they are asked. Queries are recorded to log as
+one byte of length and the key itself. HashTable_reorder counts logged keys and puts
+hot elements to the beginning of their buckets, so get.asm finds them on the first compare.
+HashTable_get_mtf moves every found element to the front of its bucket instead.
+*/
+
+const size_t QUERY_LOG_MAX_KEY = 255;
+
+struct QueryLog
+{
+    FILE  *file;
+    size_t count;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error QueryLog_open(QueryLog *ths, const char *path);
+
+hash_error QueryLog_write(QueryLog *ths, KeyType key);
+
+hash_error QueryLog_close(QueryLog *ths);
+
+KeyType* QueryLog_read(const char *path, size_t *count, char **buffer);
+
+hash_error HashTable_reorder(HashTable *ths, KeyType *queries, size_t count);
+
+ValueType* HashTable_get_mtf(HashTable *ths, KeyType key);
+
+hash_error CuckooTable_reorder(CuckooTable *ths, KeyType *queries, size_t count);
+
+//=============================================================================
+
+/* Log is appended, so several sessions may be recorded to one file */
+hash_error QueryLog_open(QueryLog *ths, const char *path)
+{
+    ths->file  = fopen(path, "ab");
+    ths->count = 0;
+
+    return (ths->file == NULL) ? HASH_ERROR : HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error QueryLog_write(QueryLog *ths, KeyType key)
+{
+    size_t len = strlen(key);
+    if (len == 0 || len > QUERY_LOG_MAX_KEY)
+        return HASH_ERROR;
+
+    unsigned char len_byte = (unsigned char)len;
+
+    if (fwrite(&len_byte, 1, 1, ths->file) != 1 || fwrite(key, 1, len, ths->file) != len)
+        return HASH_ERROR;
+
+    ths->count++;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error QueryLog_close(QueryLog *ths)
+{
+    if (ths->file == NULL)
+        return HASH_ERROR;
+
+    fclose(ths->file);
+    ths->file = NULL;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Keys are placed to *buffer padded with zeros to 8 bytes and followed by zero byte, like keys of dictionary
+   (HashingFunction reads by 8 bytes until zero after the word).
+   Returns NULL if log can't be read, both arrays must be freed by caller */
+KeyType* QueryLog_read(const char *path, size_t *count, char **buffer)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    size_t file_size = GetFileSize(file);
+    unsigned char *log = (unsigned char *)calloc(file_size + 1, 1);
+    file_size = fread(log, 1, file_size, file);
+    fclose(file);
+
+    /* Every record is at least 2 bytes and takes at most 15 bytes more in buffer */
+    *buffer = (char *)calloc(file_size * 8 + 8, 1);
+    KeyType *queries = (KeyType *)calloc(file_size / 2 + 1, sizeof(KeyType));
+
+    char  *key_ptr = *buffer;
+    size_t pos     = 0;
+    *count = 0;
+
+    while (pos < file_size && pos + 1 + log[pos] <= file_size)
+    {
+        size_t len = log[pos];
+
+        memcpy(key_ptr, log + pos + 1, len);
+        queries[(*count)++] = key_ptr;
+
+        key_ptr += (len + 7) / 8 * 8 + 8;
+        pos     += 1 + len;
+    }
+
+    free(log);
+    return queries;
+}
+
+//-----------------------------------------------------------------------------
+
+struct AccessCount
+{
+    HashTableEl        el;
+    uint32_t           hash;       /* stored hash of cuckoo slot, it moves with element */
+    unsigned long long count;
+};
+
+//-----------------------------------------------------------------------------
+
+/* Stable, because elements which are asked equally keep their order */
+void AccessCount_sort(AccessCount *elements, size_t size)
+{
+    for (size_t i = 1; i < size; i++)
+    {
+        AccessCount curr = elements[i];
+        size_t j = i;
+
+        for (; j > 0 && elements[j - 1].count < curr.count; j--)
+            elements[j] = elements[j - 1];
+
+        elements[j] = curr;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Buckets are sorted by count of queries and packed, so order of nodes in array
+   (which get.asm uses) is the same as order of list */
+hash_error HashTable_reorder(HashTable *ths, KeyType *queries, size_t count)
+{
+    size_t *bucket_offsets = (size_t *)calloc(ths->capacity + 1, sizeof(size_t));
+    if (bucket_offsets == NULL)
+        return HASH_REALLOC_ERROR;
+
+    for (size_t i = 0; i < ths->capacity; i++)
+        bucket_offsets[i + 1] = bucket_offsets[i] + ths->buckets[i].capacity;
+
+    unsigned long long *counts = (unsigned long long *)calloc(bucket_offsets[ths->capacity] + 1, sizeof(unsigned long long));
+    AccessCount *elements = NULL;
+
+    size_t max_chain = 0;
+    for (size_t i = 0; i < ths->capacity; i++)
+        if (ths->buckets[i].size > max_chain)
+            max_chain = ths->buckets[i].size;
+
+    elements = (AccessCount *)calloc(max_chain + 1, sizeof(AccessCount));
+
+    if (counts == NULL || elements == NULL)
+    {
+        free(bucket_offsets);
+        free(counts);
+        free(elements);
+        return HASH_REALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t bucket_index = ths->hash_function(queries[i]) % ths->capacity;
+        HashTableEl *found = HashTable_bucket_find(&ths->buckets[bucket_index], queries[i]);
+
+        if (found != NULL)
+        {
+            Node<HashTableEl> *node = (Node<HashTableEl> *)found;
+            counts[bucket_offsets[bucket_index] + (node - ths->buckets[bucket_index].data)]++;
+        }
+    }
+
+    for (size_t i = 0; i < ths->capacity; i++)
+    {
+        My_list<HashTableEl> *curr_bucket = &ths->buckets[i];
+        size_t curr_size = curr_bucket->size;
+
+        long long curr_node = curr_bucket->head;
+        for (size_t j = 0; j < curr_size; j++, curr_node = curr_bucket->data[curr_node].next)
+        {
+            elements[j].el    = curr_bucket->data[curr_node].value;
+            elements[j].count = counts[bucket_offsets[i] + curr_node];
+        }
+
+        AccessCount_sort(elements, curr_size);
+
+        /* Values move along the list, links stay the same */
+        curr_node = curr_bucket->head;
+        for (size_t j = 0; j < curr_size; j++, curr_node = curr_bucket->data[curr_node].next)
+            curr_bucket->data[curr_node].value = elements[j].el;
+    }
+
+    free(bucket_offsets);
+    free(counts);
+    free(elements);
+
+    return HashTable_pack(ths);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Get which moves found element to the front of bucket. Elements before it move one step back,
+   links of list stay the same. In C order of list is used, get.asm uses order of nodes in array,
+   they are the same after HashTable_reorder or HashTable_pack */
+ValueType* HashTable_get_mtf(HashTable *ths, KeyType key)
+{
+    My_list<HashTableEl> *curr_bucket = &ths->buckets[ths->hash_function(key) % ths->capacity];
+    Node<HashTableEl> *data = curr_bucket->data;
+
+    HashTableEl *found = HashTable_bucket_find(curr_bucket, key);
+    if (found == NULL)
+        return NULL;
+
+    long long found_node = (Node<HashTableEl> *)found - data;
+    HashTableEl found_el = *found;
+    HashTableEl moved    = data[curr_bucket->head].value;
+
+    for (long long curr_node = curr_bucket->head; curr_node != found_node; curr_node = data[curr_node].next)
+    {
+        HashTableEl next_el = data[data[curr_node].next].value;
+        data[data[curr_node].next].value = moved;
+        moved = next_el;
+    }
+
+    data[curr_bucket->head].value = found_el;
+    return &data[curr_bucket->head].value.value;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Open addressing can't move element out of its two buckets,
+   so hot elements only take first slots of their bucket */
+hash_error CuckooTable_reorder(CuckooTable *ths, KeyType *queries, size_t count)
+{
+    unsigned long long *counts = (unsigned long long *)calloc(ths->capacity * CUCKOO_BUCKET_SIZE, sizeof(unsigned long long));
+    if (counts == NULL)
+        return HASH_REALLOC_ERROR;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ValueType *found = CuckooTable_get(ths, queries[i]);
+        if (found == NULL)
+            continue;
+
+        /* Bucket has hashes before slots, so slot is found by its bucket */
+        if ((char *)found < (char *)ths->buckets || (char *)found >= (char *)(ths->buckets + ths->capacity))
+            continue;    /* in stash */
+
+        size_t bucket_index = ((char *)found - (char *)ths->buckets) / sizeof(CuckooBucket);
+        CuckooBucket *bucket = &ths->buckets[bucket_index];
+
+        HashTableEl *el = (HashTableEl *)((char *)found - offsetof(HashTableEl, value));
+        counts[bucket_index * CUCKOO_BUCKET_SIZE + (el - bucket->slots)]++;
+    }
+
+    AccessCount elements[CUCKOO_BUCKET_SIZE] = {};
+
+    for (size_t i = 0; i < ths->capacity; i++)
+    {
+        CuckooBucket *bucket = &ths->buckets[i];
+
+        for (size_t j = 0; j < CUCKOO_BUCKET_SIZE; j++)
+        {
+            elements[j].el   = bucket->slots[j];
+            elements[j].hash = bucket->hashes[j];
+            /* Empty slots go last */
+            elements[j].count = (bucket->slots[j].key) ? counts[i * CUCKOO_BUCKET_SIZE + j] + 1 : 0;
+        }
+
+        AccessCount_sort(elements, CUCKOO_BUCKET_SIZE);
+
+        for (size_t j = 0; j < CUCKOO_BUCKET_SIZE; j++)
+        {
+            bucket->slots[j]  = elements[j].el;
+            bucket->hashes[j] = elements[j].hash;
+        }
+    }
+
+    free(counts);
+    return HASH_OK;
+}
@@ -0,0 +1,539 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <emmintrin.h>
+#include "hash_table.hpp"
+
+/*
+Adaptive radix tree. Alternative index for the same dictionary which also supports ordered
+prefix queries (autocomplete). Every key is indexed with its terminating zero, so no key is a
+prefix of another. Node prefixes point into the keys themselves (keys must outlive the tree).
+Leaves are HashTableEl's with lowest pointer bit set.
+*/
+
+typedef enum art_node_type_en
+{
+    ART_NODE4   = 0,
+    ART_NODE16  = 1,
+    ART_NODE48  = 2,
+    ART_NODE256 = 3
+} art_node_type;
+
+struct ArtNode
+{
+    uint8_t  type;
+    uint16_t children_count;
+    uint32_t prefix_len;
+    const unsigned char *prefix;
+};
+
+struct ArtNode4
+{
+    ArtNode  header;
+    unsigned char keys[4];
+    ArtNode *children[4];
+};
+
+struct ArtNode16
+{
+    ArtNode  header;
+    unsigned char keys[16];
+    ArtNode *children[16];
+};
+
+struct ArtNode48
+{
+    ArtNode  header;
+    /* 0 - no child, otherwise index in children + 1 */
+    unsigned char child_index[256];
+    ArtNode *children[48];
+};
+
+struct ArtNode256
+{
+    ArtNode  header;
+    ArtNode *children[256];
+};
+
+struct ArtTree
+{
+    ArtNode *root;
+    size_t   size;
+    size_t   nodes_count;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error ArtTree_construct(ArtTree *ths);
+
+hash_error ArtTree_put(ArtTree *ths, KeyType key, ValueType value);
+
+ValueType* ArtTree_get(ArtTree *ths, KeyType key);
+
+size_t ArtTree_prefix(ArtTree *ths, const char* prefix, HashTableEl *found, size_t limit);
+
+hash_error ArtTree_destruct(ArtTree *ths);
+
+//=============================================================================
+
+inline bool ArtIsLeaf(const ArtNode *node)
+{
+    return ((uintptr_t)node & 1) != 0;
+}
+
+inline HashTableEl* ArtLeaf(const ArtNode *node)
+{
+    return (HashTableEl *)((uintptr_t)node & ~(uintptr_t)1);
+}
+
+inline ArtNode* ArtMakeLeaf(HashTableEl *leaf)
+{
+    return (ArtNode *)((uintptr_t)leaf | 1);
+}
+
+//-----------------------------------------------------------------------------
+
+ArtNode* ArtNode_alloc(ArtTree *ths, art_node_type type)
+{
+    static const size_t node_sizes[] = {sizeof(ArtNode4), sizeof(ArtNode16), sizeof(ArtNode48), sizeof(ArtNode256)};
+
+    ArtNode *node = (ArtNode *)calloc(1, node_sizes[type]);
+    assert(node != NULL);
+
+    node->type = type;
+    ths->nodes_count++;
+
+    return node;
+}
+
+//-----------------------------------------------------------------------------
+
+ArtNode** ArtNode_find_child(ArtNode *node, unsigned char byte)
+{
+    switch (node->type)
+    {
+        case ART_NODE4:
+        {
+            ArtNode4 *node4 = (ArtNode4 *)node;
+            for (int i = 0; i < node->children_count; i++)
+                if (node4->keys[i] == byte)
+                    return &node4->children[i];
+            return NULL;
+        }
+        case ART_NODE16:
+        {
+            ArtNode16 *node16 = (ArtNode16 *)node;
+
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)byte), _mm_loadu_si128((const __m128i *)node16->keys));
+            int mask = _mm_movemask_epi8(cmp) & ((1 << node->children_count) - 1);
+
+            return (mask) ? &node16->children[__builtin_ctz(mask)] : NULL;
+        }
+        case ART_NODE48:
+        {
+            ArtNode48 *node48 = (ArtNode48 *)node;
+            int index = node48->child_index[byte];
+            return (index) ? &node48->children[index - 1] : NULL;
+        }
+        case ART_NODE256:
+        {
+            ArtNode256 *node256 = (ArtNode256 *)node;
+            return (node256->children[byte]) ? &node256->children[byte] : NULL;
+        }
+        default:
+            return NULL;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void ArtNode_copy_header(ArtNode *dest, const ArtNode *src)
+{
+    dest->children_count = src->children_count;
+    dest->prefix_len     = src->prefix_len;
+    dest->prefix         = src->prefix;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Node4 and Node16 keep keys sorted, so iteration is always ordered */
+void ArtNode_sorted_insert(unsigned char *keys, ArtNode **children, int count, unsigned char byte, ArtNode *child)
+{
+    int pos = 0;
+    while (pos < count && keys[pos] < byte)
+        pos++;
+
+    memmove(keys + pos + 1, keys + pos, count - pos);
+    memmove(children + pos + 1, children + pos, (count - pos) * sizeof(ArtNode *));
+
+    keys[pos]     = byte;
+    children[pos] = child;
+}
+
+//-----------------------------------------------------------------------------
+
+/* ref is place where node is stored, it changes if node grows */
+void ArtNode_add_child(ArtTree *ths, ArtNode **ref, unsigned char byte, ArtNode *child)
+{
+    ArtNode *node = *ref;
+
+    switch (node->type)
+    {
+        case ART_NODE4:
+        {
+            ArtNode4 *node4 = (ArtNode4 *)node;
+            if (node->children_count < 4)
+            {
+                ArtNode_sorted_insert(node4->keys, node4->children, node->children_count, byte, child);
+                node->children_count++;
+                return;
+            }
+
+            ArtNode16 *node16 = (ArtNode16 *)ArtNode_alloc(ths, ART_NODE16);
+            ArtNode_copy_header(&node16->header, node);
+            memcpy(node16->keys, node4->keys, sizeof(node4->keys));
+            memcpy(node16->children, node4->children, sizeof(node4->children));
+
+            free(node);
+            ths->nodes_count--;
+            *ref = &node16->header;
+            ArtNode_add_child(ths, ref, byte, child);
+            return;
+        }
+        case ART_NODE16:
+        {
+            ArtNode16 *node16 = (ArtNode16 *)node;
+            if (node->children_count < 16)
+            {
+                ArtNode_sorted_insert(node16->keys, node16->children, node->children_count, byte, child);
+                node->children_count++;
+                return;
+            }
+
+            ArtNode48 *node48 = (ArtNode48 *)ArtNode_alloc(ths, ART_NODE48);
+            ArtNode_copy_header(&node48->header, node);
+            for (int i = 0; i < 16; i++)
+            {
+                node48->children[i] = node16->children[i];
+                node48->child_index[node16->keys[i]] = i + 1;
+            }
+
+            free(node);
+            ths->nodes_count--;
+            *ref = &node48->header;
+            ArtNode_add_child(ths, ref, byte, child);
+            return;
+        }
+        case ART_NODE48:
+        {
+            ArtNode48 *node48 = (ArtNode48 *)node;
+            if (node->children_count < 48)
+            {
+                /* Children are never erased, so first free slot is children_count */
+                node48->children[node->children_count] = child;
+                node48->child_index[byte] = node->children_count + 1;
+                node->children_count++;
+                return;
+            }
+
+            ArtNode256 *node256 = (ArtNode256 *)ArtNode_alloc(ths, ART_NODE256);
+            ArtNode_copy_header(&node256->header, node);
+            for (int i = 0; i < 256; i++)
+                if (node48->child_index[i])
+                    node256->children[i] = node48->children[node48->child_index[i] - 1];
+
+            free(node);
+            ths->nodes_count--;
+            *ref = &node256->header;
+            ArtNode_add_child(ths, ref, byte, child);
+            return;
+        }
+        case ART_NODE256:
+        {
+            ArtNode256 *node256 = (ArtNode256 *)node;
+            node256->children[byte] = child;
+            node->children_count++;
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Returns true if new key was added, false if value was replaced */
+bool ArtNode_insert(ArtTree *ths, ArtNode **ref, HashTableEl *new_leaf, const unsigned char *key, size_t depth)
+{
+    ArtNode *node = *ref;
+
+    if (node == NULL)
+    {
+        *ref = ArtMakeLeaf(new_leaf);
+        return true;
+    }
+
+    if (ArtIsLeaf(node))
+    {
+        HashTableEl *old_leaf = ArtLeaf(node);
+        const unsigned char *old_key = (const unsigned char *)old_leaf->key;
+
+        if (!strcmp((const char *)old_key, (const char *)key))
+        {
+            old_leaf->value = new_leaf->value;
+            free(new_leaf);
+            return false;
+        }
+
+        /* Keys are different, so they differ not later than on terminating zero */
+        size_t common = 0;
+        while (old_key[depth + common] == key[depth + common])
+            common++;
+
+        ArtNode *node4 = ArtNode_alloc(ths, ART_NODE4);
+        node4->prefix     = key + depth;
+        node4->prefix_len = common;
+
+        ArtNode_add_child(ths, &node4, old_key[depth + common], node);
+        ArtNode_add_child(ths, &node4, key[depth + common], ArtMakeLeaf(new_leaf));
+
+        *ref = node4;
+        return true;
+    }
+
+    if (node->prefix_len)
+    {
+        /* Prefix never contains terminating zero, so mismatch is found before end of key */
+        uint32_t mismatch = 0;
+        while (mismatch < node->prefix_len && node->prefix[mismatch] == key[depth + mismatch])
+            mismatch++;
+
+        if (mismatch < node->prefix_len)
+        {
+            ArtNode *node4 = ArtNode_alloc(ths, ART_NODE4);
+            node4->prefix     = node->prefix;
+            node4->prefix_len = mismatch;
+
+            unsigned char old_byte = node->prefix[mismatch];
+            node->prefix     += mismatch + 1;
+            node->prefix_len -= mismatch + 1;
+
+            ArtNode_add_child(ths, &node4, old_byte, node);
+            ArtNode_add_child(ths, &node4, key[depth + mismatch], ArtMakeLeaf(new_leaf));
+
+            *ref = node4;
+            return true;
+        }
+
+        depth += node->prefix_len;
+    }
+
+    ArtNode **child = ArtNode_find_child(node, key[depth]);
+    if (child)
+        return ArtNode_insert(ths, child, new_leaf, key, depth + 1);
+
+    ArtNode_add_child(ths, ref, key[depth], ArtMakeLeaf(new_leaf));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ArtNode_destruct(ArtNode *node)
+{
+    if (node == NULL)
+        return;
+
+    if (ArtIsLeaf(node))
+    {
+        free(ArtLeaf(node));
+        return;
+    }
+
+    switch (node->type)
+    {
+        case ART_NODE4:
+            for (int i = 0; i < node->children_count; i++)
+                ArtNode_destruct(((ArtNode4 *)node)->children[i]);
+            break;
+        case ART_NODE16:
+            for (int i = 0; i < node->children_count; i++)
+                ArtNode_destruct(((ArtNode16 *)node)->children[i]);
+            break;
+        case ART_NODE48:
+            for (int i = 0; i < node->children_count; i++)
+                ArtNode_destruct(((ArtNode48 *)node)->children[i]);
+            break;
+        case ART_NODE256:
+            for (int i = 0; i < 256; i++)
+                ArtNode_destruct(((ArtNode256 *)node)->children[i]);
+            break;
+        default:
+            break;
+    }
+
+    free(node);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Ordered depth-first traversal, returns false if limit is reached */
+bool ArtNode_collect(ArtNode *node, const char* prefix, size_t prefix_len, HashTableEl *found, size_t *found_count, size_t limit)
+{
+    if (*found_count == limit)
+        return false;
+
+    if (ArtIsLeaf(node))
+    {
+        HashTableEl *leaf = ArtLeaf(node);
+        if (!strncmp(leaf->key, prefix, prefix_len))
+            found[(*found_count)++] = *leaf;
+
+        return *found_count < limit;
+    }
+
+    switch (node->type)
+    {
+        case ART_NODE4:
+            for (int i = 0; i < node->children_count; i++)
+                if (!ArtNode_collect(((ArtNode4 *)node)->children[i], prefix, prefix_len, found, found_count, limit))
+                    return false;
+            break;
+        case ART_NODE16:
+            for (int i = 0; i < node->children_count; i++)
+                if (!ArtNode_collect(((ArtNode16 *)node)->children[i], prefix, prefix_len, found, found_count, limit))
+                    return false;
+            break;
+        case ART_NODE48:
+        {
+            ArtNode48 *node48 = (ArtNode48 *)node;
+            for (int i = 0; i < 256; i++)
+                if (node48->child_index[i] &&
+                   !ArtNode_collect(node48->children[node48->child_index[i] - 1], prefix, prefix_len, found, found_count, limit))
+                    return false;
+            break;
+        }
+        case ART_NODE256:
+        {
+            ArtNode256 *node256 = (ArtNode256 *)node;
+            for (int i = 0; i < 256; i++)
+                if (node256->children[i] &&
+                   !ArtNode_collect(node256->children[i], prefix, prefix_len, found, found_count, limit))
+                    return false;
+            break;
+        }
+        default:
+            break;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error ArtTree_construct(ArtTree *ths)
+{
+    ths->root        = NULL;
+    ths->size        = 0;
+    ths->nodes_count = 0;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error ArtTree_put(ArtTree *ths, KeyType key, ValueType value)
+{
+    HashTableEl *new_leaf = (HashTableEl *)calloc(1, sizeof(HashTableEl));
+    if (new_leaf == NULL)
+        return HASH_REALLOC_ERROR;
+
+    new_leaf->key   = key;
+    new_leaf->value = value;
+
+    if (ArtNode_insert(ths, &ths->root, new_leaf, (const unsigned char *)key, 0))
+        ths->size++;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* ArtTree_get(ArtTree *ths, KeyType key)
+{
+    const unsigned char *ukey = (const unsigned char *)key;
+    ArtNode *node = ths->root;
+    size_t depth = 0;
+
+    while (node != NULL)
+    {
+        if (ArtIsLeaf(node))
+        {
+            HashTableEl *leaf = ArtLeaf(node);
+            return (!strcmp(leaf->key, key)) ? &leaf->value : NULL;
+        }
+
+        /* Stops on terminating zero of key at least, because prefix never contains zero */
+        for (uint32_t i = 0; i < node->prefix_len; i++)
+            if (node->prefix[i] != ukey[depth + i])
+                return NULL;
+
+        depth += node->prefix_len;
+
+        ArtNode **child = ArtNode_find_child(node, ukey[depth]);
+        if (child == NULL)
+            return NULL;
+
+        node = *child;
+        depth++;
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Writes to found up to limit elements which keys start with prefix in ascending order */
+size_t ArtTree_prefix(ArtTree *ths, const char* prefix, HashTableEl *found, size_t limit)
+{
+    const unsigned char *uprefix = (const unsigned char *)prefix;
+    size_t prefix_len = strlen(prefix);
+    size_t found_count = 0;
+
+    ArtNode *node = ths->root;
+    size_t depth = 0;
+
+    while (node != NULL && !ArtIsLeaf(node) && depth < prefix_len)
+    {
+        uint32_t i = 0;
+        for (; i < node->prefix_len && depth + i < prefix_len; i++)
+            if (node->prefix[i] != uprefix[depth + i])
+                return 0;
+
+        depth += i;
+        if (depth == prefix_len)
+            break;
+
+        ArtNode **child = ArtNode_find_child(node, uprefix[depth]);
+        node = (child) ? *child : NULL;
+        depth++;
+    }
+
+    if (node != NULL)
+        ArtNode_collect(node, prefix, prefix_len, found, &found_count, limit);
+
+    return found_count;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error ArtTree_destruct(ArtTree *ths)
+{
+    ArtNode_destruct(ths->root);
+
+    ths->root        = NULL;
+    ths->size        = 0;
+    ths->nodes_count = 0;
+
+    return HASH_OK;
+}
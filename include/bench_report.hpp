@@ -0,0 +1,496 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <thread>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Results of repeated benchmark trials with description of host, saved as JSON, and comparison
+of two results. Every benchmark keeps all its trials, not only mean, so two runs are compared
+by Mann-Whitney U test: it doesn't assume normal distribution of times, one slow trial (other
+process, frequency change) doesn't move it much. Benchmark is a regression if its median
+time is worse by more than threshold and the difference is significant (p < alpha),
+a speedup if it's better in the same way, and the same otherwise.
+Normal approximation of U with correction for ties is used, it's good from ~8 trials per run.
+*/
+
+const size_t BENCH_REPORT_MAX_BENCHES = 16;
+const size_t BENCH_REPORT_MAX_TRIALS  = 256;
+const size_t BENCH_REPORT_MAX_TEXT    = 256;
+const double BENCH_REPORT_THRESHOLD   = 0.05;          /* relative change of median */
+const double BENCH_REPORT_ALPHA       = 0.01;
+
+/* Exit codes of comparison */
+const int BENCH_COMPARE_SAME       = 0;
+const int BENCH_COMPARE_ERROR      = 1;
+const int BENCH_COMPARE_REGRESSION = 2;
+
+struct BenchSeries
+{
+    char name[BENCH_REPORT_MAX_TEXT];
+    double samples[BENCH_REPORT_MAX_TRIALS];            /* ms */
+    size_t samples_count;
+};
+
+struct BenchReport
+{
+    char host[BENCH_REPORT_MAX_TEXT];
+    char system[BENCH_REPORT_MAX_TEXT];
+    char cpu[BENCH_REPORT_MAX_TEXT];
+    char compiler[BENCH_REPORT_MAX_TEXT];
+    char hash[BENCH_REPORT_MAX_TEXT];
+    char date[BENCH_REPORT_MAX_TEXT];
+    size_t cpus;
+    size_t words_count;
+
+    BenchSeries series[BENCH_REPORT_MAX_BENCHES];
+    size_t series_count;
+};
+
+//-----------------------------------------------------------------------------
+
+void BenchReport_describe_host(BenchReport *ths, size_t words_count);
+
+BenchSeries* BenchReport_series(BenchReport *ths, const char *name);
+
+void BenchReport_add(BenchReport *ths, const char *name, double sample);
+
+hash_error BenchReport_write(BenchReport *ths, const char *file_name);
+
+hash_error BenchReport_read(BenchReport *ths, const char *file_name);
+
+int BenchReport_compare(BenchReport *baseline, BenchReport *current, double threshold = BENCH_REPORT_THRESHOLD,
+                        double alpha = BENCH_REPORT_ALPHA);
+
+double BenchNow();
+
+//=============================================================================
+
+/* Wall time in ms */
+double BenchNow()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+//-----------------------------------------------------------------------------
+
+void BenchReport_copy_text(char *text, const char *value)
+{
+    snprintf(text, BENCH_REPORT_MAX_TEXT, "%s", value);
+}
+
+//-----------------------------------------------------------------------------
+
+/* "model name" of the first processor from /proc/cpuinfo */
+void BenchReport_read_cpu(char *cpu)
+{
+    BenchReport_copy_text(cpu, "unknown");
+
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "rb");
+    if (cpuinfo == NULL)
+        return;
+
+    char line[BENCH_REPORT_MAX_TEXT] = {};
+    while (fgets(line, sizeof(line), cpuinfo) != NULL)
+    {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", strlen("model name")) || colon == NULL)
+            continue;
+
+        char *value = colon + 1 + strspn(colon + 1, " \t");
+        value[strcspn(value, "\n")] = '\0';
+
+        BenchReport_copy_text(cpu, value);
+        break;
+    }
+
+    fclose(cpuinfo);
+}
+
+//-----------------------------------------------------------------------------
+
+void BenchReport_describe_host(BenchReport *ths, size_t words_count)
+{
+    *ths = {};
+
+    if (gethostname(ths->host, BENCH_REPORT_MAX_TEXT - 1) != 0)
+        BenchReport_copy_text(ths->host, "unknown");
+
+    utsname name = {};
+    if (uname(&name) == 0)
+        snprintf(ths->system, BENCH_REPORT_MAX_TEXT, "%s %s %s", name.sysname, name.release, name.machine);
+
+    BenchReport_read_cpu(ths->cpu);
+
+#ifdef __OPTIMIZE__
+    snprintf(ths->compiler, BENCH_REPORT_MAX_TEXT, "%s, optimized", __VERSION__);
+#else
+    snprintf(ths->compiler, BENCH_REPORT_MAX_TEXT, "%s, -O0", __VERSION__);
+#endif
+
+#ifdef SLOW
+    BenchReport_copy_text(ths->hash, "djb2 (SLOW)");
+#else
+    BenchReport_copy_text(ths->hash, "crc32 (hashing.asm)");
+#endif
+
+    time_t now = time(NULL);
+    tm date = {};
+    gmtime_r(&now, &date);
+    strftime(ths->date, BENCH_REPORT_MAX_TEXT, "%Y-%m-%dT%H:%M:%SZ", &date);
+
+    ths->cpus        = std::thread::hardware_concurrency();
+    ths->words_count = words_count;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Series of benchmark or NULL */
+BenchSeries* BenchReport_series(BenchReport *ths, const char *name)
+{
+    for (size_t i = 0; i < ths->series_count; i++)
+        if (!strcmp(ths->series[i].name, name))
+            return &ths->series[i];
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Existing or new series, NULL if there are BENCH_REPORT_MAX_BENCHES of them */
+BenchSeries* BenchReport_new_series(BenchReport *ths, const char *name)
+{
+    BenchSeries *series = BenchReport_series(ths, name);
+
+    if (series == NULL && ths->series_count < BENCH_REPORT_MAX_BENCHES)
+    {
+        series = &ths->series[ths->series_count++];
+        BenchReport_copy_text(series->name, name);
+    }
+
+    return series;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Samples over BENCH_REPORT_MAX_TRIALS are dropped */
+void BenchReport_add(BenchReport *ths, const char *name, double sample)
+{
+    BenchSeries *series = BenchReport_new_series(ths, name);
+
+    if (series != NULL && series->samples_count < BENCH_REPORT_MAX_TRIALS)
+        series->samples[series->samples_count++] = sample;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Quotes and backslashes are escaped, control chars are dropped */
+void BenchReport_write_text(FILE *file, const char *key, const char *value)
+{
+    fprintf(file, "  \"%s\": \"", key);
+
+    for (; *value; value++)
+    {
+        if (*value == '"' || *value == '\\')
+            fputc('\\', file);
+
+        if ((unsigned char)*value >= ' ')
+            fputc(*value, file);
+    }
+
+    fprintf(file, "\",\n");
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error BenchReport_write(BenchReport *ths, const char *file_name)
+{
+    FILE *file = fopen(file_name, "wb");
+    if (file == NULL)
+        return HASH_ERROR;
+
+    fprintf(file, "{\n");
+    BenchReport_write_text(file, "host",     ths->host);
+    BenchReport_write_text(file, "system",   ths->system);
+    BenchReport_write_text(file, "cpu",      ths->cpu);
+    BenchReport_write_text(file, "compiler", ths->compiler);
+    BenchReport_write_text(file, "hash",     ths->hash);
+    BenchReport_write_text(file, "date",     ths->date);
+    fprintf(file, "  \"cpus\": %zu,\n  \"words\": %zu,\n  \"unit\": \"ms\",\n  \"benchmarks\": [\n",
+            ths->cpus, ths->words_count);
+
+    for (size_t i = 0; i < ths->series_count; i++)
+    {
+        BenchSeries *series = &ths->series[i];
+        fprintf(file, "    {\"name\": \"%s\", \"samples\": [", series->name);
+
+        for (size_t j = 0; j < series->samples_count; j++)
+            fprintf(file, (j == 0) ? "%.6f" : ", %.6f", series->samples[j]);
+
+        fprintf(file, "]}%s\n", (i + 1 == ths->series_count) ? "" : ",");
+    }
+
+    fprintf(file, "  ]\n}\n");
+
+    return (fclose(file) == 0) ? HASH_OK : HASH_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+
+/* String value of "key": "value" after text, escapes are undone. Pointer after it or NULL */
+const char* BenchReport_read_text(const char *text, const char *key, char *value)
+{
+    char pattern[BENCH_REPORT_MAX_TEXT] = {};
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+    const char *place = strstr(text, pattern);
+    if (place == NULL)
+        return NULL;
+
+    place = strchr(place + strlen(pattern), '"');
+    if (place == NULL)
+        return NULL;
+
+    size_t length = 0;
+    for (place++; *place && *place != '"'; place++)
+    {
+        if (*place == '\\' && place[1])
+            place++;
+
+        if (length + 1 < BENCH_REPORT_MAX_TEXT)
+            value[length++] = *place;
+    }
+
+    value[length] = '\0';
+
+    return (*place == '"') ? place + 1 : NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t BenchReport_read_number(const char *text, const char *key)
+{
+    char pattern[BENCH_REPORT_MAX_TEXT] = {};
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+    const char *place = strstr(text, pattern);
+
+    return (place == NULL) ? 0 : strtoull(place + strlen(pattern), NULL, 10);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Reads file made by BenchReport_write, not any JSON */
+hash_error BenchReport_read(BenchReport *ths, const char *file_name)
+{
+    *ths = {};
+
+    char *text = NULL;
+    size_t text_size = ReadDataBase(file_name, &text);
+    if (text == NULL)
+        return HASH_ERROR;
+
+    /* Zero byte inside means it's not a text file, strstr would stop at it */
+    const char *benchmarks = strstr(text, "\"benchmarks\":");
+    if (text_size == 0 || strlen(text) != text_size || benchmarks == NULL)
+    {
+        free(text);
+        return HASH_ERROR;
+    }
+
+    BenchReport_read_text(text, "host",     ths->host);
+    BenchReport_read_text(text, "system",   ths->system);
+    BenchReport_read_text(text, "cpu",      ths->cpu);
+    BenchReport_read_text(text, "compiler", ths->compiler);
+    BenchReport_read_text(text, "hash",     ths->hash);
+    BenchReport_read_text(text, "date",     ths->date);
+    ths->cpus        = BenchReport_read_number(text, "cpus");
+    ths->words_count = BenchReport_read_number(text, "words");
+
+    char name[BENCH_REPORT_MAX_TEXT] = {};
+    const char *place = benchmarks;
+
+    while ((place = BenchReport_read_text(place, "name", name)) != NULL)
+    {
+        const char *samples = strstr(place, "\"samples\":");
+        const char *open    = (samples == NULL) ? NULL : strchr(samples, '[');
+        if (open == NULL)
+            break;
+
+        /* Empty series is kept too, comparison reports it */
+        BenchReport_new_series(ths, name);
+
+        place = open + 1;
+        while (true)
+        {
+            place += strspn(place, " \t\r\n,");
+            if (*place == ']' || *place == '\0')
+                break;
+
+            char *end = NULL;
+            double sample = strtod(place, &end);
+            if (end == place)
+            {
+                free(text);
+                return HASH_ERROR;
+            }
+
+            BenchReport_add(ths, name, sample);
+            place = end;
+        }
+    }
+
+    free(text);
+
+    return (ths->series_count > 0) ? HASH_OK : HASH_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+
+int BenchCompareDouble(const void *first, const void *second)
+{
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+
+    return (a > b) - (a < b);
+}
+
+//-----------------------------------------------------------------------------
+
+double BenchMedian(const BenchSeries *series)
+{
+    double sorted[BENCH_REPORT_MAX_TRIALS] = {};
+    memcpy(sorted, series->samples, series->samples_count * sizeof(double));
+    qsort(sorted, series->samples_count, sizeof(double), BenchCompareDouble);
+
+    size_t middle = series->samples_count / 2;
+
+    return (series->samples_count % 2) ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Two-sided p-value of Mann-Whitney U test: both series are ranked together (ties get
+   mean rank), U of the first one is compared with its normal approximation */
+double MannWhitney(const BenchSeries *first, const BenchSeries *second)
+{
+    size_t n1 = first->samples_count;
+    size_t n2 = second->samples_count;
+    size_t n  = n1 + n2;
+
+    double values[2 * BENCH_REPORT_MAX_TRIALS] = {};
+    memcpy(values, first->samples, n1 * sizeof(double));
+    memcpy(values + n1, second->samples, n2 * sizeof(double));
+    qsort(values, n, sizeof(double), BenchCompareDouble);
+
+    /* Sum of ranks of the first series and sum of t^3 - t over groups of t equal values */
+    double rank_sum = 0;
+    double ties     = 0;
+
+    for (size_t begin = 0; begin < n; )
+    {
+        size_t end = begin;
+        while (end < n && values[end] == values[begin])
+            end++;
+
+        double t    = end - begin;
+        double rank = (begin + 1 + end) / 2.0;
+        ties += t * t * t - t;
+
+        for (size_t i = 0; i < n1; i++)
+            if (first->samples[i] == values[begin])
+                rank_sum += rank;
+
+        begin = end;
+    }
+
+    double u     = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean  = n1 * n2 / 2.0;
+    double sigma = sqrt(n1 * n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1))));
+
+    if (sigma == 0)
+        return 1;
+
+    /* Continuity correction */
+    double z = (fabs(u - mean) - 0.5) / sigma;
+    if (z < 0)
+        z = 0;
+
+    return erfc(z / sqrt(2.0));
+}
+
+//-----------------------------------------------------------------------------
+
+bool BenchReport_same_text(const char *first, const char *second, const char *what)
+{
+    if (!strcmp(first, second))
+        return true;
+
+    printf("warning: %s differs: \"%s\" in baseline, \"%s\" now\n", what, first, second);
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Prints table of all benchmarks of baseline. Returns BENCH_COMPARE_REGRESSION if any
+   of them is a regression, BENCH_COMPARE_ERROR if any is missing or has too few trials */
+int BenchReport_compare(BenchReport *baseline, BenchReport *current, double threshold, double alpha)
+{
+    BenchReport_same_text(baseline->cpu,      current->cpu,      "cpu");
+    BenchReport_same_text(baseline->host,     current->host,     "host");
+    BenchReport_same_text(baseline->compiler, current->compiler, "compiler");
+    BenchReport_same_text(baseline->hash,     current->hash,     "hash");
+
+    if (baseline->words_count != current->words_count)
+        printf("warning: words differ: %zu in baseline, %zu now\n", baseline->words_count, current->words_count);
+
+    printf("%-12s %12s %12s %9s %9s  %s\n", "benchmark", "baseline ms", "current ms", "change", "p", "verdict");
+
+    bool regression = false;
+    bool failed     = false;
+
+    for (size_t i = 0; i < baseline->series_count; i++)
+    {
+        BenchSeries *before = &baseline->series[i];
+        BenchSeries *after  = BenchReport_series(current, before->name);
+
+        if (after == NULL || before->samples_count < 2 || after->samples_count < 2)
+        {
+            printf("%-12s %12s %12s %9s %9s  %s\n", before->name, "", "", "", "",
+                   (after == NULL) ? "MISSING" : "TOO FEW TRIALS");
+            failed = true;
+            continue;
+        }
+
+        double median_before = BenchMedian(before);
+        double median_after  = BenchMedian(after);
+        double change        = (median_before > 0) ? median_after / median_before - 1 : 0;
+        double p             = MannWhitney(before, after);
+
+        const char *verdict = "same";
+        if (p < alpha && change > threshold)
+        {
+            verdict    = "REGRESSION";
+            regression = true;
+        }
+        else if (p < alpha && change < -threshold)
+            verdict = "speedup";
+
+        printf("%-12s %12.3f %12.3f %+8.1f%% %9.4f  %s\n", before->name, median_before, median_after,
+               100 * change, p, verdict);
+    }
+
+    if (regression)
+        return BENCH_COMPARE_REGRESSION;
+
+    return (failed) ? BENCH_COMPARE_ERROR : BENCH_COMPARE_SAME;
+}
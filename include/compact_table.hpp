@@ -0,0 +1,469 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+#include "parallel_build.hpp"
+
+/*
+Compact read only table for the same words as HashTable: 8 bytes per entry and 4 bytes per bucket
+instead of 32 byte node and 64 byte list header. Keys and values are copied to one arena, entry keeps
+32-bit offset of its key (in 8-byte units, so arena may be up to 32 GB) and 32-bit hash of key,
+value lies right after key. Entries of bucket lie together in order of buckets, so bucket is only
+index of its first entry (like in CSR matrix) and there are no links.
+Hash of entry is compared before key, so most other keys of bucket aren't read at all.
+Keys in arena are padded with zeros to 8 bytes, first 8 bytes are compared as one word,
+so asked keys must be padded with zeros to 8 bytes too (as for HashingFunction).
+Table has no pointers inside, so it's saved to image file as it is: header, bucket_begin,
+entries and arena, every part begins at offset divisible by 8.
+*/
+
+const size_t COMPACT_ALIGN = 8;
+
+const uint32_t COMPACT_IMAGE_MAGIC   = 0x54434944;          /* "DICT" */
+const uint32_t COMPACT_IMAGE_VERSION = 1;
+const char     COMPACT_IMAGE_PROBE[2 * COMPACT_ALIGN] = "compact";
+
+struct CompactEntry
+{
+    uint32_t key;                  /* offset in arena / COMPACT_ALIGN */
+    uint32_t hash;
+};
+
+struct CompactTable
+{
+    size_t capacity;
+    size_t size;
+    HashFunction hash_function;
+
+    uint32_t *bucket_begin;        /* capacity + 1, entries of bucket i are [bucket_begin[i], bucket_begin[i + 1]) */
+    CompactEntry *entries;
+
+    char *arena;
+    size_t arena_size;
+};
+
+struct CompactImageHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t arena_size;
+    uint64_t hash_check;           /* hash of COMPACT_IMAGE_PROBE, image is used only with the same function */
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error CompactTable_build(CompactTable *ths, DoubleWord *translates, size_t words_count,
+                              HashFunction hash_function = HashingFunction);
+
+const char* CompactTable_get(CompactTable *ths, KeyType key);
+
+size_t CompactTable_index_bytes(CompactTable *ths);
+
+size_t CompactTable_bytes(CompactTable *ths);
+
+hash_error CompactTable_save(CompactTable *ths, const char *file_name);
+
+hash_error CompactTable_load(CompactTable *ths, const char *file_name, HashFunction hash_function = HashingFunction);
+
+size_t CompactTable_image_bytes(CompactTable *ths);
+
+void CompactTable_image_store(CompactTable *ths, char *image);
+
+hash_error CompactTable_image_view(CompactTable *ths, const char *image, size_t image_size,
+                                   HashFunction hash_function = HashingFunction);
+
+hash_error CompactTable_destruct(CompactTable *ths);
+
+//=============================================================================
+
+/* Place of key with zero after it, then value with zero */
+size_t CompactRecordSize(const char *key, const char *value)
+{
+    size_t key_size = (strlen(key) + COMPACT_ALIGN) / COMPACT_ALIGN * COMPACT_ALIGN;
+    size_t size = key_size + strlen(value) + 1;
+
+    return (size + COMPACT_ALIGN - 1) / COMPACT_ALIGN * COMPACT_ALIGN;
+}
+
+//-----------------------------------------------------------------------------
+
+inline const char* CompactTable_key(CompactTable *ths, CompactEntry *entry)
+{
+    return ths->arena + (size_t)entry->key * COMPACT_ALIGN;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Repeated key keeps place of its first entry and value of the last one, like HashTable_put */
+hash_error CompactTable_build(CompactTable *ths, DoubleWord *translates, size_t words_count, HashFunction hash_function)
+{
+    *ths = {};
+    ths->capacity      = words_count / LoadFactor + 1;
+    ths->hash_function = hash_function;
+
+    if (words_count > UINT32_MAX)
+        return HASH_ERROR;
+
+    unsigned long long *hashes = (unsigned long long *)calloc(words_count + 1, sizeof(unsigned long long));
+    uint32_t *offsets          = (uint32_t *)calloc(words_count + 1, sizeof(uint32_t));
+    ths->bucket_begin          = (uint32_t *)calloc(ths->capacity + 1, sizeof(uint32_t));
+    ths->entries               = (CompactEntry *)calloc(words_count + 1, sizeof(CompactEntry));
+
+    if (hashes == NULL || offsets == NULL || ths->bucket_begin == NULL || ths->entries == NULL)
+    {
+        free(hashes);
+        free(offsets);
+        CompactTable_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        if (ths->arena_size / COMPACT_ALIGN > UINT32_MAX)
+        {
+            free(hashes);
+            free(offsets);
+            CompactTable_destruct(ths);
+            return HASH_ERROR;
+        }
+
+        offsets[i] = ths->arena_size / COMPACT_ALIGN;
+        ths->arena_size += CompactRecordSize(translates[i].primary_word, translates[i].translated_word);
+    }
+
+    HashTranslates(hash_function, translates, words_count, hashes);
+
+    for (size_t i = 0; i < words_count; i++)
+        ths->bucket_begin[hashes[i] % ths->capacity + 1]++;
+
+    ths->arena = (char *)calloc(ths->arena_size + COMPACT_ALIGN, sizeof(char));
+
+    if (ths->arena == NULL)
+    {
+        free(hashes);
+        free(offsets);
+        CompactTable_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        char *record = ths->arena + (size_t)offsets[i] * COMPACT_ALIGN;
+        size_t key_len = strlen(translates[i].primary_word);
+
+        memcpy(record, translates[i].primary_word, key_len);
+        strcpy(record + (key_len + COMPACT_ALIGN) / COMPACT_ALIGN * COMPACT_ALIGN, translates[i].translated_word);
+    }
+
+    /* Counting sort by buckets, stable */
+    for (size_t i = 0; i < ths->capacity; i++)
+        ths->bucket_begin[i + 1] += ths->bucket_begin[i];
+
+    uint32_t *fill = (uint32_t *)calloc(ths->capacity, sizeof(uint32_t));
+    if (fill == NULL)
+    {
+        free(hashes);
+        free(offsets);
+        CompactTable_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    memcpy(fill, ths->bucket_begin, ths->capacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        CompactEntry *entry = &ths->entries[fill[hashes[i] % ths->capacity]++];
+
+        entry->key  = offsets[i];
+        entry->hash = (uint32_t)hashes[i];
+    }
+
+    /* Entries move only back, so every one is read before it's overwritten */
+    for (size_t bucket = 0; bucket < ths->capacity; bucket++)
+    {
+        size_t begin = ths->bucket_begin[bucket];
+        size_t end   = ths->bucket_begin[bucket + 1];
+        ths->bucket_begin[bucket] = ths->size;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            CompactEntry entry = ths->entries[i];
+
+            size_t place = ths->bucket_begin[bucket];
+            while (place < ths->size && !(ths->entries[place].hash == entry.hash &&
+                                          !strcmp(CompactTable_key(ths, &ths->entries[place]), CompactTable_key(ths, &entry))))
+                place++;
+
+            ths->entries[place] = entry;
+            if (place == ths->size)
+                ths->size++;
+        }
+    }
+
+    ths->bucket_begin[ths->capacity] = ths->size;
+
+    free(fill);
+    free(hashes);
+    free(offsets);
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Pointer to value in arena or NULL */
+const char* CompactTable_get(CompactTable *ths, KeyType key)
+{
+    unsigned long long hash = ths->hash_function(key);
+    size_t bucket = hash % ths->capacity;
+
+    uint64_t first_word = 0;
+    memcpy(&first_word, key, sizeof(uint64_t));
+
+    for (size_t i = ths->bucket_begin[bucket]; i < ths->bucket_begin[bucket + 1]; i++)
+    {
+        CompactEntry *entry = &ths->entries[i];
+        if (entry->hash != (uint32_t)hash)
+            continue;
+
+        const char *stored = CompactTable_key(ths, entry);
+        if (*(const uint64_t *)stored != first_word || strcmp(stored, key))
+            continue;
+
+        return stored + (strlen(stored) + COMPACT_ALIGN) / COMPACT_ALIGN * COMPACT_ALIGN;
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Without arena: the same as HashTable which doesn't own strings */
+size_t CompactTable_index_bytes(CompactTable *ths)
+{
+    return (ths->capacity + 1) * sizeof(uint32_t) + ths->size * sizeof(CompactEntry);
+}
+
+//-----------------------------------------------------------------------------
+
+size_t CompactTable_bytes(CompactTable *ths)
+{
+    return CompactTable_index_bytes(ths) + ths->arena_size;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t CompactImageAligned(size_t size)
+{
+    return (size + COMPACT_ALIGN - 1) / COMPACT_ALIGN * COMPACT_ALIGN;
+}
+
+//-----------------------------------------------------------------------------
+
+bool CompactImage_write(FILE *file, const void *data, size_t size)
+{
+    static const char zeros[COMPACT_ALIGN] = {};
+
+    return fwrite(data, 1, size, file) == size &&
+           fwrite(zeros, 1, CompactImageAligned(size) - size, file) == CompactImageAligned(size) - size;
+}
+
+//-----------------------------------------------------------------------------
+
+bool CompactImage_read(FILE *file, void *data, size_t size)
+{
+    char zeros[COMPACT_ALIGN] = {};
+
+    return fread(data, 1, size, file) == size &&
+           fread(zeros, 1, CompactImageAligned(size) - size, file) == CompactImageAligned(size) - size;
+}
+
+//-----------------------------------------------------------------------------
+
+CompactImageHeader CompactTable_image_header(CompactTable *ths)
+{
+    CompactImageHeader header = {};
+    header.magic      = COMPACT_IMAGE_MAGIC;
+    header.version    = COMPACT_IMAGE_VERSION;
+    header.capacity   = ths->capacity;
+    header.size       = ths->size;
+    header.arena_size = ths->arena_size;
+    header.hash_check = ths->hash_function(COMPACT_IMAGE_PROBE);
+
+    return header;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Header of image, table is used only if it's image of this version made with the same hash function */
+bool CompactImageHeader_check(const CompactImageHeader *header, HashFunction hash_function)
+{
+    return header->magic == COMPACT_IMAGE_MAGIC && header->version == COMPACT_IMAGE_VERSION &&
+           header->hash_check == hash_function(COMPACT_IMAGE_PROBE) && header->capacity != 0 &&
+           header->size <= UINT32_MAX;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CompactTable_save(CompactTable *ths, const char *file_name)
+{
+    FILE *file = fopen(file_name, "wb");
+    if (file == NULL)
+        return HASH_ERROR;
+
+    CompactImageHeader header = CompactTable_image_header(ths);
+
+    bool written = CompactImage_write(file, &header, sizeof(header)) &&
+                   CompactImage_write(file, ths->bucket_begin, (ths->capacity + 1) * sizeof(uint32_t)) &&
+                   CompactImage_write(file, ths->entries, ths->size * sizeof(CompactEntry)) &&
+                   CompactImage_write(file, ths->arena, ths->arena_size);
+
+    if (fclose(file) != 0 || !written)
+        return HASH_ERROR;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* HASH_ERROR if file isn't image of this version or it was made with other hash function */
+hash_error CompactTable_load(CompactTable *ths, const char *file_name, HashFunction hash_function)
+{
+    *ths = {};
+
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return HASH_ERROR;
+
+    CompactImageHeader header = {};
+    if (!CompactImage_read(file, &header, sizeof(header)) || !CompactImageHeader_check(&header, hash_function))
+    {
+        fclose(file);
+        return HASH_ERROR;
+    }
+
+    ths->capacity      = header.capacity;
+    ths->size          = header.size;
+    ths->arena_size    = header.arena_size;
+    ths->hash_function = hash_function;
+
+    ths->bucket_begin = (uint32_t *)calloc(ths->capacity + 1, sizeof(uint32_t));
+    ths->entries      = (CompactEntry *)calloc(ths->size + 1, sizeof(CompactEntry));
+    ths->arena        = (char *)calloc(ths->arena_size + COMPACT_ALIGN, sizeof(char));
+
+    if (ths->bucket_begin == NULL || ths->entries == NULL || ths->arena == NULL)
+    {
+        fclose(file);
+        CompactTable_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    bool read = CompactImage_read(file, ths->bucket_begin, (ths->capacity + 1) * sizeof(uint32_t)) &&
+                CompactImage_read(file, ths->entries, ths->size * sizeof(CompactEntry)) &&
+                CompactImage_read(file, ths->arena, ths->arena_size);
+    fclose(file);
+
+    if (!read || ths->bucket_begin[ths->capacity] != ths->size)
+    {
+        CompactTable_destruct(ths);
+        return HASH_ERROR;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Image in memory has the same layout as file made by CompactTable_save */
+size_t CompactTable_image_bytes(CompactTable *ths)
+{
+    return CompactImageAligned(sizeof(CompactImageHeader)) +
+           CompactImageAligned((ths->capacity + 1) * sizeof(uint32_t)) +
+           CompactImageAligned(ths->size * sizeof(CompactEntry)) + CompactImageAligned(ths->arena_size);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Image must have CompactTable_image_bytes zeroed bytes and be aligned to 8 */
+void CompactTable_image_store(CompactTable *ths, char *image)
+{
+    CompactImageHeader header = CompactTable_image_header(ths);
+
+    memcpy(image, &header, sizeof(header));
+    image += CompactImageAligned(sizeof(header));
+
+    memcpy(image, ths->bucket_begin, (ths->capacity + 1) * sizeof(uint32_t));
+    image += CompactImageAligned((ths->capacity + 1) * sizeof(uint32_t));
+
+    memcpy(image, ths->entries, ths->size * sizeof(CompactEntry));
+    image += CompactImageAligned(ths->size * sizeof(CompactEntry));
+
+    memcpy(image, ths->arena, ths->arena_size);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Table points into image, nothing is copied, so it must not be destructed and it's valid while
+   image is. Image may be mapped read only: CompactTable_get doesn't write */
+hash_error CompactTable_image_view(CompactTable *ths, const char *image, size_t image_size, HashFunction hash_function)
+{
+    *ths = {};
+
+    CompactImageHeader header = {};
+    if (image_size < sizeof(header))
+        return HASH_ERROR;
+
+    memcpy(&header, image, sizeof(header));
+    if (!CompactImageHeader_check(&header, hash_function))
+        return HASH_ERROR;
+
+    ths->capacity      = header.capacity;
+    ths->size          = header.size;
+    ths->arena_size    = header.arena_size;
+    ths->hash_function = hash_function;
+
+    if (CompactTable_image_bytes(ths) > image_size)
+    {
+        *ths = {};
+        return HASH_ERROR;
+    }
+
+    char *place = (char *)image + CompactImageAligned(sizeof(header));
+
+    ths->bucket_begin = (uint32_t *)place;
+    place += CompactImageAligned((ths->capacity + 1) * sizeof(uint32_t));
+
+    ths->entries = (CompactEntry *)place;
+    place += CompactImageAligned(ths->size * sizeof(CompactEntry));
+
+    ths->arena = place;
+
+    if (ths->bucket_begin[ths->capacity] != ths->size)
+    {
+        *ths = {};
+        return HASH_ERROR;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CompactTable_destruct(CompactTable *ths)
+{
+    free(ths->bucket_begin);
+    free(ths->entries);
+    free(ths->arena);
+
+    ths->bucket_begin = NULL;
+    ths->entries      = NULL;
+    ths->arena        = NULL;
+    ths->size         = 0;
+
+    return HASH_OK;
+}
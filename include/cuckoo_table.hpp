@@ -0,0 +1,322 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "hash_table.hpp"
+
+/*
+Bucketized cuckoo hash table. Every key may be only in one of two buckets (or in small stash),
+bucket is 3 elements and 32-bit hashes of their keys in one cache line. So get touches not more
+than two bucket lines, no matter how bad the dictionary is, and key is compared only if its hash
+is the same. Both buckets are got from these 32 bits, so the other bucket of moved element is
+known without its key. Insert searches the shortest chain of displacements by BFS.
+*/
+
+const double CuckooLoadFactor   = 0.9;
+const size_t CUCKOO_BUCKET_SIZE = 3;
+const size_t CUCKOO_STASH_SIZE  = 8;
+const size_t CUCKOO_BFS_MAX     = 512;
+
+struct alignas(64) CuckooBucket
+{
+    uint32_t hashes[CUCKOO_BUCKET_SIZE];
+    HashTableEl slots[CUCKOO_BUCKET_SIZE];
+};
+
+struct CuckooTable
+{
+    size_t capacity;         /* Count of buckets */
+    size_t size;
+    CuckooBucket *buckets;
+    HashFunction hash_function;
+
+    size_t stash_size;
+    uint32_t stash_hashes[CUCKOO_STASH_SIZE];
+    HashTableEl stash[CUCKOO_STASH_SIZE];
+
+    size_t rehash_count;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error CuckooTable_construct(CuckooTable *ths, size_t elements_count);
+
+hash_error CuckooTable_allocate(CuckooTable *ths, size_t capacity);
+
+hash_error CuckooTable_rehash(CuckooTable *ths, size_t new_capacity);
+
+hash_error CuckooTable_set_hash(CuckooTable *ths, HashFunction hash_function);
+
+hash_error CuckooTable_put(CuckooTable *ths, KeyType key, ValueType value);
+
+ValueType* CuckooTable_get(CuckooTable *ths, KeyType key);
+
+ValueType* CuckooTable_get_hashed(CuckooTable *ths, KeyType key, uint32_t hash);
+
+hash_error CuckooTable_destruct(CuckooTable *ths);
+
+//=============================================================================
+
+/* Maps 32-bit value to [0, capacity) by multiplication, so capacity needn't be power of two */
+inline size_t CuckooReduce(CuckooTable *ths, unsigned long long value)
+{
+    return ((value & 0xFFFFFFFF) * ths->capacity) >> 32;
+}
+
+//-----------------------------------------------------------------------------
+
+inline size_t CuckooFirstBucket(CuckooTable *ths, uint32_t hash)
+{
+    return CuckooReduce(ths, hash);
+}
+
+//-----------------------------------------------------------------------------
+
+/* crc32 gives only 32 bits, so second bucket is taken from multiplicative mix of the same hash */
+inline size_t CuckooSecondBucket(CuckooTable *ths, uint32_t hash)
+{
+    size_t first  = CuckooFirstBucket(ths, hash);
+    size_t second = CuckooReduce(ths, (hash * 0x9E3779B97F4A7C15ULL) >> 32);
+
+    return (second == first) ? (second + 1) % ths->capacity : second;
+}
+
+//-----------------------------------------------------------------------------
+
+inline size_t CuckooOtherBucket(CuckooTable *ths, uint32_t hash, size_t bucket)
+{
+    size_t first = CuckooFirstBucket(ths, hash);
+
+    return (first == bucket) ? CuckooSecondBucket(ths, hash) : first;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CuckooTable_allocate(CuckooTable *ths, size_t capacity)
+{
+    ths->capacity = capacity;
+    ths->buckets  = (CuckooBucket *)aligned_alloc(sizeof(CuckooBucket), capacity * sizeof(CuckooBucket));
+    if (ths->buckets == NULL)
+        return HASH_REALLOC_ERROR;
+
+    memset(ths->buckets, 0, capacity * sizeof(CuckooBucket));
+
+    ths->hash_function = HashingFunction;
+    ths->size         = 0;
+    ths->stash_size   = 0;
+    ths->rehash_count = 0;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CuckooTable_construct(CuckooTable *ths, size_t elements_count)
+{
+    size_t capacity = elements_count / (CUCKOO_BUCKET_SIZE * CuckooLoadFactor) + 2;
+
+    return CuckooTable_allocate(ths, capacity);
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* CuckooTable_get_hashed(CuckooTable *ths, KeyType key, uint32_t hash)
+{
+    CuckooBucket *first  = &ths->buckets[CuckooFirstBucket(ths, hash)];
+    CuckooBucket *second = &ths->buckets[CuckooSecondBucket(ths, hash)];
+
+    for (size_t i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+        if (first->hashes[i] == hash && first->slots[i].key && !strcmp(first->slots[i].key, key))
+            return &first->slots[i].value;
+
+    for (size_t i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+        if (second->hashes[i] == hash && second->slots[i].key && !strcmp(second->slots[i].key, key))
+            return &second->slots[i].value;
+
+    for (size_t i = 0; i < ths->stash_size; i++)
+        if (ths->stash_hashes[i] == hash && !strcmp(ths->stash[i].key, key))
+            return &ths->stash[i].value;
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* CuckooTable_get(CuckooTable *ths, KeyType key)
+{
+    return CuckooTable_get_hashed(ths, key, ths->hash_function(key));
+}
+
+//-----------------------------------------------------------------------------
+
+struct CuckooPathNode
+{
+    size_t bucket;
+    long long parent;      /* Index in BFS queue, -1 for start buckets */
+    size_t parent_slot;    /* Slot of parent bucket which element moves to this bucket */
+};
+
+//-----------------------------------------------------------------------------
+
+/* Returns false if there's no free slot in reach of BFS */
+bool CuckooTable_insert(CuckooTable *ths, HashTableEl new_el, uint32_t hash)
+{
+    CuckooPathNode queue[CUCKOO_BFS_MAX];
+    size_t queue_head = 0;
+    size_t queue_tail = 0;
+
+    queue[queue_tail++] = {CuckooFirstBucket(ths, hash),  -1, 0};
+    queue[queue_tail++] = {CuckooSecondBucket(ths, hash), -1, 0};
+
+    while (queue_head < queue_tail)
+    {
+        size_t curr = queue_head++;
+        CuckooBucket *bucket = &ths->buckets[queue[curr].bucket];
+
+        for (size_t i = 0; i < CUCKOO_BUCKET_SIZE; i++)
+        {
+            if (bucket->slots[i].key != NULL)
+                continue;
+
+            /* Free slot is found, move elements along the path from the end */
+            size_t free_bucket = queue[curr].bucket;
+            size_t free_slot   = i;
+            long long node     = (long long)curr;
+
+            while (queue[node].parent != -1)
+            {
+                CuckooPathNode *path = &queue[node];
+                CuckooBucket *from = &ths->buckets[queue[path->parent].bucket];
+
+                ths->buckets[free_bucket].hashes[free_slot] = from->hashes[path->parent_slot];
+                ths->buckets[free_bucket].slots[free_slot]  = from->slots[path->parent_slot];
+
+                free_bucket = queue[path->parent].bucket;
+                free_slot   = path->parent_slot;
+                node        = path->parent;
+            }
+
+            ths->buckets[free_bucket].hashes[free_slot] = hash;
+            ths->buckets[free_bucket].slots[free_slot]  = new_el;
+            return true;
+        }
+
+        for (size_t i = 0; i < CUCKOO_BUCKET_SIZE && queue_tail < CUCKOO_BFS_MAX; i++)
+        {
+            size_t other = CuckooOtherBucket(ths, bucket->hashes[i], queue[curr].bucket);
+
+            /* Bucket mustn't be twice in one path, otherwise moved element could be moved again */
+            bool in_path = false;
+            for (long long node = (long long)curr; node != -1 && !in_path; node = queue[node].parent)
+                in_path = (queue[node].bucket == other);
+
+            if (!in_path)
+                queue[queue_tail++] = {other, (long long)curr, i};
+        }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key mustn't be in table yet */
+hash_error CuckooTable_put_new(CuckooTable *ths, KeyType key, ValueType value, uint32_t hash)
+{
+    if (ths->size + 1 > CuckooLoadFactor * ths->capacity * CUCKOO_BUCKET_SIZE)
+        CuckooTable_rehash(ths, ths->capacity * 2);
+
+    HashTableEl new_el = {};
+    new_el.key   = key;
+    new_el.value = value;
+
+    if (!CuckooTable_insert(ths, new_el, hash))
+    {
+        if (ths->stash_size == CUCKOO_STASH_SIZE)
+        {
+            hash_error error = CuckooTable_rehash(ths, ths->capacity * 2);
+            if (error != HASH_OK)
+                return error;
+
+            return CuckooTable_put_new(ths, key, value, hash);
+        }
+
+        ths->stash_hashes[ths->stash_size] = hash;
+        ths->stash[ths->stash_size++]      = new_el;
+    }
+
+    ths->size++;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Stored hashes are used again, keys aren't hashed */
+hash_error CuckooTable_rehash(CuckooTable *ths, size_t new_capacity)
+{
+    if (new_capacity <= ths->capacity)
+        return HASH_ERROR;
+
+    CuckooTable new_table = {};
+    if (CuckooTable_allocate(&new_table, new_capacity) != HASH_OK)
+        return HASH_REALLOC_ERROR;
+
+    new_table.hash_function = ths->hash_function;
+    new_table.rehash_count  = ths->rehash_count + 1;
+
+    for (size_t i = 0; i < ths->capacity; i++)
+    for (size_t j = 0; j < CUCKOO_BUCKET_SIZE; j++)
+        if (ths->buckets[i].slots[j].key)
+            CuckooTable_put_new(&new_table, ths->buckets[i].slots[j].key, ths->buckets[i].slots[j].value,
+                                ths->buckets[i].hashes[j]);
+
+    for (size_t i = 0; i < ths->stash_size; i++)
+        CuckooTable_put_new(&new_table, ths->stash[i].key, ths->stash[i].value, ths->stash_hashes[i]);
+
+    free(ths->buckets);
+    *ths = new_table;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CuckooTable_put(CuckooTable *ths, KeyType key, ValueType value)
+{
+    uint32_t hash = ths->hash_function(key);
+
+    ValueType *value_ptr = CuckooTable_get_hashed(ths, key, hash);
+    if (value_ptr != NULL)
+    {
+        *value_ptr = value;
+        return HASH_OK;
+    }
+
+    return CuckooTable_put_new(ths, key, value, hash);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Only for empty table, elements aren't moved */
+hash_error CuckooTable_set_hash(CuckooTable *ths, HashFunction hash_function)
+{
+    if (ths->size != 0)
+        return HASH_ERROR;
+
+    ths->hash_function = hash_function;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error CuckooTable_destruct(CuckooTable *ths)
+{
+    free(ths->buckets);
+
+    ths->buckets    = NULL;
+    ths->capacity   = 0;
+    ths->size       = 0;
+    ths->stash_size = 0;
+
+    return HASH_OK;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+
+struct DoubleWord
+{
+    const char* primary_word;
+    const char* translated_word;
+};
+
+//-----------------------------------------------------------------------------
+
+size_t GetFileSize(FILE* file)
+{
+    size_t size = 0;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    return size;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t GetEolCount(const char* buffer, size_t buffer_size)
+{
+    assert(buffer != NULL);
+
+    size_t eol_count = 0;
+    const char* ptr  = buffer;
+
+    while((size_t)(ptr - buffer) < buffer_size)
+    {
+        if (*ptr == '\n') eol_count++;
+        ptr++;
+    }
+    
+    return eol_count;
+}
+
+//-----------------------------------------------------------------------------
+
+DoubleWord* Parser(char* buffer, size_t eol_count, size_t file_size)
+{
+    DoubleWord* translates = (DoubleWord *)calloc(eol_count, sizeof(DoubleWord));
+    char* ptr = buffer;
+    size_t curr_word = 1;
+
+    translates[0].primary_word = buffer;
+
+    while((size_t)(ptr - buffer) < file_size)
+    {
+        if (*ptr == '=')
+        {
+            *ptr = '\0';
+            translates[curr_word - 1].translated_word = ptr + 1;
+        }
+        if (*ptr == '\n'){
+            *ptr = '\0';
+            if (curr_word < eol_count)
+                translates[curr_word++].primary_word = ptr + 1;
+        }
+        ptr++;
+    }
+
+    return translates;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ReadDataBase(const char* file_name, char** buffer)
+{
+    assert(file_name != NULL);
+    assert(buffer    != NULL);
+
+    FILE* file = fopen(file_name, "rb");
+    if (file == NULL) return 0;
+
+    size_t file_size = GetFileSize(file);
+    *buffer = (char *)calloc(file_size + 1, sizeof(char));
+    fread(*buffer, sizeof(char), file_size, file);
+    fclose(file);
+
+    return file_size;
+}
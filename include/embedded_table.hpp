@@ -0,0 +1,182 @@
+#pragma once
+#include <cstddef>
+#include <array>
+#include "hash_table.hpp"
+
+/*
+Hash table built by compiler from constant array of elements (dic_embed makes such headers from .dic).
+Nodes and buckets are constexpr, so they lie in read only memory and nothing is done on start,
+HashTable itself is constant initialized and is asked with HashTable_get as usual.
+Layout is the same as after HashTable_pack: nodes of every bucket lie together, in order of dictionary.
+Table is read only: put, rehash and destruct mustn't be called for it.
+*/
+
+/* The same as HashingFunction */
+constexpr unsigned long long ConstexprHashingFunction(const char* key)
+{
+#ifdef SLOW
+    unsigned long long hash = 5381;
+
+    while (*key)
+    {
+        hash = ((hash << 5) + hash) + *key;
+        key++;
+    }
+    return hash;
+#else
+    /* crc32 instruction: CRC-32C without inversions, 8 bytes of key are little endian word */
+    unsigned long long hash = 0;
+
+    do
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            hash ^= (unsigned char)key[i];
+
+            for (int bit = 0; bit < 8; bit++)
+                hash = (hash >> 1) ^ (0x82F63B78 & (0 - (hash & 1)));
+        }
+
+        key += 8;
+    } while (*key);
+
+    return hash;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+constexpr bool ConstexprStringEqual(const char* first, const char* second)
+{
+    while (*first && *first == *second)
+    {
+        first++;
+        second++;
+    }
+
+    return *first == *second;
+}
+
+//-----------------------------------------------------------------------------
+
+constexpr size_t EmbeddedCapacity(size_t elements_count)
+{
+    return elements_count / LoadFactor + 1;
+}
+
+//-----------------------------------------------------------------------------
+
+template <size_t N>
+struct EmbeddedNodes
+{
+    Node<HashTableEl> nodes[N];
+    size_t size;                   /* count of different keys */
+};
+
+//-----------------------------------------------------------------------------
+
+/* Repeated key keeps place of its first entry and value of the last one, like HashTable_put */
+template <size_t N, size_t CAPACITY>
+constexpr EmbeddedNodes<N> EmbeddedNodes_build(const HashTableEl (&elements)[N])
+{
+    EmbeddedNodes<N> result = {};
+
+    size_t buckets[N]                 = {};
+    size_t bucket_begin[CAPACITY + 1] = {};
+    size_t order[N]                   = {};
+
+    /* Counting sort of elements by buckets, stable */
+    for (size_t i = 0; i < N; i++)
+    {
+        buckets[i] = ConstexprHashingFunction(elements[i].key) % CAPACITY;
+        bucket_begin[buckets[i] + 1]++;
+    }
+
+    for (size_t i = 0; i < CAPACITY; i++)
+        bucket_begin[i + 1] += bucket_begin[i];
+
+    size_t next_place[CAPACITY] = {};
+    for (size_t i = 0; i < CAPACITY; i++)
+        next_place[i] = bucket_begin[i];
+
+    for (size_t i = 0; i < N; i++)
+        order[next_place[buckets[i]]++] = i;
+
+    for (size_t bucket = 0; bucket < CAPACITY; bucket++)
+    {
+        size_t first_node = result.size;
+
+        for (size_t i = bucket_begin[bucket]; i < bucket_begin[bucket + 1]; i++)
+        {
+            const HashTableEl &el = elements[order[i]];
+
+            size_t node = first_node;
+            while (node < result.size && !ConstexprStringEqual(result.nodes[node].value.key, el.key))
+                node++;
+
+            result.nodes[node].value = el;
+            if (node == result.size)
+                result.size++;
+        }
+
+        size_t bucket_size = result.size - first_node;
+
+        for (size_t i = 0; i < bucket_size; i++)
+        {
+            result.nodes[first_node + i].next = (i + 1) % bucket_size;
+            result.nodes[first_node + i].prev = (i + bucket_size - 1) % bucket_size;
+        }
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Buckets are packed lists pointing to read only nodes */
+template <size_t N, size_t CAPACITY>
+constexpr std::array<My_list<HashTableEl>, CAPACITY> EmbeddedBuckets_build(const EmbeddedNodes<N> &nodes)
+{
+    std::array<My_list<HashTableEl>, CAPACITY> buckets = {};
+
+    for (size_t i = 0; i < CAPACITY; i++)
+    {
+        buckets[i].head          = -1;
+        buckets[i].free          = -1;
+        buckets[i].boost_mode    = 1;
+        buckets[i].external_data = 1;
+    }
+
+    for (size_t i = 0; i < nodes.size; i++)
+    {
+        My_list<HashTableEl> &bucket = buckets[ConstexprHashingFunction(nodes.nodes[i].value.key) % CAPACITY];
+
+        if (bucket.size == 0)
+        {
+            bucket.data = const_cast<Node<HashTableEl> *>(&nodes.nodes[i]);
+            bucket.head = 0;
+        }
+
+        bucket.size++;
+        bucket.capacity++;
+    }
+
+    return buckets;
+}
+
+//-----------------------------------------------------------------------------
+
+template <size_t N, size_t CAPACITY>
+constexpr HashTable EmbeddedTable_build(const std::array<My_list<HashTableEl>, CAPACITY> &buckets,
+                                        const EmbeddedNodes<N> &nodes)
+{
+    HashTable table = {};
+
+    table.capacity        = CAPACITY;
+    table.size            = nodes.size;
+    table.buckets         = const_cast<My_list<HashTableEl> *>(buckets.data());
+    table.hash_function   = HashingFunction;
+    table.max_load_factor = LoadFactor;
+
+    return table;
+}
@@ -0,0 +1,449 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+"Did you mean" index like SymSpell: words within edit distance d of query share a string made by
+not more than d deletions from both of them. Only first FUZZY_PREFIX_LEN characters are used
+(for prefixes it stays true), so every word has at most 29 such strings for d = 2. They are short,
+so string itself packed to 8 bytes is its key, index keeps 32-bit hash of key and number of word
+in buckets like CompactTable. Candidates are checked by bit-parallel edit distance (Myers):
+one column of distance matrix is 64-bit word and is computed with few bitwise operations.
+Words must outlive the index.
+*/
+
+const size_t FUZZY_PREFIX_LEN    = 7;
+const size_t FUZZY_MAX_DISTANCE  = 2;
+const size_t FUZZY_MAX_DELETES   = 64;       /* >= sum of C(FUZZY_PREFIX_LEN, k) for k <= FUZZY_MAX_DISTANCE */
+const size_t FUZZY_MAX_CANDIDATES = 4096;    /* different words, repeats are removed while collecting */
+const size_t FUZZY_BITS          = 64;       /* longer queries are checked by usual DP */
+
+struct FuzzyEntry
+{
+    uint32_t hash;
+    uint32_t word;
+};
+
+struct FuzzyIndex
+{
+    size_t max_distance;
+
+    KeyType *words;
+    unsigned char *lengths;        /* 255 for longer words, so most candidates are filtered without key */
+    size_t words_count;
+
+    size_t capacity;
+    uint32_t *bucket_begin;        /* capacity + 1, like in CompactTable */
+    FuzzyEntry *entries;
+    size_t entries_count;
+};
+
+struct FuzzySuggestion
+{
+    KeyType word;
+    size_t distance;
+    size_t length_difference;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error FuzzyIndex_construct(FuzzyIndex *ths, DoubleWord *translates, size_t words_count,
+                                size_t max_distance = FUZZY_MAX_DISTANCE);
+
+size_t FuzzyIndex_suggest(FuzzyIndex *ths, const char *key, FuzzySuggestion *suggestions, size_t limit,
+                          bool *truncated = NULL);
+
+size_t FuzzyIndex_bytes(FuzzyIndex *ths);
+
+hash_error FuzzyIndex_destruct(FuzzyIndex *ths);
+
+size_t EditDistance(const char *first, const char *second);
+
+//=============================================================================
+
+inline uint32_t FuzzyHash(uint64_t packed)
+{
+    packed ^= packed >> 33;
+    packed *= 0xFF51AFD7ED558CCDULL;
+    packed ^= packed >> 33;
+
+    return (uint32_t)packed;
+}
+
+//-----------------------------------------------------------------------------
+
+int FuzzyDeletes_compare(const void *first, const void *second)
+{
+    uint64_t a = *(const uint64_t *)first;
+    uint64_t b = *(const uint64_t *)second;
+
+    return (a > b) - (a < b);
+}
+
+//-----------------------------------------------------------------------------
+
+/* All different strings made by deleting up to max_distance characters of prefix, packed
+   to little endian words. Returns their count */
+size_t FuzzyDeletes(const char *key, size_t max_distance, uint64_t *deletes)
+{
+    size_t len = strnlen(key, FUZZY_PREFIX_LEN);
+
+    uint64_t packed = 0;
+    memcpy(&packed, key, len);
+
+    deletes[0] = packed;
+    size_t count = 1;
+    size_t level_begin = 0;
+
+    for (size_t distance = 1; distance <= max_distance && distance <= len; distance++)
+    {
+        size_t level_end = count;
+        size_t level_len = len - distance + 1;
+
+        for (size_t i = level_begin; i < level_end; i++)
+        for (size_t position = 0; position < level_len; position++)
+        {
+            uint64_t low_mask = (1ULL << (8 * position)) - 1;
+            deletes[count++] = (deletes[i] & low_mask) | ((deletes[i] >> (8 * (position + 1))) << (8 * position));
+        }
+
+        level_begin = level_end;
+    }
+
+    qsort(deletes, count, sizeof(uint64_t), FuzzyDeletes_compare);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+        if (unique == 0 || deletes[i] != deletes[unique - 1])
+            deletes[unique++] = deletes[i];
+
+    return unique;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error FuzzyIndex_construct(FuzzyIndex *ths, DoubleWord *translates, size_t words_count, size_t max_distance)
+{
+    *ths = {};
+    ths->max_distance = (max_distance > FUZZY_MAX_DISTANCE) ? FUZZY_MAX_DISTANCE : max_distance;
+    ths->words_count  = words_count;
+
+    if (words_count > UINT32_MAX)
+        return HASH_ERROR;
+
+    ths->words   = (KeyType *)calloc(words_count + 1, sizeof(KeyType));
+    ths->lengths = (unsigned char *)calloc(words_count + 1, sizeof(unsigned char));
+    if (ths->words == NULL || ths->lengths == NULL)
+    {
+        FuzzyIndex_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    uint64_t deletes[FUZZY_MAX_DELETES] = {};
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        ths->words[i] = translates[i].primary_word;
+
+        size_t len = strlen(ths->words[i]);
+        ths->lengths[i] = (len < UCHAR_MAX) ? len : UCHAR_MAX;
+
+        ths->entries_count += FuzzyDeletes(ths->words[i], ths->max_distance, deletes);
+    }
+
+    /* Many words share deletes, so there are less different keys than entries */
+    ths->capacity = ths->entries_count / 2 + 1;
+    ths->bucket_begin = (uint32_t *)calloc(ths->capacity + 1, sizeof(uint32_t));
+    ths->entries      = (FuzzyEntry *)calloc(ths->entries_count + 1, sizeof(FuzzyEntry));
+
+    if (ths->entries_count > UINT32_MAX || ths->bucket_begin == NULL || ths->entries == NULL)
+    {
+        FuzzyIndex_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    /* The second pass makes the same deletes again instead of keeping them all */
+    for (size_t i = 0; i < words_count; i++)
+    {
+        size_t count = FuzzyDeletes(ths->words[i], ths->max_distance, deletes);
+
+        for (size_t j = 0; j < count; j++)
+            ths->bucket_begin[FuzzyHash(deletes[j]) % ths->capacity + 1]++;
+    }
+
+    for (size_t i = 0; i < ths->capacity; i++)
+        ths->bucket_begin[i + 1] += ths->bucket_begin[i];
+
+    uint32_t *fill = (uint32_t *)calloc(ths->capacity, sizeof(uint32_t));
+    if (fill == NULL)
+    {
+        FuzzyIndex_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    memcpy(fill, ths->bucket_begin, ths->capacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        size_t count = FuzzyDeletes(ths->words[i], ths->max_distance, deletes);
+
+        for (size_t j = 0; j < count; j++)
+        {
+            uint32_t hash = FuzzyHash(deletes[j]);
+            FuzzyEntry *entry = &ths->entries[fill[hash % ths->capacity]++];
+
+            entry->hash = hash;
+            entry->word = i;
+        }
+    }
+
+    free(fill);
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Match bits of every character in pattern, for Myers algorithm */
+struct FuzzyPattern
+{
+    uint64_t peq[256];
+    size_t length;
+};
+
+//-----------------------------------------------------------------------------
+
+void FuzzyPattern_construct(FuzzyPattern *ths, const char *pattern)
+{
+    memset(ths->peq, 0, sizeof(ths->peq));
+    ths->length = strlen(pattern);
+
+    for (size_t i = 0; i < ths->length && i < FUZZY_BITS; i++)
+        ths->peq[(unsigned char)pattern[i]] |= 1ULL << i;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Edit distance between pattern (not longer than 64) and text, Myers/Hyyro bit vectors:
+   pv/mv are +1/-1 vertical differences of current column, score is the last cell of column */
+size_t FuzzyPattern_distance(FuzzyPattern *ths, const char *text)
+{
+    if (ths->length == 0)
+        return strlen(text);
+
+    uint64_t pv   = (ths->length == FUZZY_BITS) ? ~0ULL : (1ULL << ths->length) - 1;
+    uint64_t mv   = 0;
+    uint64_t last = 1ULL << (ths->length - 1);
+    size_t score  = ths->length;
+
+    for (const unsigned char *symbol = (const unsigned char *)text; *symbol; symbol++)
+    {
+        uint64_t eq = ths->peq[*symbol];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        if      (ph & last) score++;
+        else if (mh & last) score--;
+
+        /* The first row is distance from empty prefix, so it grows by one every step */
+        ph = (ph << 1) | 1;
+        mh = mh << 1;
+
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+
+    return score;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Levenshtein distance by usual DP with two rows */
+size_t EditDistance(const char *first, const char *second)
+{
+    size_t first_len  = strlen(first);
+    size_t second_len = strlen(second);
+
+    size_t *row = (size_t *)calloc(second_len + 1, sizeof(size_t));
+    if (row == NULL)
+        return (size_t)-1;
+
+    for (size_t j = 0; j <= second_len; j++)
+        row[j] = j;
+
+    for (size_t i = 1; i <= first_len; i++)
+    {
+        size_t diagonal = row[0];
+        row[0] = i;
+
+        for (size_t j = 1; j <= second_len; j++)
+        {
+            size_t replace = diagonal + (first[i - 1] != second[j - 1]);
+            diagonal = row[j];
+
+            size_t best = (row[j] < row[j - 1]) ? row[j] + 1 : row[j - 1] + 1;
+            row[j] = (replace < best) ? replace : best;
+        }
+    }
+
+    size_t distance = row[second_len];
+    free(row);
+
+    return distance;
+}
+
+//-----------------------------------------------------------------------------
+
+int FuzzyCandidates_compare(const void *first, const void *second)
+{
+    uint32_t a = *(const uint32_t *)first;
+    uint32_t b = *(const uint32_t *)second;
+
+    return (a > b) - (a < b);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Sorts candidates and removes repeats, returns count of different ones */
+size_t FuzzyCandidates_unique(uint32_t *candidates, size_t count)
+{
+    qsort(candidates, count, sizeof(uint32_t), FuzzyCandidates_compare);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+        if (unique == 0 || candidates[i] != candidates[unique - 1])
+            candidates[unique++] = candidates[i];
+
+    return unique;
+}
+
+//-----------------------------------------------------------------------------
+
+/* The closest words first, then the ones with closer length, then in order of dictionary.
+   Returns count of suggestions written (not more than limit). Word is found by every its delete
+   shared with key, so repeats are removed when candidates fill up; truncated is set if there are
+   more than FUZZY_MAX_CANDIDATES different ones even then and the rest isn't checked */
+size_t FuzzyIndex_suggest(FuzzyIndex *ths, const char *key, FuzzySuggestion *suggestions, size_t limit,
+                          bool *truncated)
+{
+    if (truncated != NULL)
+        *truncated = false;
+
+    if (ths->entries == NULL || limit == 0)
+        return 0;
+
+    uint64_t deletes[FUZZY_MAX_DELETES] = {};
+    size_t deletes_count = FuzzyDeletes(key, ths->max_distance, deletes);
+
+    uint32_t candidates[FUZZY_MAX_CANDIDATES];
+    size_t candidates_count = 0;
+    bool full = false;
+
+    for (size_t i = 0; i < deletes_count && !full; i++)
+    {
+        uint32_t hash = FuzzyHash(deletes[i]);
+        size_t bucket = hash % ths->capacity;
+
+        for (size_t j = ths->bucket_begin[bucket]; j < ths->bucket_begin[bucket + 1]; j++)
+        {
+            if (ths->entries[j].hash != hash)
+                continue;
+
+            if (candidates_count == FUZZY_MAX_CANDIDATES)
+            {
+                candidates_count = FuzzyCandidates_unique(candidates, candidates_count);
+                full = (candidates_count == FUZZY_MAX_CANDIDATES);
+
+                if (full)
+                    break;
+            }
+
+            candidates[candidates_count++] = ths->entries[j].word;
+        }
+    }
+
+    if (truncated != NULL)
+        *truncated = full;
+
+    candidates_count = FuzzyCandidates_unique(candidates, candidates_count);
+
+    FuzzyPattern pattern = {};
+    FuzzyPattern_construct(&pattern, key);
+
+    size_t key_len = pattern.length;
+    size_t found = 0;
+
+    for (size_t i = 0; i < candidates_count; i++)
+    {
+        size_t word_len = ths->lengths[candidates[i]];
+        size_t len_diff = (word_len > key_len) ? word_len - key_len : key_len - word_len;
+
+        if (word_len < UCHAR_MAX && len_diff > ths->max_distance)
+            continue;
+
+        KeyType word = ths->words[candidates[i]];
+        if (word_len == UCHAR_MAX)
+        {
+            word_len = strlen(word);
+            len_diff = (word_len > key_len) ? word_len - key_len : key_len - word_len;
+        }
+
+        size_t distance = (key_len <= FUZZY_BITS) ? FuzzyPattern_distance(&pattern, word) : EditDistance(key, word);
+        if (distance > ths->max_distance)
+            continue;
+
+        /* Insertion sort to the first limit places */
+        size_t place = found;
+        while (place > 0)
+        {
+            FuzzySuggestion *prev = &suggestions[place - 1];
+
+            if (prev->distance < distance || (prev->distance == distance && prev->length_difference <= len_diff))
+                break;
+
+            if (place < limit)
+                suggestions[place] = *prev;
+            place--;
+        }
+
+        if (place < limit)
+        {
+            suggestions[place].word              = word;
+            suggestions[place].distance          = distance;
+            suggestions[place].length_difference = len_diff;
+
+            if (found < limit)
+                found++;
+        }
+    }
+
+    return found;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t FuzzyIndex_bytes(FuzzyIndex *ths)
+{
+    return (ths->capacity + 1) * sizeof(uint32_t) + ths->entries_count * sizeof(FuzzyEntry) +
+           ths->words_count * (sizeof(KeyType) + sizeof(unsigned char));
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error FuzzyIndex_destruct(FuzzyIndex *ths)
+{
+    free(ths->words);
+    free(ths->lengths);
+    free(ths->bucket_begin);
+    free(ths->entries);
+
+    *ths = {};
+
+    return HASH_OK;
+}
@@ -0,0 +1,298 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <new>
+#include "hash_table.hpp"
+
+/*
+Translation cache with bounded memory in front of slower storage. Entries lie in fixed
+array of slots, free slots are kept in list like in My_list, key is found by open addressing
+index of slot numbers. When count of entries or bytes reaches budget, entry is evicted by CLOCK:
+get only sets referenced flag of slot, hand of clock clears flags and evicts first entry without it.
+Segmented LRU is done the same way: referenced entry of probation segment is moved to protected one
+by the hand instead of get, protected entries over quota go back to probation.
+Get may be called from several threads under shared lock, put needs exclusive one.
+*/
+
+const double CACHE_INDEX_LOAD       = 0.5;
+const double CACHE_PROTECTED_SHARE  = 0.8;
+
+typedef enum cache_policy_en
+{
+    CACHE_CLOCK = 0,
+    CACHE_SLRU  = 1
+} cache_policy;
+
+struct CacheSlot
+{
+    HashTableEl el;                /* NULL key for free slot */
+    unsigned long long hash;
+    size_t bytes;                  /* key and value are copied to one block */
+    long long next_free;
+
+    std::atomic<unsigned char> referenced;
+    unsigned char protected_segment;
+};
+
+struct HashCache
+{
+    size_t max_entries;
+    size_t max_bytes;              /* 0 if only count of entries is limited */
+    cache_policy policy;
+    HashFunction hash_function;
+
+    size_t size;
+    size_t bytes;
+    size_t protected_size;
+    size_t evictions;
+
+    CacheSlot *slots;              /* max_entries */
+    long long free;
+    size_t hand;
+
+    unsigned *index;               /* slot number + 1, 0 for empty cell */
+    size_t index_mask;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error HashCache_construct(HashCache *ths, size_t max_entries, size_t max_bytes, cache_policy policy,
+                               HashFunction hash_function = HashingFunction);
+
+ValueType* HashCache_get(HashCache *ths, KeyType key);
+
+hash_error HashCache_put(HashCache *ths, KeyType key, ValueType value);
+
+hash_error HashCache_destruct(HashCache *ths);
+
+//=============================================================================
+
+hash_error HashCache_construct(HashCache *ths, size_t max_entries, size_t max_bytes, cache_policy policy,
+                               HashFunction hash_function)
+{
+    *ths = {};
+    ths->max_entries   = (max_entries == 0) ? 1 : max_entries;
+    ths->max_bytes     = max_bytes;
+    ths->policy        = policy;
+    ths->hash_function = hash_function;
+
+    size_t index_size = 1;
+    while (index_size * CACHE_INDEX_LOAD < ths->max_entries)
+        index_size *= 2;
+
+    ths->index_mask = index_size - 1;
+    ths->index = (unsigned *)calloc(index_size, sizeof(unsigned));
+    ths->slots = new (std::nothrow) CacheSlot[ths->max_entries]();
+
+    if (ths->index == NULL || ths->slots == NULL)
+    {
+        HashCache_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    for (size_t i = 0; i < ths->max_entries; i++)
+        ths->slots[i].next_free = (i + 1 < ths->max_entries) ? (long long)(i + 1) : -1;
+
+    ths->free = 0;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Returns cell of index with this key or empty cell where it should be */
+size_t HashCache_find_cell(HashCache *ths, KeyType key, unsigned long long hash)
+{
+    size_t cell = hash & ths->index_mask;
+
+    while (ths->index[cell] != 0)
+    {
+        CacheSlot *slot = &ths->slots[ths->index[cell] - 1];
+
+        if (slot->hash == hash && !strcmp(slot->el.key, key))
+            return cell;
+
+        cell = (cell + 1) & ths->index_mask;
+    }
+
+    return cell;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Pointer is valid until next put */
+ValueType* HashCache_get(HashCache *ths, KeyType key)
+{
+    size_t cell = HashCache_find_cell(ths, key, ths->hash_function(key));
+
+    if (ths->index[cell] == 0)
+        return NULL;
+
+    CacheSlot *slot = &ths->slots[ths->index[cell] - 1];
+
+    /* Flag is written only if it's not set yet, so hot line isn't written by every get */
+    if (!slot->referenced.load(std::memory_order_relaxed))
+        slot->referenced.store(1, std::memory_order_relaxed);
+
+    return &slot->el.value;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Backward shift deletion, so index doesn't need tombstones */
+void HashCache_erase_cell(HashCache *ths, size_t cell)
+{
+    size_t next = (cell + 1) & ths->index_mask;
+
+    while (ths->index[next] != 0)
+    {
+        size_t home = ths->slots[ths->index[next] - 1].hash & ths->index_mask;
+
+        /* Element of next cell may move to the hole if its home isn't in (cell, next] */
+        if (((next - home) & ths->index_mask) >= ((next - cell) & ths->index_mask))
+        {
+            ths->index[cell] = ths->index[next];
+            cell = next;
+        }
+
+        next = (next + 1) & ths->index_mask;
+    }
+
+    ths->index[cell] = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void HashCache_free_slot(HashCache *ths, size_t slot_number)
+{
+    CacheSlot *slot = &ths->slots[slot_number];
+
+    HashCache_erase_cell(ths, HashCache_find_cell(ths, slot->el.key, slot->hash));
+
+    ths->size--;
+    ths->bytes -= slot->bytes;
+    if (slot->protected_segment)
+        ths->protected_size--;
+
+    std::free((void *)slot->el.key);
+
+    slot->el = {};
+    slot->bytes = 0;
+    slot->protected_segment = 0;
+    slot->referenced.store(0, std::memory_order_relaxed);
+
+    slot->next_free = ths->free;
+    ths->free = slot_number;
+}
+
+//-----------------------------------------------------------------------------
+
+void HashCache_evict(HashCache *ths)
+{
+    while (true)
+    {
+        /* Quota of current size, not of max_entries: byte budget may hold less entries */
+        size_t protected_quota = ths->size * CACHE_PROTECTED_SHARE;
+        size_t slot_number = ths->hand;
+        CacheSlot *slot = &ths->slots[slot_number];
+        ths->hand = (ths->hand + 1) % ths->max_entries;
+
+        if (slot->el.key == NULL)
+            continue;
+
+        bool referenced = slot->referenced.load(std::memory_order_relaxed);
+        if (referenced)
+            slot->referenced.store(0, std::memory_order_relaxed);
+
+        if (slot->protected_segment)
+        {
+            if (!referenced && ths->protected_size > protected_quota)
+            {
+                slot->protected_segment = 0;
+                ths->protected_size--;
+            }
+            continue;
+        }
+
+        if (referenced)
+        {
+            if (ths->policy == CACHE_SLRU)
+            {
+                slot->protected_segment = 1;
+                ths->protected_size++;
+            }
+            continue;
+        }
+
+        HashCache_free_slot(ths, slot_number);
+        ths->evictions++;
+        return;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key and value are copied, key is padded with zeros like keys of dictionary */
+hash_error HashCache_put(HashCache *ths, KeyType key, ValueType value)
+{
+    unsigned long long hash = ths->hash_function(key);
+
+    size_t key_size   = (strlen(key) + 7) / 8 * 8 + 8;
+    size_t value_size = strlen(value) + 1;
+    size_t bytes      = key_size + value_size;
+
+    if (ths->max_bytes != 0 && bytes > ths->max_bytes)
+        return HASH_ERROR;
+
+    size_t cell = HashCache_find_cell(ths, key, hash);
+    if (ths->index[cell] != 0)
+        HashCache_free_slot(ths, ths->index[cell] - 1);
+
+    while (ths->free == -1 || (ths->max_bytes != 0 && ths->bytes + bytes > ths->max_bytes))
+        HashCache_evict(ths);
+
+    char *block = (char *)calloc(bytes, 1);
+    if (block == NULL)
+        return HASH_REALLOC_ERROR;
+
+    memcpy(block, key, strlen(key));
+    memcpy(block + key_size, value, value_size);
+
+    size_t slot_number = ths->free;
+    CacheSlot *slot = &ths->slots[slot_number];
+    ths->free = slot->next_free;
+
+    slot->el.key    = block;
+    slot->el.value  = block + key_size;
+    slot->hash      = hash;
+    slot->bytes     = bytes;
+    slot->next_free = -1;
+
+    /* Eviction could move elements of index */
+    ths->index[HashCache_find_cell(ths, key, hash)] = slot_number + 1;
+
+    ths->size++;
+    ths->bytes += bytes;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashCache_destruct(HashCache *ths)
+{
+    if (ths->slots != NULL)
+        for (size_t i = 0; i < ths->max_entries; i++)
+            std::free((void *)ths->slots[i].el.key);
+
+    delete[] ths->slots;
+    free(ths->index);
+
+    ths->slots = NULL;
+    ths->index = NULL;
+    ths->size  = 0;
+    ths->bytes = 0;
+
+    return HASH_OK;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <nmmintrin.h>
+
+/*
+Alternative hashing functions for comparison with HashingFunction.
+All of them have HashFunction signature, so could be set to table with HashTable_set_hash.
+*/
+
+unsigned long long Djb2Hash(const char* key)
+{
+    unsigned long long hash = 5381;
+
+    while (*key)
+    {
+        hash = ((hash << 5) + hash) + *key;
+        key++;
+    }
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long Fnv1aHash(const char* key)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    while (*key)
+    {
+        hash ^= (unsigned char)*key;
+        hash *= 1099511628211ULL;
+        key++;
+    }
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+
+/* _mm_crc32_u8 version from README, works with any keys */
+__attribute__((target("sse4.2")))
+unsigned long long Crc32ByteHash(const char* key)
+{
+    unsigned long long hash = 0;
+
+    while (*key)
+    {
+        hash = _mm_crc32_u8(hash, *key);
+        key++;
+    }
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Same as HashingFunction in hashing.asm, key must be padded with zeros to 8 bytes */
+__attribute__((target("sse4.2")))
+unsigned long long Crc32Hash(const char* key)
+{
+    unsigned long long hash = 0;
+
+    do
+    {
+        uint64_t word = 0;
+        memcpy(&word, key, sizeof(word));
+
+        hash = _mm_crc32_u64(hash, word);
+        key += 8;
+    } while (*key);
+
+    return hash;
+}
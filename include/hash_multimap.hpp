@@ -0,0 +1,268 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Multimap of translations: value of key in HashTable points to run of all its translations in arena.
+Run is header with count and size, then values one after another, every value is 2 bytes
+of length, its characters and '\0'. So all translations of word are read together from one place
+instead of walking list. The first run has place only for one value, run which has no place
+for new value is copied to arena end with doubled capacity. Old place isn't used again,
+arena is freed only as a whole.
+*/
+
+const size_t MULTI_ARENA_BLOCK   = 1 << 16;
+const size_t MULTI_VALUE_MAX_LEN = UINT16_MAX;
+
+struct ArenaBlock
+{
+    ArenaBlock *prev;
+    size_t size;
+    size_t used;
+};
+
+struct MultiArena
+{
+    ArenaBlock *last;
+    size_t allocated;              /* bytes of blocks */
+    size_t abandoned;              /* bytes of runs which were moved */
+};
+
+struct ValueRun
+{
+    uint32_t count;
+    uint32_t bytes;                /* used bytes of values */
+    uint32_t capacity;             /* bytes for values after header */
+    uint32_t reserved;
+};
+
+/* Values of one key: count values of bytes total starting from data */
+struct ValueSpan
+{
+    const char *data;
+    size_t count;
+    size_t bytes;
+};
+
+struct HashMultiMap
+{
+    HashTable table;
+    MultiArena arena;
+    size_t values_count;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error HashMultiMap_construct(HashMultiMap *ths, size_t capacity, hash_alloc_policy policy = HASH_ALLOC_DEFAULT);
+
+hash_error HashMultiMap_append(HashMultiMap *ths, KeyType key, const char *value);
+
+ValueSpan HashMultiMap_get(HashMultiMap *ths, KeyType key);
+
+hash_error HashMultiMap_build(HashMultiMap *ths, DoubleWord *translates, size_t words_count);
+
+hash_error HashMultiMap_destruct(HashMultiMap *ths);
+
+const char* ValueSpan_first(ValueSpan span);
+
+const char* ValueSpan_next(ValueSpan span, const char *value);
+
+size_t ValueSpan_length(const char *value);
+
+//=============================================================================
+
+/* Pointer is aligned to 8 bytes and stays valid until arena is freed */
+char* MultiArena_alloc(MultiArena *ths, size_t size)
+{
+    size = (size + 7) / 8 * 8;
+
+    if (ths->last == NULL || ths->last->used + size > ths->last->size)
+    {
+        size_t block_size = (size > MULTI_ARENA_BLOCK) ? size : MULTI_ARENA_BLOCK;
+
+        ArenaBlock *block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL)
+            return NULL;
+
+        block->prev = ths->last;
+        block->size = block_size;
+        block->used = 0;
+
+        ths->last = block;
+        ths->allocated += block_size;
+    }
+
+    char *result = (char *)(ths->last + 1) + ths->last->used;
+    ths->last->used += size;
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void MultiArena_free(MultiArena *ths)
+{
+    while (ths->last != NULL)
+    {
+        ArenaBlock *prev = ths->last->prev;
+        free(ths->last);
+        ths->last = prev;
+    }
+
+    *ths = {};
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashMultiMap_construct(HashMultiMap *ths, size_t capacity, hash_alloc_policy policy)
+{
+    *ths = {};
+    return HashTable_construct(&ths->table, capacity, policy);
+}
+
+//-----------------------------------------------------------------------------
+
+ValueRun* HashMultiMap_new_run(HashMultiMap *ths, size_t capacity)
+{
+    ValueRun *run = (ValueRun *)MultiArena_alloc(&ths->arena, sizeof(ValueRun) + capacity);
+    if (run == NULL)
+        return NULL;
+
+    *run = {};
+    run->capacity = (capacity + 7) / 8 * 8;
+
+    return run;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key isn't copied, like in HashTable_put. Values are copied in order of append */
+hash_error HashMultiMap_append(HashMultiMap *ths, KeyType key, const char *value)
+{
+    size_t len = strlen(value);
+    if (len > MULTI_VALUE_MAX_LEN)
+        return HASH_ERROR;
+
+    size_t value_bytes = sizeof(uint16_t) + len + 1;
+
+    HashTableEl *el = HashTable_find_or_insert(&ths->table, key, ths->table.hash_function(key), NULL);
+    if (el == NULL)
+        return HASH_REALLOC_ERROR;
+
+    ValueRun *run = (ValueRun *)el->value;
+
+    if (run == NULL || run->bytes + value_bytes > run->capacity)
+    {
+        /* The first run is exact: most words have one translation */
+        size_t capacity = (run == NULL) ? value_bytes : 2 * (size_t)run->capacity;
+        while (capacity < ((run == NULL) ? 0 : run->bytes) + value_bytes)
+            capacity *= 2;
+
+        ValueRun *new_run = HashMultiMap_new_run(ths, capacity);
+        if (new_run == NULL)
+            return HASH_REALLOC_ERROR;
+
+        if (run != NULL)
+        {
+            memcpy(new_run + 1, run + 1, run->bytes);
+            new_run->count = run->count;
+            new_run->bytes = run->bytes;
+
+            ths->arena.abandoned += sizeof(ValueRun) + run->capacity;
+        }
+
+        run = new_run;
+        el->value = (ValueType)run;
+    }
+
+    char *place = (char *)(run + 1) + run->bytes;
+    uint16_t short_len = len;
+
+    memcpy(place, &short_len, sizeof(uint16_t));
+    memcpy(place + sizeof(uint16_t), value, len + 1);
+
+    run->count++;
+    run->bytes += value_bytes;
+    ths->values_count++;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Empty span if there's no such key. Span is valid until next append of this key */
+ValueSpan HashMultiMap_get(HashMultiMap *ths, KeyType key)
+{
+    ValueSpan span = {};
+
+    ValueType *found = HashTable_get(&ths->table, key);
+    if (found == NULL)
+        return span;
+
+    const ValueRun *run = (const ValueRun *)*found;
+
+    span.data  = (const char *)(run + 1);
+    span.count = run->count;
+    span.bytes = run->bytes;
+
+    return span;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Every line of dictionary is one more translation of its word */
+hash_error HashMultiMap_build(HashMultiMap *ths, DoubleWord *translates, size_t words_count)
+{
+    if (HashMultiMap_construct(ths, words_count / LoadFactor + 1) != HASH_OK)
+        return HASH_REALLOC_ERROR;
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        hash_error error = HashMultiMap_append(ths, translates[i].primary_word, translates[i].translated_word);
+        if (error != HASH_OK)
+            return error;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashMultiMap_destruct(HashMultiMap *ths)
+{
+    HashTable_destruct(&ths->table);
+    MultiArena_free(&ths->arena);
+    ths->values_count = 0;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Values are zero terminated strings, NULL after the last one */
+const char* ValueSpan_first(ValueSpan span)
+{
+    return (span.count == 0) ? NULL : span.data + sizeof(uint16_t);
+}
+
+//-----------------------------------------------------------------------------
+
+const char* ValueSpan_next(ValueSpan span, const char *value)
+{
+    const char *next = value + ValueSpan_length(value) + 1 + sizeof(uint16_t);
+
+    return (next < span.data + span.bytes) ? next : NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ValueSpan_length(const char *value)
+{
+    uint16_t len = 0;
+    memcpy(&len, value - sizeof(uint16_t), sizeof(uint16_t));
+
+    return len;
+}
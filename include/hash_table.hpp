@@ -1,11 +1,24 @@
+#pragma once
 #include <cstdlib>
 #include "list.hpp"
+#include "huge_pages.hpp"
 #include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <nmmintrin.h>
+
+#ifdef LATENCY_HISTOGRAMS
+#include "latency_histogram.hpp"
+#endif
 
 typedef const char* KeyType;
 typedef const char* ValueType;
 
-const double LoadFactor = 0.65;
+constexpr double LoadFactor = 0.65;
+
+const size_t HASH_STATS_HISTOGRAM_SIZE = 16;
+const size_t HASH_LANES                = 4;   /* keys hashed together by HashingFunction_batch */
+const size_t HASH_BATCH_MAX            = 64;
 
 //-----------------------------------------------------------------------------
 
@@ -29,6 +42,10 @@ extern "C" unsigned long long HashingFunction(const char*);
 
 #endif
 
+typedef unsigned long long (*HashFunction)(const char*);
+
+typedef ValueType (*ValueMaker)(KeyType key, void *context);
+
 //-----------------------------------------------------------------------------
 
 typedef enum hash_error_en
@@ -44,25 +61,119 @@ struct HashTableEl
     ValueType value;
 };
 
+/* Counters of get, they are updated only if HASH_TABLE_STATS is defined
+   (get.asm must be assembled with the same define) */
+struct HashTableCounters
+{
+    unsigned long long gets_hit;
+    unsigned long long gets_miss;
+    unsigned long long probes_hit;
+    unsigned long long probes_miss;
+};
+
 struct HashTable
 {
     size_t capacity;
     size_t size;
     My_list<HashTableEl> *buckets;
+    HashFunction hash_function;  /* HashingFunction by default */
+
+#ifdef HASH_TABLE_STATS
+    HashTableCounters counters;
+#endif
+
+    /* Fields above are used in get.asm, don't move them */
+    double max_load_factor;      /* LoadFactor by default, table grows twice after it */
+
+    size_t rehash_count;
+    unsigned long long rehash_time_ns;
+
+    hash_alloc_policy alloc_policy;
+    HugeBlock buckets_block;
+    HugeBlock entries_block;     /* Nodes of all buckets after HashTable_pack */
+};
+
+struct HashTableStats
+{
+    size_t size;
+    size_t capacity;
+    double load_factor;
+
+    size_t max_chain;
+    /* Count of buckets with such chain length, last one is for longer chains too */
+    size_t chain_histogram[HASH_STATS_HISTOGRAM_SIZE];
+
+    /* Expected count of compares if every key (or every bucket for miss) is asked equally */
+    double expected_probes_hit;
+    double expected_probes_miss;
+
+    /* Measured, zero without HASH_TABLE_STATS */
+    HashTableCounters counters;
+    double avg_probes_hit;
+    double avg_probes_miss;
+
+    size_t rehash_count;
+    unsigned long long rehash_time_ns;
+
+    /* Buckets and nodes, keys and values aren't owned by table */
+    size_t bytes;
+    double bytes_per_entry;
 };
 
 //-----------------------------------------------------------------------------
 
 hash_error HashTable_add(HashTable *ths, KeyType key, ValueType value);
 
+hash_error HashTable_add_hashed(HashTable *ths, KeyType key, ValueType value, unsigned long long hash);
+
+void HashTable_add_batch(HashTable *ths, const HashTableEl *elements, size_t count);
+
 hash_error HashTable_rehash(HashTable *ths, size_t new_capacity);
 
-hash_error HashTable_construct(HashTable *ths, size_t new_capacity);
+hash_error HashTable_construct(HashTable *ths, size_t new_capacity, hash_alloc_policy policy = HASH_ALLOC_DEFAULT);
+
+hash_error HashTable_allocate(HashTable *ths, size_t new_capacity, hash_alloc_policy policy);
+
+void HashTable_construct_buckets(HashTable *ths, size_t from, size_t to);
+
+hash_error HashTable_pack(HashTable *ths);
+
+hash_error HashTable_set_hash(HashTable *ths, HashFunction hash_function);
 
 hash_error HashTable_put(HashTable *ths, KeyType new_key, ValueType new_value);
 
+hash_error HashTable_put_hashed(HashTable *ths, KeyType new_key, ValueType new_value, unsigned long long hash);
+
+hash_error HashTable_remove(HashTable *ths, KeyType key);
+
+HashTableEl* HashTable_find_or_insert(HashTable *ths, KeyType key, unsigned long long hash, bool *inserted);
+
+HashTableEl* HashTable_bucket_find(My_list<HashTableEl> *bucket, KeyType key);
+
+ValueType* HashTable_emplace(HashTable *ths, KeyType key, ValueType value, bool *inserted = NULL);
+
+ValueType* HashTable_upsert(HashTable *ths, KeyType key, ValueType value, bool *inserted = NULL);
+
+ValueType* HashTable_try_emplace(HashTable *ths, KeyType key, ValueMaker make_value, void *context, bool *inserted = NULL);
+
 hash_error HashTable_destruct(HashTable *ths);
 
+hash_error HashTable_stats(HashTable *ths, HashTableStats *stats);
+
+void HashTable_reset_counters(HashTable *ths);
+
+size_t HashTable_bytes(HashTable *ths);
+
+void HashTable_dump_stats(HashTableStats *stats, FILE *file, const char *name);
+
+ValueType* HashTable_get_hashed(HashTable *ths, KeyType key, unsigned long long hash);
+
+void HashTable_get_batch(HashTable *ths, const KeyType *keys, size_t count, ValueType **values);
+
+void HashingFunction_batch(const KeyType *keys, size_t count, unsigned long long *hashes);
+
+void HashFunction_batch(HashFunction hash_function, const KeyType *keys, size_t count, unsigned long long *hashes);
+
 #ifdef SLOW
 ValueType* HashTable_get(HashTable *ths, KeyType key);
 #else
@@ -71,24 +182,55 @@ extern "C" ValueType* HashTable_get(HashTable* ths, KeyType key);
 
 //=============================================================================
 
-hash_error HashTable_construct(HashTable *ths, size_t new_capacity)
+hash_error HashTable_construct(HashTable *ths, size_t new_capacity, hash_alloc_policy policy)
+{
+    if (HashTable_allocate(ths, new_capacity, policy) != HASH_OK)
+        return HASH_REALLOC_ERROR;
+
+    HashTable_construct_buckets(ths, 0, ths->capacity);
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Sets fields and allocates array of buckets, but buckets themselves aren't constructed */
+hash_error HashTable_allocate(HashTable *ths, size_t new_capacity, hash_alloc_policy policy)
 {
     ths->capacity = (new_capacity <= 0) ? 1 : new_capacity;
+    ths->hash_function = HashingFunction;
+    ths->max_load_factor = LoadFactor;
+    ths->alloc_policy = policy;
+    ths->entries_block = {};
 
-    ths->buckets = (My_list<HashTableEl> *)calloc(ths->capacity, sizeof(My_list<HashTableEl>));
+    ths->buckets_block = HugeBlock_alloc(ths->capacity * sizeof(My_list<HashTableEl>), policy);
+    ths->buckets = (My_list<HashTableEl> *)ths->buckets_block.ptr;
 
     if (ths->buckets == NULL)
         return HASH_REALLOC_ERROR;
     
+    ths->size = 0;
+    ths->rehash_count = 0;
+    ths->rehash_time_ns = 0;
+
+#ifdef HASH_TABLE_STATS
+    ths->counters = {};
+#endif
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Buckets [from, to) are independent, so different threads may construct different ranges */
+void HashTable_construct_buckets(HashTable *ths, size_t from, size_t to)
+{
     HashTableEl default_el = {};
     default_el.key   = NULL;
     default_el.value = NULL;
 
-    for (size_t i = 0; i < ths->capacity; i++)
+    for (size_t i = from; i < to; i++)
         ths->buckets[i].construct(1, default_el);
-    
-    ths->size = 0;
-    return HASH_OK;
 }
 
 //-----------------------------------------------------------------------------
@@ -99,8 +241,16 @@ hash_error HashTable_rehash(HashTable *ths, size_t new_capacity)
     if (new_capacity < ths->capacity)
         return HASH_ERROR;
     
+    timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
     HashTable new_hash_table = {};
-    HashTable_construct(&new_hash_table, new_capacity);
+    HashTable_construct(&new_hash_table, new_capacity, ths->alloc_policy);
+    new_hash_table.hash_function = ths->hash_function;
+
+    /* Elements are added in the same order, keys are hashed by HASH_BATCH_MAX together */
+    HashTableEl batch[HASH_BATCH_MAX];
+    size_t batch_size = 0;
 
     for (size_t i = 0; i < ths->capacity; i++)
     {
@@ -111,16 +261,40 @@ hash_error HashTable_rehash(HashTable *ths, size_t new_capacity)
         size_t curr_size = curr_bucket->get_size();
 
         for (size_t j = 0; j < curr_size; j++, curr_bucket->iter_increase(iter))
-            HashTable_add(&new_hash_table, (*curr_bucket)[iter].key, (*curr_bucket)[iter].value);
+        {
+            batch[batch_size++] = (*curr_bucket)[iter];
+
+            if (batch_size == HASH_BATCH_MAX)
+            {
+                HashTable_add_batch(&new_hash_table, batch, batch_size);
+                batch_size = 0;
+            }
+        }
 
         curr_bucket->destruct();
     }
+
+    HashTable_add_batch(&new_hash_table, batch, batch_size);
     
-    free(ths->buckets);
+    HugeBlock_free(&ths->buckets_block);
+    HugeBlock_free(&ths->entries_block);
     ths->buckets = new_hash_table.buckets;
+    ths->buckets_block = new_hash_table.buckets_block;
     ths->capacity = new_hash_table.capacity;
     ths->size = new_hash_table.size;
 
+    timespec end = {};
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned long long time_ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+    ths->rehash_count++;
+    ths->rehash_time_ns += time_ns;
+
+#ifdef LATENCY_HISTOGRAMS
+    Latency_record(LATENCY_REHASH, time_ns);
+#endif
+
     return HASH_OK;
 }
 
@@ -128,8 +302,34 @@ hash_error HashTable_rehash(HashTable *ths, size_t new_capacity)
 
 hash_error HashTable_add(HashTable *ths, KeyType key, ValueType value)
 {
-    unsigned long long new_hash = HashingFunction(key);
-    
+    return HashTable_add_hashed(ths, key, value, ths->hash_function(key));
+}
+
+//-----------------------------------------------------------------------------
+
+/* Not more than HASH_BATCH_MAX elements, they are added in order */
+void HashTable_add_batch(HashTable *ths, const HashTableEl *elements, size_t count)
+{
+    if (count == 0)
+        return;
+
+    KeyType keys[HASH_BATCH_MAX] = {};
+    unsigned long long hashes[HASH_BATCH_MAX];
+
+    for (size_t i = 0; i < count; i++)
+        keys[i] = elements[i].key;
+
+    HashFunction_batch(ths->hash_function, keys, count, hashes);
+
+    for (size_t i = 0; i < count; i++)
+        HashTable_add_hashed(ths, elements[i].key, elements[i].value, hashes[i]);
+}
+
+//-----------------------------------------------------------------------------
+
+/* hash must be ths->hash_function(key), it's for callers which have already computed it */
+hash_error HashTable_add_hashed(HashTable *ths, KeyType key, ValueType value, unsigned long long new_hash)
+{
     HashTableEl new_el = {};
     new_el.key   = key;
     new_el.value = value;
@@ -138,7 +338,7 @@ hash_error HashTable_add(HashTable *ths, KeyType key, ValueType value)
 
     ths->size++;
     
-    if (((double)ths->size / ths->capacity) > LoadFactor)
+    if (((double)ths->size / ths->capacity) > ths->max_load_factor)
         HashTable_rehash(ths, ths->capacity * 2);
     
     return HASH_OK;
@@ -146,12 +346,8 @@ hash_error HashTable_add(HashTable *ths, KeyType key, ValueType value)
 
 //-----------------------------------------------------------------------------
 
-#ifdef SLOW
-
-ValueType* HashTable_get(HashTable *ths, KeyType key)
+ValueType* HashTable_get_hashed(HashTable *ths, KeyType key, unsigned long long new_hash)
 {
-    unsigned long long new_hash = HashingFunction(key);
-
     My_list<HashTableEl> *curr_bucket = &(ths->buckets[new_hash % ths->capacity]);
     size_t curr_size = curr_bucket->size;
 
@@ -161,30 +357,353 @@ ValueType* HashTable_get(HashTable *ths, KeyType key)
     for (size_t i = 0; i < curr_size; i++, curr_bucket->iter_increase(iter))
     {
         if (!strcmp(key, (*curr_bucket)[iter].key))
+        {
+#ifdef HASH_TABLE_STATS
+            ths->counters.gets_hit++;
+            ths->counters.probes_hit += i + 1;
+#endif
             return &((*curr_bucket)[iter].value);
+        }
     }
 
+#ifdef HASH_TABLE_STATS
+    ths->counters.gets_miss++;
+    ths->counters.probes_miss += curr_size;
+#endif
+
     return NULL;
 }
 
+//-----------------------------------------------------------------------------
+
+#ifdef SLOW
+
+ValueType* HashTable_get(HashTable *ths, KeyType key)
+{
+    return HashTable_get_hashed(ths, key, ths->hash_function(key));
+}
+
 #endif
 
 //-----------------------------------------------------------------------------
 
+/* Hashes of all keys are computed first and buckets are prefetched, so cache misses
+   of different keys overlap instead of going one after another */
+void HashTable_get_batch(HashTable *ths, const KeyType *keys, size_t count, ValueType **values)
+{
+    for (size_t batch = 0; batch < count; batch += HASH_BATCH_MAX)
+    {
+        size_t batch_size = (count - batch < HASH_BATCH_MAX) ? count - batch : HASH_BATCH_MAX;
+        My_list<HashTableEl> *batch_buckets[HASH_BATCH_MAX];
+        unsigned long long    batch_hashes[HASH_BATCH_MAX];
+
+        HashFunction_batch(ths->hash_function, keys + batch, batch_size, batch_hashes);
+
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            batch_buckets[i] = &(ths->buckets[batch_hashes[i] % ths->capacity]);
+            __builtin_prefetch(batch_buckets[i]);
+        }
+
+        for (size_t i = 0; i < batch_size; i++)
+            __builtin_prefetch(batch_buckets[i]->data);
+
+        for (size_t i = 0; i < batch_size; i++)
+        {
+            My_list<HashTableEl> *curr_bucket = batch_buckets[i];
+            size_t curr_size = curr_bucket->size;
+
+            list_iterator iter = curr_bucket->begin();
+            values[batch + i] = NULL;
+
+            for (size_t j = 0; j < curr_size; j++, curr_bucket->iter_increase(iter))
+            {
+                if (!strcmp(keys[batch + i], (*curr_bucket)[iter].key))
+                {
+                    values[batch + i] = &((*curr_bucket)[iter].value);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+inline unsigned long long HashWord(const char *word)
+{
+    unsigned long long result = 0;
+    memcpy(&result, word, sizeof(result));
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+#ifndef SLOW
+
+/* The same as HashingFunction for HASH_LANES keys at once. crc32 of one key waits for the previous
+   crc32 of this key, but chains of different keys don't depend on each other, so they go
+   through the unit together. Lanes go together while all keys have next word, then the rest
+   of longer keys is hashed one by one */
+__attribute__((target("sse4.2")))
+void HashingFunction_lanes(const KeyType *keys, unsigned long long *hashes)
+{
+    const char *word0 = keys[0], *word1 = keys[1], *word2 = keys[2], *word3 = keys[3];
+    unsigned long long hash0 = 0, hash1 = 0, hash2 = 0, hash3 = 0;
+
+    do
+    {
+        hash0 = _mm_crc32_u64(hash0, HashWord(word0));
+        hash1 = _mm_crc32_u64(hash1, HashWord(word1));
+        hash2 = _mm_crc32_u64(hash2, HashWord(word2));
+        hash3 = _mm_crc32_u64(hash3, HashWord(word3));
+
+        word0 += 8;
+        word1 += 8;
+        word2 += 8;
+        word3 += 8;
+    } while (*word0 && *word1 && *word2 && *word3);
+
+    for (; *word0; word0 += 8) hash0 = _mm_crc32_u64(hash0, HashWord(word0));
+    for (; *word1; word1 += 8) hash1 = _mm_crc32_u64(hash1, HashWord(word1));
+    for (; *word2; word2 += 8) hash2 = _mm_crc32_u64(hash2, HashWord(word2));
+    for (; *word3; word3 += 8) hash3 = _mm_crc32_u64(hash3, HashWord(word3));
+
+    hashes[0] = hash0;
+    hashes[1] = hash1;
+    hashes[2] = hash2;
+    hashes[3] = hash3;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+/* hashes[i] = HashingFunction(keys[i]), keys are padded like for HashingFunction */
+void HashingFunction_batch(const KeyType *keys, size_t count, unsigned long long *hashes)
+{
+    size_t i = 0;
+
+#ifndef SLOW
+    for (; i + HASH_LANES <= count; i += HASH_LANES)
+        HashingFunction_lanes(keys + i, hashes + i);
+#endif
+
+    for (; i < count; i++)
+        hashes[i] = HashingFunction(keys[i]);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Other functions hash keys one by one */
+void HashFunction_batch(HashFunction hash_function, const KeyType *keys, size_t count, unsigned long long *hashes)
+{
+    if (hash_function == HashingFunction)
+    {
+        HashingFunction_batch(keys, count, hashes);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        hashes[i] = hash_function(keys[i]);
+}
+
+//-----------------------------------------------------------------------------
+
 hash_error HashTable_put(HashTable *ths, KeyType new_key, ValueType new_value)
 {
-    const char ** value_ptr = HashTable_get(ths, new_key);
+#ifdef LATENCY_HISTOGRAMS
+    unsigned long long start = LatencyNow();
+    hash_error error = HashTable_put_hashed(ths, new_key, new_value, ths->hash_function(new_key));
+    Latency_record(LATENCY_PUT, LatencyNow() - start);
+
+    return error;
+#else
+    return HashTable_put_hashed(ths, new_key, new_value, ths->hash_function(new_key));
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+/* Moves nodes of all buckets to one array (in huge pages if policy says so). 
+   Call it after bulk load, next adds to bucket move it out of this array */
+hash_error HashTable_pack(HashTable *ths)
+{
+    HugeBlock new_block = HugeBlock_alloc(ths->size * sizeof(Node<HashTableEl>), ths->alloc_policy);
+
+    if (new_block.ptr == NULL)
+        return HASH_REALLOC_ERROR;
 
-    if (value_ptr == NULL)
+    Node<HashTableEl> *storage = (Node<HashTableEl> *)new_block.ptr;
+
+    for (size_t i = 0; i < ths->capacity; i++)
     {
-        HashTable_add(ths, new_key, new_value);
-        return HASH_OK;
+        size_t curr_size = ths->buckets[i].get_size();
+        if (curr_size == 0)
+            continue;
+
+        ths->buckets[i].pack(storage);
+        storage += curr_size;
     }
-    else
+
+    HugeBlock_free(&ths->entries_block);
+    ths->entries_block = new_block;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Only for empty table, elements aren't moved */
+hash_error HashTable_set_hash(HashTable *ths, HashFunction hash_function)
+{
+    if (ths->size != 0)
+        return HASH_ERROR;
+
+    ths->hash_function = hash_function;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTable_put_hashed(HashTable *ths, KeyType new_key, ValueType new_value, unsigned long long new_hash)
+{
+    HashTableEl *el = HashTable_find_or_insert(ths, new_key, new_hash, NULL);
+
+    if (el == NULL)
+        return HASH_REALLOC_ERROR;
+
+    el->value = new_value;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* HASH_ERROR if there's no such key. get.asm reads bucket as array of its first size nodes,
+   so the last node of array is moved to place of removed one, and erased node is the first
+   free one for next insert */
+hash_error HashTable_remove(HashTable *ths, KeyType key)
+{
+    My_list<HashTableEl> *bucket = &(ths->buckets[ths->hash_function(key) % ths->capacity]);
+
+    HashTableEl *found = HashTable_bucket_find(bucket, key);
+    if (found == NULL)
+        return HASH_ERROR;
+
+    list_iterator last = {(long long)bucket->size - 1};
+    *found = bucket->data[last.it].value;
+
+    if (bucket->erase(last) != LIST_OK)
+        return HASH_ERROR;
+
+    ths->size--;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* One pass over bucket: returns element with such key or inserts new one with NULL value.
+   Table grows before insert, so returned element is already in its final bucket.
+   Pointer is valid until next insert to the table */
+HashTableEl* HashTable_find_or_insert(HashTable *ths, KeyType key, unsigned long long hash, bool *inserted)
+{
+    My_list<HashTableEl> *curr_bucket = &(ths->buckets[hash % ths->capacity]);
+
+    HashTableEl *found = HashTable_bucket_find(curr_bucket, key);
+    if (found != NULL)
     {
-        *value_ptr = new_value;
-        return HASH_OK;
+        if (inserted) *inserted = false;
+        return found;
+    }
+
+    if (((double)(ths->size + 1) / ths->capacity) > ths->max_load_factor)
+    {
+        if (HashTable_rehash(ths, ths->capacity * 2) != HASH_OK)
+            return NULL;
+
+        curr_bucket = &(ths->buckets[hash % ths->capacity]);
     }
+
+    HashTableEl new_el = {};
+    new_el.key   = key;
+    new_el.value = NULL;
+
+    list_iterator iter = curr_bucket->push_front(new_el);
+    if (iter.it == -1)
+        return NULL;
+
+    ths->size++;
+
+    if (inserted) *inserted = true;
+    return &((*curr_bucket)[iter]);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Nodes are walked directly like in get.asm, without iterator calls */
+HashTableEl* HashTable_bucket_find(My_list<HashTableEl> *bucket, KeyType key)
+{
+    Node<HashTableEl> *data = bucket->data;
+    long long curr_node = bucket->head;
+
+    for (size_t i = 0; i < bucket->size; i++, curr_node = data[curr_node].next)
+    {
+        if (!strcmp(key, data[curr_node].value.key))
+            return &(data[curr_node].value);
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Inserts value only if there's no such key. Returns pointer to value in table */
+ValueType* HashTable_emplace(HashTable *ths, KeyType key, ValueType value, bool *inserted)
+{
+    bool is_inserted = false;
+    HashTableEl *el = HashTable_find_or_insert(ths, key, ths->hash_function(key), &is_inserted);
+
+    if (el == NULL)
+        return NULL;
+
+    if (is_inserted)
+        el->value = value;
+
+    if (inserted) *inserted = is_inserted;
+    return &el->value;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Inserts value or replaces old one. Returns pointer to value in table */
+ValueType* HashTable_upsert(HashTable *ths, KeyType key, ValueType value, bool *inserted)
+{
+    HashTableEl *el = HashTable_find_or_insert(ths, key, ths->hash_function(key), inserted);
+
+    if (el == NULL)
+        return NULL;
+
+    el->value = value;
+    return &el->value;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Like emplace, but make_value is called only if key is absent */
+ValueType* HashTable_try_emplace(HashTable *ths, KeyType key, ValueMaker make_value, void *context, bool *inserted)
+{
+    bool is_inserted = false;
+    HashTableEl *el = HashTable_find_or_insert(ths, key, ths->hash_function(key), &is_inserted);
+
+    if (el == NULL)
+        return NULL;
+
+    if (is_inserted)
+        el->value = make_value(key, context);
+
+    if (inserted) *inserted = is_inserted;
+    return &el->value;
 }
 
 //-----------------------------------------------------------------------------
@@ -194,7 +713,105 @@ hash_error HashTable_destruct(HashTable *ths)
     for (size_t i = 0; i < ths->capacity; i++)
         ths->buckets[i].destruct();
     
-    free(ths->buckets);
+    HugeBlock_free(&ths->buckets_block);
+    HugeBlock_free(&ths->entries_block);
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTable_stats(HashTable *ths, HashTableStats *stats)
+{
+    *stats = {};
+
+    stats->size           = ths->size;
+    stats->capacity       = ths->capacity;
+    stats->load_factor    = (double)ths->size / ths->capacity;
+    stats->rehash_count   = ths->rehash_count;
+    stats->rehash_time_ns = ths->rehash_time_ns;
+
+    stats->bytes           = HashTable_bytes(ths);
+    stats->bytes_per_entry = (ths->size) ? (double)stats->bytes / ths->size : 0;
+
+    size_t probes_sum = 0;
+    for (size_t i = 0; i < ths->capacity; i++)
+    {
+        size_t chain = ths->buckets[i].get_size();
+
+        if (chain > stats->max_chain)
+            stats->max_chain = chain;
+
+        stats->chain_histogram[(chain < HASH_STATS_HISTOGRAM_SIZE) ? chain : HASH_STATS_HISTOGRAM_SIZE - 1]++;
+
+        /* Element on i-th place of chain is found after i + 1 compares */
+        probes_sum += chain * (chain + 1) / 2;
+    }
+
+    stats->expected_probes_hit  = (ths->size) ? (double)probes_sum / ths->size : 0;
+    stats->expected_probes_miss = stats->load_factor;
+
+#ifdef HASH_TABLE_STATS
+    stats->counters = ths->counters;
+
+    if (ths->counters.gets_hit)
+        stats->avg_probes_hit  = (double)ths->counters.probes_hit  / ths->counters.gets_hit;
+    if (ths->counters.gets_miss)
+        stats->avg_probes_miss = (double)ths->counters.probes_miss / ths->counters.gets_miss;
+#endif
 
     return HASH_OK;
 }
+
+//-----------------------------------------------------------------------------
+
+void HashTable_reset_counters(HashTable *ths)
+{
+#ifdef HASH_TABLE_STATS
+    ths->counters = {};
+#else
+    (void)ths;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+/* Prometheus text format, so it could be scraped from file or socket as is */
+void HashTable_dump_stats(HashTableStats *stats, FILE *file, const char *name)
+{
+    fprintf(file, "hash_table_size{table=\"%s\"} %zu\n",                 name, stats->size);
+    fprintf(file, "hash_table_capacity{table=\"%s\"} %zu\n",             name, stats->capacity);
+    fprintf(file, "hash_table_load_factor{table=\"%s\"} %f\n",           name, stats->load_factor);
+    fprintf(file, "hash_table_max_chain{table=\"%s\"} %zu\n",            name, stats->max_chain);
+
+    for (size_t i = 0; i < HASH_STATS_HISTOGRAM_SIZE; i++)
+        fprintf(file, "hash_table_chain_buckets{table=\"%s\",length=\"%zu%s\"} %zu\n",
+                name, i, (i == HASH_STATS_HISTOGRAM_SIZE - 1) ? "+" : "", stats->chain_histogram[i]);
+
+    fprintf(file, "hash_table_expected_probes_hit{table=\"%s\"} %f\n",   name, stats->expected_probes_hit);
+    fprintf(file, "hash_table_expected_probes_miss{table=\"%s\"} %f\n",  name, stats->expected_probes_miss);
+
+#ifdef HASH_TABLE_STATS
+    fprintf(file, "hash_table_gets_hit_total{table=\"%s\"} %llu\n",      name, stats->counters.gets_hit);
+    fprintf(file, "hash_table_gets_miss_total{table=\"%s\"} %llu\n",     name, stats->counters.gets_miss);
+    fprintf(file, "hash_table_avg_probes_hit{table=\"%s\"} %f\n",        name, stats->avg_probes_hit);
+    fprintf(file, "hash_table_avg_probes_miss{table=\"%s\"} %f\n",       name, stats->avg_probes_miss);
+#endif
+
+    fprintf(file, "hash_table_rehash_total{table=\"%s\"} %zu\n",         name, stats->rehash_count);
+    fprintf(file, "hash_table_rehash_seconds_total{table=\"%s\"} %f\n",  name, stats->rehash_time_ns / 1e9);
+    fprintf(file, "hash_table_bytes{table=\"%s\"} %zu\n",                name, stats->bytes);
+    fprintf(file, "hash_table_bytes_per_entry{table=\"%s\"} %f\n",       name, stats->bytes_per_entry);
+}
+
+//-----------------------------------------------------------------------------
+
+size_t HashTable_bytes(HashTable *ths)
+{
+    size_t bytes = ths->capacity * sizeof(My_list<HashTableEl>);
+
+    for (size_t i = 0; i < ths->capacity; i++)
+        bytes += ths->buckets[i].capacity * sizeof(Node<HashTableEl>);
+
+    return bytes;
+}
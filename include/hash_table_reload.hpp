@@ -0,0 +1,233 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Hot dictionary reload. Writer builds a whole new table from a dictionary file (usually in
+background thread) and publishes it with one atomic exchange. Readers never take a lock:
+they only announce the epoch they've entered in their own cache line. Old table is freed
+when there's no reader that entered before it was unpublished (epoch based reclamation).
+*/
+
+const size_t RELOAD_MAX_READERS = 64;
+const size_t RELOAD_MAX_RETIRED = 16;
+
+struct HashTableSnapshot
+{
+    HashTable   table;
+    char       *buffer;
+    DoubleWord *translates;
+    size_t      words_count;
+
+    unsigned long long retire_epoch;
+};
+
+struct alignas(64) ReloadReader
+{
+    /* 0 if reader is outside of critical section */
+    std::atomic<unsigned long long> epoch;
+};
+
+struct HashTableReloader
+{
+    std::atomic<HashTableSnapshot *> current;
+    std::atomic<unsigned long long>  global_epoch;
+    std::atomic<size_t>              readers_count;
+
+    ReloadReader readers[RELOAD_MAX_READERS];
+
+    /* Writers side only */
+    std::mutex          writer_lock;
+    HashTableSnapshot  *retired[RELOAD_MAX_RETIRED];
+    size_t              retired_count;
+    size_t              reloads_count;
+};
+
+//-----------------------------------------------------------------------------
+
+HashTableSnapshot* HashTableSnapshot_load(const char* dictionary_path);
+
+void HashTableSnapshot_free(HashTableSnapshot *snapshot);
+
+hash_error HashTableReloader_construct(HashTableReloader *ths, const char* dictionary_path);
+
+hash_error HashTableReloader_reload(HashTableReloader *ths, const char* dictionary_path);
+
+size_t HashTableReloader_collect(HashTableReloader *ths);
+
+size_t HashTableReloader_register(HashTableReloader *ths);
+
+HashTable* HashTableReloader_read_lock(HashTableReloader *ths, size_t reader);
+
+void HashTableReloader_read_unlock(HashTableReloader *ths, size_t reader);
+
+hash_error HashTableReloader_destruct(HashTableReloader *ths);
+
+//=============================================================================
+
+HashTableSnapshot* HashTableSnapshot_load(const char* dictionary_path)
+{
+    HashTableSnapshot *snapshot = (HashTableSnapshot *)calloc(1, sizeof(HashTableSnapshot));
+    if (snapshot == NULL)
+        return NULL;
+
+    size_t buffer_size = ReadDataBase(dictionary_path, &snapshot->buffer);
+    if (snapshot->buffer == NULL)
+    {
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->words_count = GetEolCount(snapshot->buffer, buffer_size);
+    snapshot->translates  = Parser(snapshot->buffer, snapshot->words_count, buffer_size);
+
+    if (HashTable_construct(&snapshot->table, snapshot->words_count / LoadFactor + 1) != HASH_OK)
+    {
+        free(snapshot->translates);
+        free(snapshot->buffer);
+        free(snapshot);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < snapshot->words_count; i++)
+        HashTable_put(&snapshot->table, snapshot->translates[i].primary_word, snapshot->translates[i].translated_word);
+
+    return snapshot;
+}
+
+//-----------------------------------------------------------------------------
+
+void HashTableSnapshot_free(HashTableSnapshot *snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    HashTable_destruct(&snapshot->table);
+    free(snapshot->translates);
+    free(snapshot->buffer);
+    free(snapshot);
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTableReloader_construct(HashTableReloader *ths, const char* dictionary_path)
+{
+    HashTableSnapshot *snapshot = HashTableSnapshot_load(dictionary_path);
+    if (snapshot == NULL)
+        return HASH_ERROR;
+
+    ths->current.store(snapshot);
+    ths->global_epoch.store(1);
+    ths->readers_count.store(0);
+
+    for (size_t i = 0; i < RELOAD_MAX_READERS; i++)
+        ths->readers[i].epoch.store(0);
+
+    ths->retired_count = 0;
+    ths->reloads_count = 0;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTableReloader_reload(HashTableReloader *ths, const char* dictionary_path)
+{
+    /* The heaviest part (reading, parsing, building) is done before taking writer lock */
+    HashTableSnapshot *snapshot = HashTableSnapshot_load(dictionary_path);
+    if (snapshot == NULL)
+        return HASH_ERROR;
+
+    std::lock_guard<std::mutex> guard(ths->writer_lock);
+
+    /* Wait for free place in retired list, readers are never waiting for it */
+    while (ths->retired_count == RELOAD_MAX_RETIRED && HashTableReloader_collect(ths) == 0)
+        std::this_thread::yield();
+
+    HashTableSnapshot *old_snapshot = ths->current.exchange(snapshot);
+
+    /* Every reader that could see old_snapshot has entered with epoch <= retire_epoch */
+    old_snapshot->retire_epoch = ths->global_epoch.fetch_add(1);
+    ths->retired[ths->retired_count++] = old_snapshot;
+    ths->reloads_count++;
+
+    HashTableReloader_collect(ths);
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Writer lock must be taken. Returns count of freed snapshots */
+size_t HashTableReloader_collect(HashTableReloader *ths)
+{
+    unsigned long long min_epoch = ths->global_epoch.load();
+    size_t readers_count = ths->readers_count.load();
+
+    for (size_t i = 0; i < readers_count; i++)
+    {
+        unsigned long long reader_epoch = ths->readers[i].epoch.load();
+        if (reader_epoch != 0 && reader_epoch < min_epoch)
+            min_epoch = reader_epoch;
+    }
+
+    size_t freed = 0;
+    for (size_t i = 0; i < ths->retired_count; )
+    {
+        if (ths->retired[i]->retire_epoch < min_epoch)
+        {
+            HashTableSnapshot_free(ths->retired[i]);
+            ths->retired[i] = ths->retired[--ths->retired_count];
+            freed++;
+        }
+        else
+            i++;
+    }
+
+    return freed;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t HashTableReloader_register(HashTableReloader *ths)
+{
+    size_t reader = ths->readers_count.fetch_add(1);
+    assert(reader < RELOAD_MAX_READERS);
+
+    return reader;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Table and values got from it are valid until read_unlock */
+HashTable* HashTableReloader_read_lock(HashTableReloader *ths, size_t reader)
+{
+    ths->readers[reader].epoch.store(ths->global_epoch.load(std::memory_order_acquire));
+
+    return &(ths->current.load()->table);
+}
+
+//-----------------------------------------------------------------------------
+
+void HashTableReloader_read_unlock(HashTableReloader *ths, size_t reader)
+{
+    ths->readers[reader].epoch.store(0, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+
+/* There mustn't be any readers */
+hash_error HashTableReloader_destruct(HashTableReloader *ths)
+{
+    for (size_t i = 0; i < ths->retired_count; i++)
+        HashTableSnapshot_free(ths->retired[i]);
+
+    ths->retired_count = 0;
+
+    HashTableSnapshot_free(ths->current.exchange(NULL));
+
+    return HASH_OK;
+}
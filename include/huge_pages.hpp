@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+/*
+Allocation of big arrays in 2MB pages, so random lookups miss dTLB less often.
+At first explicit huge pages (MAP_HUGETLB) are tried, they need reserved pages in
+/proc/sys/vm/nr_hugepages. Then transparent huge pages (madvise), then calloc.
+*/
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+typedef enum hash_alloc_policy_en
+{
+    HASH_ALLOC_DEFAULT    = 0,
+    HASH_ALLOC_HUGE_PAGES = 1
+} hash_alloc_policy;
+
+typedef enum huge_page_kind_en
+{
+    HUGE_PAGE_NONE    = 0,    /* calloc */
+    HUGE_PAGE_HUGETLB = 1,
+    HUGE_PAGE_THP     = 2
+} huge_page_kind;
+
+struct HugeBlock
+{
+    void          *ptr;
+    size_t         size;
+    huge_page_kind kind;
+};
+
+//-----------------------------------------------------------------------------
+
+/* Memory is zeroed like after calloc */
+HugeBlock HugeBlock_alloc(size_t size, hash_alloc_policy policy)
+{
+    HugeBlock block = {NULL, size, HUGE_PAGE_NONE};
+
+    if (policy == HASH_ALLOC_HUGE_PAGES && size != 0)
+    {
+        block.size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+        void *ptr = mmap(NULL, block.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            block.ptr  = ptr;
+            block.kind = HUGE_PAGE_HUGETLB;
+            return block;
+        }
+
+        /* One more huge page to align begin of block */
+        size_t mapped_size = block.size + HUGE_PAGE_SIZE;
+        ptr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            char *begin   = (char *)ptr;
+            char *aligned = (char *)(((size_t)begin + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+
+            if (aligned != begin)
+                munmap(begin, aligned - begin);
+            if (aligned + block.size != begin + mapped_size)
+                munmap(aligned + block.size, begin + mapped_size - (aligned + block.size));
+
+            madvise(aligned, block.size, MADV_HUGEPAGE);
+
+            block.ptr  = aligned;
+            block.kind = HUGE_PAGE_THP;
+            return block;
+        }
+
+        block.size = size;
+    }
+
+    block.ptr = calloc(size, 1);
+    return block;
+}
+
+//-----------------------------------------------------------------------------
+
+void HugeBlock_free(HugeBlock *block)
+{
+    if (block->ptr == NULL)
+        return;
+
+    if (block->kind == HUGE_PAGE_NONE)
+        free(block->ptr);
+    else
+        munmap(block->ptr, block->size);
+
+    block->ptr  = NULL;
+    block->size = 0;
+}
@@ -0,0 +1,330 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <nmmintrin.h>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Case and accent insensitive lookup: keys of table are stored folded and every asked key is folded
+the same way. Capital letters of ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic become small,
+letter followed by combining accent (NFD) becomes one precomposed letter (NFC), so "Café", "CAFÉ"
+and "Cafe" with U+0301 are the same key "café". Folded key is never longer than original one,
+so it's folded in place of dictionary buffer or query.
+KeyFold_hash folds and hashes key in one pass: 8 byte word without bytes >= 0x80 is folded
+as 8 lanes of one register (SWAR) and its crc32 is taken at once, so hash is HashingFunction
+of folded key. The first word with other bytes (or followed by word beginning with them)
+sends the rest of key to UTF-8 folding, then the rest of folded key is hashed.
+*/
+
+const uint64_t KEY_FOLD_ONES      = 0x0101010101010101ULL;
+const uint64_t KEY_FOLD_HIGH_BITS = 0x8080808080808080ULL;
+const uint32_t KEY_FOLD_INVALID   = 0xFFFFFFFF;
+
+struct KeyFoldComposition
+{
+    uint16_t base;                 /* small letter */
+    uint16_t mark;                 /* combining mark after it */
+    uint16_t composed;
+};
+
+const KeyFoldComposition KEY_FOLD_COMPOSITIONS[] = {
+    {'a', 0x300, 0xE0},  {'e', 0x300, 0xE8},  {'i', 0x300, 0xEC},  {'o', 0x300, 0xF2},  {'u', 0x300, 0xF9},
+    {'a', 0x301, 0xE1},  {'e', 0x301, 0xE9},  {'i', 0x301, 0xED},  {'o', 0x301, 0xF3},  {'u', 0x301, 0xFA},
+    {'y', 0x301, 0xFD},  {'c', 0x301, 0x107}, {'l', 0x301, 0x13A}, {'n', 0x301, 0x144}, {'r', 0x301, 0x155},
+    {'s', 0x301, 0x15B}, {'z', 0x301, 0x17A},
+    {'a', 0x302, 0xE2},  {'e', 0x302, 0xEA},  {'i', 0x302, 0xEE},  {'o', 0x302, 0xF4},  {'u', 0x302, 0xFB},
+    {'a', 0x303, 0xE3},  {'n', 0x303, 0xF1},  {'o', 0x303, 0xF5},
+    {'a', 0x308, 0xE4},  {'e', 0x308, 0xEB},  {'i', 0x308, 0xEF},  {'o', 0x308, 0xF6},  {'u', 0x308, 0xFC},
+    {'y', 0x308, 0xFF},  {0x435, 0x308, 0x451}, {0x438, 0x306, 0x439},
+    {'a', 0x30A, 0xE5},  {'u', 0x30A, 0x16F},
+    {'c', 0x30C, 0x10D}, {'e', 0x30C, 0x11B}, {'n', 0x30C, 0x148}, {'r', 0x30C, 0x159}, {'s', 0x30C, 0x161},
+    {'z', 0x30C, 0x17E},
+    {'c', 0x327, 0xE7},  {'z', 0x307, 0x17C}
+};
+
+//-----------------------------------------------------------------------------
+
+size_t KeyFold(const char *key, char *folded);
+
+unsigned long long KeyFold_hash(const char *key, char *folded, HashFunction hash_function = HashingFunction);
+
+ValueType* HashTable_get_folded(HashTable *ths, char *key);
+
+void KeyFold_translates(DoubleWord *translates, size_t words_count);
+
+//=============================================================================
+
+/* Capitals of ASCII word become small letters. Bytes are below 0x80, so adding
+   to one of them doesn't carry to the next one */
+inline uint64_t KeyFold_ascii_word(uint64_t word)
+{
+    uint64_t from_a  = word + KEY_FOLD_ONES * (0x80 - 'A');
+    uint64_t after_z = word + KEY_FOLD_ONES * (0x80 - 'Z' - 1);
+
+    return word | (((from_a & ~after_z) & KEY_FOLD_HIGH_BITS) >> 2);
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t KeyFold_lower(uint32_t code)
+{
+    if (code < 0x80)
+        return (code >= 'A' && code <= 'Z') ? code + ('a' - 'A') : code;
+
+    if (code >= 0xC0 && code <= 0xDE && code != 0xD7)
+        return code + 0x20;
+
+    /* Latin Extended-A: pairs of capital and small letter */
+    if ((code >= 0x100 && code <= 0x137) || (code >= 0x14A && code <= 0x177))
+        return code | 1;
+    if ((code >= 0x139 && code <= 0x148) || (code >= 0x179 && code <= 0x17E))
+        return (code & 1) ? code + 1 : code;
+
+    switch (code)
+    {
+        case 0x130: return 'i';
+        case 0x178: return 0xFF;
+        case 0x17F: return 's';
+        case 0x386: return 0x3AC;
+        case 0x38C: return 0x3CC;
+        case 0x3C2: return 0x3C3;          /* final sigma */
+        default:    break;
+    }
+
+    if (code >= 0x388 && code <= 0x38A)
+        return code + 0x25;
+    if (code == 0x38E || code == 0x38F)
+        return code + 0x3F;
+    if (code >= 0x391 && code <= 0x3AB && code != 0x3A2)
+        return code + 0x20;
+
+    if (code >= 0x400 && code <= 0x40F)
+        return code + 0x50;
+    if (code >= 0x410 && code <= 0x42F)
+        return code + 0x20;
+
+    return code;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Code point at text and its length in size, byte which doesn't begin valid
+   sequence is KEY_FOLD_INVALID of size 1. Zero byte ends any sequence */
+uint32_t KeyFold_decode(const unsigned char *text, size_t *size)
+{
+    *size = 1;
+
+    if (text[0] < 0x80)
+        return text[0];
+
+    size_t   length = 0;
+    uint32_t code   = 0;
+
+    if      ((text[0] & 0xE0) == 0xC0) { length = 2; code = text[0] & 0x1F; }
+    else if ((text[0] & 0xF0) == 0xE0) { length = 3; code = text[0] & 0x0F; }
+    else if ((text[0] & 0xF8) == 0xF0) { length = 4; code = text[0] & 0x07; }
+    else
+        return KEY_FOLD_INVALID;
+
+    for (size_t i = 1; i < length; i++)
+    {
+        if ((text[i] & 0xC0) != 0x80)
+            return KEY_FOLD_INVALID;
+
+        code = (code << 6) | (text[i] & 0x3F);
+    }
+
+    *size = length;
+    return code;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t KeyFold_encode(uint32_t code, unsigned char *text)
+{
+    if (code < 0x80)
+    {
+        text[0] = code;
+        return 1;
+    }
+
+    if (code < 0x800)
+    {
+        text[0] = 0xC0 | (code >> 6);
+        text[1] = 0x80 | (code & 0x3F);
+        return 2;
+    }
+
+    if (code < 0x10000)
+    {
+        text[0] = 0xE0 | (code >> 12);
+        text[1] = 0x80 | ((code >> 6) & 0x3F);
+        text[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+
+    text[0] = 0xF0 | (code >> 18);
+    text[1] = 0x80 | ((code >> 12) & 0x3F);
+    text[2] = 0x80 | ((code >> 6) & 0x3F);
+    text[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Precomposed letter or 0 */
+uint32_t KeyFold_compose(uint32_t base, uint32_t mark)
+{
+    if (mark < 0x300 || mark > 0x36F)
+        return 0;
+
+    for (size_t i = 0; i < sizeof(KEY_FOLD_COMPOSITIONS) / sizeof(KEY_FOLD_COMPOSITIONS[0]); i++)
+        if (KEY_FOLD_COMPOSITIONS[i].base == base && KEY_FOLD_COMPOSITIONS[i].mark == mark)
+            return KEY_FOLD_COMPOSITIONS[i].composed;
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Folds zero terminated text, returns length of result and length of text in text_length.
+   Every letter is written not further than it was read, so folded may be text itself */
+size_t KeyFold_utf8(const char *text, char *folded, size_t *text_length)
+{
+    const unsigned char *in  = (const unsigned char *)text;
+    unsigned char       *out = (unsigned char *)folded;
+
+    while (*in)
+    {
+        size_t size = 0;
+        uint32_t code = KeyFold_decode(in, &size);
+
+        if (code == KEY_FOLD_INVALID)
+        {
+            *out++ = *in++;
+            continue;
+        }
+
+        in  += size;
+        code = KeyFold_lower(code);
+
+        uint32_t composed = KeyFold_compose(code, KeyFold_decode(in, &size));
+        if (composed != 0)
+        {
+            code = composed;
+            in  += size;
+        }
+
+        out += KeyFold_encode(code, out);
+    }
+
+    *text_length = in - (const unsigned char *)text;
+    return out - (unsigned char *)folded;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Bytes after folded key are zeroed up to the end of padding of original key and the first byte
+   of the next word, like in dictionary where '=' is replaced by zero */
+void KeyFold_pad(char *folded, size_t length, size_t key_length)
+{
+    size_t padded = (key_length + 7) / 8 * 8;
+
+    memset(folded + length, 0, padded + 1 - length);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key must be padded like for HashingFunction, folded must have place for the same padding.
+   Returns length of folded key */
+size_t KeyFold(const char *key, char *folded)
+{
+    size_t key_length = 0;
+    size_t length     = KeyFold_utf8(key, folded, &key_length);
+
+    KeyFold_pad(folded, length, key_length);
+
+    return length;
+}
+
+//-----------------------------------------------------------------------------
+
+#ifndef SLOW
+
+/* HashingFunction(folded) which reads key once while it's ASCII. Word is folded alone only if
+   the next one begins with ASCII too: combining mark there would compose with its last letter */
+__attribute__((target("sse4.2")))
+unsigned long long KeyFold_hash_words(const char *key, char *folded)
+{
+    unsigned long long hash = 0;
+    size_t place = 0;
+
+    do
+    {
+        uint64_t word = HashWord(key + place);
+
+        if ((word & KEY_FOLD_HIGH_BITS) || (unsigned char)key[place + 8] >= 0x80)
+        {
+            size_t key_length = 0;
+            size_t length     = place + KeyFold_utf8(key + place, folded + place, &key_length);
+
+            KeyFold_pad(folded, length, place + key_length);
+
+            do
+            {
+                hash   = _mm_crc32_u64(hash, HashWord(folded + place));
+                place += 8;
+            } while (folded[place]);
+
+            return hash;
+        }
+
+        word = KeyFold_ascii_word(word);
+        memcpy(folded + place, &word, sizeof(word));
+
+        hash   = _mm_crc32_u64(hash, word);
+        place += 8;
+    } while (key[place]);
+
+    folded[place] = '\0';
+
+    return hash;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+/* Folds key to folded (may be key itself) and returns hash_function(folded),
+   one pass for HashingFunction */
+unsigned long long KeyFold_hash(const char *key, char *folded, HashFunction hash_function)
+{
+#ifndef SLOW
+    if (hash_function == HashingFunction)
+        return KeyFold_hash_words(key, folded);
+#endif
+
+    KeyFold(key, folded);
+
+    return hash_function(folded);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key is folded in place, table must be built from folded keys (KeyFold_translates) */
+ValueType* HashTable_get_folded(HashTable *ths, char *key)
+{
+    return HashTable_get_hashed(ths, key, KeyFold_hash(key, key, ths->hash_function));
+}
+
+//-----------------------------------------------------------------------------
+
+/* Words are folded in place of dictionary buffer, words which become equal are one key,
+   and the last value is kept like in HashTable_put */
+void KeyFold_translates(DoubleWord *translates, size_t words_count)
+{
+    for (size_t i = 0; i < words_count; i++)
+        KeyFold(translates[i].primary_word, (char *)translates[i].primary_word);
+}
@@ -0,0 +1,256 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <thread>
+#include <csignal>
+#include <pthread.h>
+
+/*
+Latency histograms of table operations, like HdrHistogram: every power of two of nanoseconds
+is split to 32 linear sub buckets, so error of value is not more than 1/32.
+Every thread records to its own histograms (relaxed stores without lock prefix), they are merged
+only when dumped. Histograms of finished threads are kept, so they are in the dump too.
+*/
+
+typedef enum latency_op_en
+{
+    LATENCY_GET_HIT  = 0,
+    LATENCY_GET_MISS = 1,
+    LATENCY_PUT      = 2,
+    LATENCY_REHASH   = 3,
+    LATENCY_OPS_COUNT
+} latency_op;
+
+const char *LATENCY_OP_NAMES[LATENCY_OPS_COUNT] = {"get_hit", "get_miss", "put", "rehash"};
+
+const size_t LATENCY_SUB_BITS      = 5;
+const size_t LATENCY_SUB_COUNT     = 1 << LATENCY_SUB_BITS;
+const size_t LATENCY_BUCKETS_COUNT = (64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT;
+
+const double LATENCY_PERCENTILES[] = {50, 90, 99, 99.9};
+
+struct LatencyHistogram
+{
+    std::atomic<unsigned long long> counts[LATENCY_BUCKETS_COUNT];
+    std::atomic<unsigned long long> total;
+    std::atomic<unsigned long long> max;
+};
+
+struct LatencyRecorder
+{
+    LatencyHistogram histograms[LATENCY_OPS_COUNT];
+    LatencyRecorder *next;
+};
+
+/* All recorders ever made, new ones are pushed to head */
+std::atomic<LatencyRecorder *> LatencyRecorders(NULL);
+
+thread_local LatencyRecorder *LatencyLocal = NULL;
+
+//-----------------------------------------------------------------------------
+
+unsigned long long LatencyNow();
+
+void Latency_record(latency_op op, unsigned long long ns);
+
+void Latency_merge(LatencyHistogram *result, latency_op op);
+
+unsigned long long LatencyHistogram_percentile(LatencyHistogram *ths, double percentile);
+
+void Latency_dump(FILE *file);
+
+void Latency_reset();
+
+void Latency_dump_on_signal(int signum);
+
+//=============================================================================
+
+unsigned long long LatencyNow()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+
+inline size_t LatencyIndex(unsigned long long ns)
+{
+    if (ns < LATENCY_SUB_COUNT)
+        return ns;
+
+    size_t exponent = 63 - __builtin_clzll(ns);
+    size_t top      = ns >> (exponent - LATENCY_SUB_BITS);
+
+    return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT + top - LATENCY_SUB_COUNT;
+}
+
+//-----------------------------------------------------------------------------
+
+/* The largest value of bucket */
+unsigned long long LatencyValue(size_t index)
+{
+    if (index < LATENCY_SUB_COUNT)
+        return index;
+
+    size_t exponent = index / LATENCY_SUB_COUNT + LATENCY_SUB_BITS - 1;
+    unsigned long long top = index % LATENCY_SUB_COUNT + LATENCY_SUB_COUNT;
+
+    return ((top + 1) << (exponent - LATENCY_SUB_BITS)) - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+LatencyRecorder* Latency_local()
+{
+    if (LatencyLocal != NULL)
+        return LatencyLocal;
+
+    LatencyLocal = new LatencyRecorder();
+
+    LatencyRecorder *head = LatencyRecorders.load();
+    do
+        LatencyLocal->next = head;
+    while (!LatencyRecorders.compare_exchange_weak(head, LatencyLocal));
+
+    return LatencyLocal;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Only this thread writes its histograms, so load and store are enough */
+inline void LatencyCounter_add(std::atomic<unsigned long long> *counter, unsigned long long value)
+{
+    counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+void Latency_record(latency_op op, unsigned long long ns)
+{
+    LatencyHistogram *histogram = &Latency_local()->histograms[op];
+
+    LatencyCounter_add(&histogram->counts[LatencyIndex(ns)], 1);
+    LatencyCounter_add(&histogram->total, 1);
+
+    if (ns > histogram->max.load(std::memory_order_relaxed))
+        histogram->max.store(ns, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+/* result must be zeroed */
+void Latency_merge(LatencyHistogram *result, latency_op op)
+{
+    for (LatencyRecorder *recorder = LatencyRecorders.load(); recorder != NULL; recorder = recorder->next)
+    {
+        LatencyHistogram *histogram = &recorder->histograms[op];
+
+        for (size_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+            LatencyCounter_add(&result->counts[i], histogram->counts[i].load(std::memory_order_relaxed));
+
+        LatencyCounter_add(&result->total, histogram->total.load(std::memory_order_relaxed));
+
+        if (histogram->max.load(std::memory_order_relaxed) > result->max.load(std::memory_order_relaxed))
+            result->max.store(histogram->max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long long LatencyHistogram_percentile(LatencyHistogram *ths, double percentile)
+{
+    unsigned long long total = ths->total.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    unsigned long long rank = (unsigned long long)(percentile / 100 * total + 0.5);
+    if (rank == 0) rank = 1;
+
+    unsigned long long passed = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+    {
+        passed += ths->counts[i].load(std::memory_order_relaxed);
+
+        if (passed >= rank)
+        {
+            unsigned long long value = LatencyValue(i);
+            unsigned long long max   = ths->max.load(std::memory_order_relaxed);
+
+            return (value < max) ? value : max;
+        }
+    }
+
+    return ths->max.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+
+void Latency_dump(FILE *file)
+{
+    LatencyHistogram *histogram = new LatencyHistogram();
+
+    for (int op = 0; op < LATENCY_OPS_COUNT; op++)
+    {
+        for (size_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+            histogram->counts[i].store(0, std::memory_order_relaxed);
+        histogram->total.store(0, std::memory_order_relaxed);
+        histogram->max.store(0, std::memory_order_relaxed);
+
+        Latency_merge(histogram, (latency_op)op);
+
+        fprintf(file, "%-9s count %10llu", LATENCY_OP_NAMES[op], histogram->total.load(std::memory_order_relaxed));
+
+        for (size_t i = 0; i < sizeof(LATENCY_PERCENTILES) / sizeof(LATENCY_PERCENTILES[0]); i++)
+            fprintf(file, "  p%g %8llu", LATENCY_PERCENTILES[i], LatencyHistogram_percentile(histogram, LATENCY_PERCENTILES[i]));
+
+        fprintf(file, "  max %10llu ns\n", histogram->max.load(std::memory_order_relaxed));
+    }
+
+    fflush(file);
+    delete histogram;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Not exact if other threads record at the same time */
+void Latency_reset()
+{
+    for (LatencyRecorder *recorder = LatencyRecorders.load(); recorder != NULL; recorder = recorder->next)
+    for (int op = 0; op < LATENCY_OPS_COUNT; op++)
+    {
+        for (size_t i = 0; i < LATENCY_BUCKETS_COUNT; i++)
+            recorder->histograms[op].counts[i].store(0, std::memory_order_relaxed);
+
+        recorder->histograms[op].total.store(0, std::memory_order_relaxed);
+        recorder->histograms[op].max.store(0, std::memory_order_relaxed);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Latency_signal_loop(sigset_t signals)
+{
+    int signum = 0;
+
+    while (sigwait(&signals, &signum) == 0)
+        Latency_dump(stderr);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Dump goes to stderr from separate thread (printf isn't safe in handler). Call it before
+   other threads are started: signal is blocked in this thread and in threads started after */
+void Latency_dump_on_signal(int signum)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, signum);
+
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    std::thread(Latency_signal_loop, signals).detach();
+}
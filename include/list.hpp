@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 #include "list.hpp"
     
 //#define DEBUG_MODE
@@ -45,6 +46,7 @@ struct My_list
 
     long long free;              
     char boost_mode;
+    char external_data;          /* data isn't owned by list (placed by pack) */
 
     long long head;
 
@@ -56,6 +58,8 @@ struct My_list
 
     list_error shrink_to_fit();
 
+    list_error pack(Node<T> *storage);
+
     list_iterator push_back(const T &x);
 
     list_iterator push_front(const T &x);
@@ -227,11 +231,23 @@ list_error My_list<T>::resize(size_t new_cap)
        (boost_mode == true  && new_cap <  size))
         return LIST_ERROR; 
     
-    Node<T> *new_data = (Node<T> *)realloc(data, new_cap * sizeof(Node<T>));
+    Node<T> *new_data = NULL;
+
+    if (external_data)
+    {
+        /* Storage given to pack can't be reallocated, so list gets its own memory */
+        new_data = (Node<T> *)malloc(new_cap * sizeof(Node<T>));
+        if (new_data != NULL)
+            memcpy(new_data, data, capacity * sizeof(Node<T>));
+    }
+    else
+        new_data = (Node<T> *)realloc(data, new_cap * sizeof(Node<T>));
     
     if (new_data == NULL)
         return LIST_WRONG_REALLOC;
     
+    external_data = 0;
+    
     data = new_data;
     
     if (new_cap == size)
@@ -389,6 +405,7 @@ list_error My_list<T>::construct(size_t new_capacity, const T& new_default_el)
     capacity = new_capacity;
     size = 0;
     boost_mode = 0;
+    external_data = 0;
     default_el = new_default_el;
     
     //return verify();
@@ -401,12 +418,14 @@ list_error My_list<T>::destruct()
     //if (verify() != LIST_OK)
     //    return LIST_ERROR;
     
-    std::free(data);
+    if (!external_data)
+        std::free(data);
     capacity = 0;
     size =  0;
     head = -1;
     free = -1;
     boost_mode =  0;
+    external_data = 0;
     
     return LIST_OK;
 }
@@ -440,16 +459,48 @@ list_error My_list<T>::boost()
         curr_node = data[curr_node].next;
     }
     
-    std::free(data);
+    if (!external_data)
+        std::free(data);
     data = new_data;
     capacity = size;
     free = -1;
     head = 0;
     boost_mode = 1;
+    external_data = 0;
         
     return LIST_OK;
 }
 
+template <typename T>
+list_error My_list<T>::pack(Node<T> *storage)
+{
+    //if (verify() != LIST_OK)
+    //    return LIST_ERROR;
+    
+    if (size == 0)
+        return LIST_ERROR;
+    
+    long long curr_node = head;
+    for (int i = 0; i < size; i++)
+    {
+        storage[i].value = data[curr_node].value;
+        storage[i].next = (i + 1) % size;
+        storage[i].prev = (i - 1 + size) % size;
+        curr_node = data[curr_node].next;
+    }
+    
+    if (!external_data)
+        std::free(data);
+    data = storage;
+    capacity = size;
+    free = -1;
+    head = 0;
+    boost_mode = 1;
+    external_data = 1;
+    
+    return LIST_OK;
+}
+
 template <typename T>
 list_error My_list<T>::shrink_to_fit()
 {    
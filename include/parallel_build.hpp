@@ -0,0 +1,263 @@
+#pragma once
+#include <thread>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Building of table from parsed dictionary in several threads.
+Buckets are split to contiguous partitions, one per thread. At first every thread hashes
+its slice of words and counts them per partition, then puts indices of words to staging
+array, where words of every partition lie together and in input order. At last every thread
+fills its own partition, so no locks are needed and every bucket sees the same sequence
+of puts as in HashTable_build. That's why both tables are equal up to addresses of nodes.
+*/
+
+struct ParallelBuild
+{
+    HashTable  *table;
+    DoubleWord *translates;
+    size_t      words_count;
+    size_t      threads_count;
+
+    unsigned long long *hashes;   /* hash of every word */
+    size_t *counts;               /* [thread][partition], then offsets in staging */
+    size_t *staging;              /* indices of words grouped by partition */
+    size_t *partition_begin;      /* [partition], one more for end of last partition */
+    size_t *inserted;             /* [partition] */
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTable_build(HashTable *ths, DoubleWord *translates, size_t words_count,
+                           hash_alloc_policy policy = HASH_ALLOC_DEFAULT);
+
+hash_error HashTable_build_parallel(HashTable *ths, DoubleWord *translates, size_t words_count,
+                                    size_t threads_count, hash_alloc_policy policy = HASH_ALLOC_DEFAULT);
+
+bool HashTable_equal(HashTable *first, HashTable *second);
+
+void HashTranslates(HashFunction hash_function, const DoubleWord *translates, size_t count, unsigned long long *hashes);
+
+//=============================================================================
+
+/* Capacity is chosen so that nothing is rehashed while words are put */
+size_t HashTable_build_capacity(size_t words_count)
+{
+    return words_count / LoadFactor + 1;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Reference sequential build */
+hash_error HashTable_build(HashTable *ths, DoubleWord *translates, size_t words_count, hash_alloc_policy policy)
+{
+    if (HashTable_construct(ths, HashTable_build_capacity(words_count), policy) != HASH_OK)
+        return HASH_REALLOC_ERROR;
+
+    unsigned long long hashes[HASH_BATCH_MAX];
+
+    for (size_t batch = 0; batch < words_count; batch += HASH_BATCH_MAX)
+    {
+        size_t batch_size = (words_count - batch < HASH_BATCH_MAX) ? words_count - batch : HASH_BATCH_MAX;
+        HashTranslates(ths->hash_function, translates + batch, batch_size, hashes);
+
+        for (size_t i = 0; i < batch_size; i++)
+            if (HashTable_put_hashed(ths, translates[batch + i].primary_word, translates[batch + i].translated_word,
+                                     hashes[i]) != HASH_OK)
+                return HASH_REALLOC_ERROR;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* hashes[i] = hash_function(translates[i].primary_word), keys go to HashFunction_batch by HASH_BATCH_MAX */
+void HashTranslates(HashFunction hash_function, const DoubleWord *translates, size_t count, unsigned long long *hashes)
+{
+    KeyType keys[HASH_BATCH_MAX];
+
+    for (size_t batch = 0; batch < count; batch += HASH_BATCH_MAX)
+    {
+        size_t batch_size = (count - batch < HASH_BATCH_MAX) ? count - batch : HASH_BATCH_MAX;
+
+        for (size_t i = 0; i < batch_size; i++)
+            keys[i] = translates[batch + i].primary_word;
+
+        HashFunction_batch(hash_function, keys, batch_size, hashes + batch);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ParallelBuild_partition(ParallelBuild *ths, unsigned long long hash)
+{
+    return (hash % ths->table->capacity) * ths->threads_count / ths->table->capacity;
+}
+
+//-----------------------------------------------------------------------------
+
+void ParallelBuild_hash(ParallelBuild *ths, size_t thread)
+{
+    size_t *counts = ths->counts + thread * ths->threads_count;
+    size_t  from   = ths->words_count * thread / ths->threads_count;
+    size_t  to     = ths->words_count * (thread + 1) / ths->threads_count;
+
+    HashTranslates(ths->table->hash_function, ths->translates + from, to - from, ths->hashes + from);
+
+    for (size_t i = from; i < to; i++)
+        counts[ParallelBuild_partition(ths, ths->hashes[i])]++;
+}
+
+//-----------------------------------------------------------------------------
+
+void ParallelBuild_scatter(ParallelBuild *ths, size_t thread)
+{
+    size_t *offsets = ths->counts + thread * ths->threads_count;
+    size_t  from    = ths->words_count * thread / ths->threads_count;
+    size_t  to      = ths->words_count * (thread + 1) / ths->threads_count;
+
+    for (size_t i = from; i < to; i++)
+        ths->staging[offsets[ParallelBuild_partition(ths, ths->hashes[i])]++] = i;
+}
+
+//-----------------------------------------------------------------------------
+
+void ParallelBuild_fill(ParallelBuild *ths, size_t partition)
+{
+    HashTable *table = ths->table;
+
+    /* First bucket of partition p is ceil(p * capacity / threads_count) */
+    size_t bucket_from = (partition * table->capacity + ths->threads_count - 1) / ths->threads_count;
+    size_t bucket_to   = ((partition + 1) * table->capacity + ths->threads_count - 1) / ths->threads_count;
+
+    HashTable_construct_buckets(table, bucket_from, bucket_to);
+
+    for (size_t i = ths->partition_begin[partition]; i < ths->partition_begin[partition + 1]; i++)
+    {
+        DoubleWord *word = &ths->translates[ths->staging[i]];
+        My_list<HashTableEl> *curr_bucket = &table->buckets[ths->hashes[ths->staging[i]] % table->capacity];
+
+        HashTableEl *found = HashTable_bucket_find(curr_bucket, word->primary_word);
+        if (found != NULL)
+        {
+            found->value = word->translated_word;
+            continue;
+        }
+
+        HashTableEl new_el = {};
+        new_el.key   = word->primary_word;
+        new_el.value = word->translated_word;
+
+        curr_bucket->push_front(new_el);
+        ths->inserted[partition]++;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Runs one step of build in every thread and waits for all of them */
+void ParallelBuild_run(ParallelBuild *ths, void (*step)(ParallelBuild *, size_t))
+{
+    std::thread *threads = new std::thread[ths->threads_count];
+
+    for (size_t i = 0; i < ths->threads_count; i++)
+        threads[i] = std::thread(step, ths, i);
+
+    for (size_t i = 0; i < ths->threads_count; i++)
+        threads[i].join();
+
+    delete[] threads;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error HashTable_build_parallel(HashTable *ths, DoubleWord *translates, size_t words_count,
+                                    size_t threads_count, hash_alloc_policy policy)
+{
+    if (threads_count == 0)
+        threads_count = 1;
+
+    if (HashTable_allocate(ths, HashTable_build_capacity(words_count), policy) != HASH_OK)
+        return HASH_REALLOC_ERROR;
+
+    ParallelBuild build = {};
+    build.table           = ths;
+    build.translates      = translates;
+    build.words_count     = words_count;
+    build.threads_count   = threads_count;
+    build.hashes          = (unsigned long long *)calloc(words_count + 1, sizeof(unsigned long long));
+    build.counts          = (size_t *)calloc(threads_count * threads_count, sizeof(size_t));
+    build.staging         = (size_t *)calloc(words_count + 1, sizeof(size_t));
+    build.partition_begin = (size_t *)calloc(threads_count + 1, sizeof(size_t));
+    build.inserted        = (size_t *)calloc(threads_count, sizeof(size_t));
+
+    hash_error error = HASH_OK;
+
+    if (build.hashes == NULL || build.counts == NULL || build.staging == NULL ||
+        build.partition_begin == NULL || build.inserted == NULL)
+    {
+        HashTable_construct_buckets(ths, 0, ths->capacity);
+        error = HASH_REALLOC_ERROR;
+    }
+    else
+    {
+        ParallelBuild_run(&build, ParallelBuild_hash);
+
+        /* Counts become offsets: partitions one by one, inside partition threads in order of slices */
+        size_t offset = 0;
+        for (size_t partition = 0; partition < threads_count; partition++)
+        {
+            build.partition_begin[partition] = offset;
+
+            for (size_t thread = 0; thread < threads_count; thread++)
+            {
+                size_t count = build.counts[thread * threads_count + partition];
+                build.counts[thread * threads_count + partition] = offset;
+                offset += count;
+            }
+        }
+        build.partition_begin[threads_count] = offset;
+
+        ParallelBuild_run(&build, ParallelBuild_scatter);
+        ParallelBuild_run(&build, ParallelBuild_fill);
+
+        for (size_t i = 0; i < threads_count; i++)
+            ths->size += build.inserted[i];
+    }
+
+    free(build.hashes);
+    free(build.counts);
+    free(build.staging);
+    free(build.partition_begin);
+    free(build.inserted);
+
+    return error;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Tables are equal if all buckets have the same nodes in the same places */
+bool HashTable_equal(HashTable *first, HashTable *second)
+{
+    if (first->capacity != second->capacity || first->size != second->size ||
+        first->hash_function != second->hash_function)
+        return false;
+
+    for (size_t i = 0; i < first->capacity; i++)
+    {
+        My_list<HashTableEl> *first_bucket  = &first->buckets[i];
+        My_list<HashTableEl> *second_bucket = &second->buckets[i];
+
+        if (first_bucket->size     != second_bucket->size     ||
+            first_bucket->capacity != second_bucket->capacity ||
+            first_bucket->head     != second_bucket->head     ||
+            first_bucket->free     != second_bucket->free)
+            return false;
+
+        if (memcmp(first_bucket->data, second_bucket->data, first_bucket->capacity * sizeof(Node<HashTableEl>)))
+            return false;
+    }
+
+    return true;
+}
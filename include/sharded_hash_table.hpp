@@ -0,0 +1,132 @@
+#pragma once
+#include <shared_mutex>
+#include <mutex>
+#include <new>
+#include "hash_table.hpp"
+
+/*
+Hash table split to independent shards. Key is hashed once: high bits of hash choose shard,
+the same hash gives bucket inside shard. Every shard has its own lock and grows on its own,
+so writers to different shards don't wait for each other and rehash stops only 1/N of keys.
+*/
+
+struct alignas(64) HashTableShard
+{
+    std::shared_mutex lock;
+    HashTable table;
+};
+
+struct ShardedHashTable
+{
+    size_t shards_count;
+    HashTableShard *shards;
+    HashFunction hash_function;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error ShardedHashTable_construct(ShardedHashTable *ths, size_t shards_count, size_t capacity,
+                                      HashFunction hash_function = HashingFunction);
+
+size_t ShardedHashTable_route(ShardedHashTable *ths, unsigned long long hash);
+
+hash_error ShardedHashTable_put(ShardedHashTable *ths, KeyType key, ValueType value);
+
+bool ShardedHashTable_get(ShardedHashTable *ths, KeyType key, ValueType *value);
+
+size_t ShardedHashTable_size(ShardedHashTable *ths);
+
+hash_error ShardedHashTable_destruct(ShardedHashTable *ths);
+
+//=============================================================================
+
+hash_error ShardedHashTable_construct(ShardedHashTable *ths, size_t shards_count, size_t capacity,
+                                      HashFunction hash_function)
+{
+    ths->shards_count  = (shards_count == 0) ? 1 : shards_count;
+    ths->hash_function = hash_function;
+    ths->shards        = new (std::nothrow) HashTableShard[ths->shards_count];
+
+    if (ths->shards == NULL)
+        return HASH_REALLOC_ERROR;
+
+    for (size_t i = 0; i < ths->shards_count; i++)
+    {
+        if (HashTable_construct(&ths->shards[i].table, capacity / ths->shards_count + 1) != HASH_OK)
+            return HASH_REALLOC_ERROR;
+
+        HashTable_set_hash(&ths->shards[i].table, hash_function);
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* crc32 gives 32 bits and djb2 64 ones, so both halves are folded before taking high bits */
+size_t ShardedHashTable_route(ShardedHashTable *ths, unsigned long long hash)
+{
+    unsigned long long folded = (hash ^ (hash >> 32)) & 0xFFFFFFFF;
+
+    return (folded * ths->shards_count) >> 32;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error ShardedHashTable_put(ShardedHashTable *ths, KeyType key, ValueType value)
+{
+    unsigned long long hash = ths->hash_function(key);
+    HashTableShard *shard = &ths->shards[ShardedHashTable_route(ths, hash)];
+
+    std::unique_lock<std::shared_mutex> guard(shard->lock);
+
+    return HashTable_put_hashed(&shard->table, key, value, hash);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Value is copied out, because shard may be rehashed right after unlock */
+bool ShardedHashTable_get(ShardedHashTable *ths, KeyType key, ValueType *value)
+{
+    unsigned long long hash = ths->hash_function(key);
+    HashTableShard *shard = &ths->shards[ShardedHashTable_route(ths, hash)];
+
+    std::shared_lock<std::shared_mutex> guard(shard->lock);
+
+    ValueType *value_ptr = HashTable_get_hashed(&shard->table, key, hash);
+    if (value_ptr == NULL)
+        return false;
+
+    *value = *value_ptr;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ShardedHashTable_size(ShardedHashTable *ths)
+{
+    size_t size = 0;
+
+    for (size_t i = 0; i < ths->shards_count; i++)
+    {
+        std::shared_lock<std::shared_mutex> guard(ths->shards[i].lock);
+        size += ths->shards[i].table.size;
+    }
+
+    return size;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error ShardedHashTable_destruct(ShardedHashTable *ths)
+{
+    for (size_t i = 0; i < ths->shards_count; i++)
+        HashTable_destruct(&ths->shards[i].table);
+
+    delete[] ths->shards;
+
+    ths->shards       = NULL;
+    ths->shards_count = 0;
+
+    return HASH_OK;
+}
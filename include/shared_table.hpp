@@ -0,0 +1,327 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash_table.hpp"
+#include "compact_table.hpp"
+
+/*
+Table shared by many processes through POSIX shared memory instead of one private table per process.
+Builder stores image of CompactTable (see CompactTable_image_store) to segment name.N, image has only
+offsets inside, so every process maps it at any address and reads it as it is, pages are in memory
+once for all of them. Small control segment name keeps number N of the current image.
+Readers map both segments read only. Publishing of new image is a swap: new segment is filled
+completely, then number in control segment is changed atomically and old segment is unlinked.
+Reader which still maps old image reads it until SharedTable_refresh, pages are freed after the last
+munmap. So reader never sees half of image and needs no lock. Only one builder may publish at a time.
+Segments are named (not memfd) so workers attach by name whether they were forked from builder or not.
+*/
+
+const uint32_t SHARED_TABLE_MAGIC    = 0x52414853;      /* "SHAR" */
+const uint32_t SHARED_TABLE_VERSION  = 1;
+const size_t   SHARED_TABLE_NAME_MAX = 256;
+const size_t   SHARED_TABLE_TRIES    = 16;              /* image may be swapped while reader opens it */
+const mode_t   SHARED_TABLE_MODE     = 0644;
+
+struct SharedControl
+{
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> generation;                   /* number of current image, 0 before the first one */
+};
+
+struct SharedTable
+{
+    char name[SHARED_TABLE_NAME_MAX];
+    const SharedControl *control;
+
+    uint64_t generation;           /* of mapped image */
+    const char *image;
+    size_t image_size;
+    CompactTable table;            /* points into image */
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error SharedTable_publish(const char *name, CompactTable *table, uint64_t *generation = NULL);
+
+hash_error SharedTable_attach(SharedTable *ths, const char *name, HashFunction hash_function = HashingFunction);
+
+hash_error SharedTable_refresh(SharedTable *ths);
+
+const char* SharedTable_get(SharedTable *ths, KeyType key);
+
+hash_error SharedTable_detach(SharedTable *ths);
+
+hash_error SharedTable_unlink(const char *name);
+
+//=============================================================================
+
+/* Name of segment with image number generation */
+bool SharedTable_segment_name(const char *name, uint64_t generation, char *segment_name)
+{
+    int length = snprintf(segment_name, SHARED_TABLE_NAME_MAX, "%s.%llu", name, (unsigned long long)generation);
+
+    return length > 0 && (size_t)length < SHARED_TABLE_NAME_MAX;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Control segment is made by the first builder, zeroed memory is generation 0 */
+SharedControl* SharedControl_open(const char *name)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, SHARED_TABLE_MODE);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || ((size_t)info.st_size < sizeof(SharedControl) &&
+                                  ftruncate(fd, sizeof(SharedControl)) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *mapped = mmap(NULL, sizeof(SharedControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    SharedControl *control = (SharedControl *)mapped;
+
+    if (control->magic == 0)
+    {
+        control->version = SHARED_TABLE_VERSION;
+        control->magic   = SHARED_TABLE_MAGIC;
+    }
+
+    if (control->magic != SHARED_TABLE_MAGIC || control->version != SHARED_TABLE_VERSION)
+    {
+        munmap(mapped, sizeof(SharedControl));
+        return NULL;
+    }
+
+    return control;
+}
+
+//-----------------------------------------------------------------------------
+
+/* New segment gets image of table, then it becomes current one and the old one is unlinked */
+hash_error SharedTable_publish(const char *name, CompactTable *table, uint64_t *generation)
+{
+    SharedControl *control = SharedControl_open(name);
+    if (control == NULL)
+        return HASH_ERROR;
+
+    uint64_t next = control->generation.load() + 1;
+
+    char segment_name[SHARED_TABLE_NAME_MAX] = {};
+    if (!SharedTable_segment_name(name, next, segment_name))
+    {
+        munmap(control, sizeof(SharedControl));
+        return HASH_ERROR;
+    }
+
+    /* Left by builder which died before swap */
+    shm_unlink(segment_name);
+
+    int fd = shm_open(segment_name, O_RDWR | O_CREAT | O_EXCL, SHARED_TABLE_MODE);
+    if (fd < 0)
+    {
+        munmap(control, sizeof(SharedControl));
+        return HASH_ERROR;
+    }
+
+    size_t image_size = CompactTable_image_bytes(table);
+    void  *image      = MAP_FAILED;
+
+    if (ftruncate(fd, image_size) == 0)
+        image = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+    {
+        shm_unlink(segment_name);
+        munmap(control, sizeof(SharedControl));
+        return HASH_REALLOC_ERROR;
+    }
+
+    CompactTable_image_store(table, (char *)image);
+    munmap(image, image_size);
+
+    uint64_t previous = control->generation.exchange(next);
+    munmap(control, sizeof(SharedControl));
+
+    if (previous != 0 && SharedTable_segment_name(name, previous, segment_name))
+        shm_unlink(segment_name);
+
+    if (generation != NULL)
+        *generation = next;
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* HASH_ERROR if nothing is published by this name */
+hash_error SharedTable_attach(SharedTable *ths, const char *name, HashFunction hash_function)
+{
+    *ths = {};
+    ths->table.hash_function = hash_function;
+
+    if (strlen(name) >= SHARED_TABLE_NAME_MAX)
+        return HASH_ERROR;
+
+    strcpy(ths->name, name);
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return HASH_ERROR;
+
+    struct stat info = {};
+    void *mapped = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedControl))
+        mapped = mmap(NULL, sizeof(SharedControl), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return HASH_ERROR;
+
+    ths->control = (const SharedControl *)mapped;
+
+    if (ths->control->magic != SHARED_TABLE_MAGIC || ths->control->version != SHARED_TABLE_VERSION ||
+        SharedTable_refresh(ths) != HASH_OK)
+    {
+        SharedTable_detach(ths);
+        return HASH_ERROR;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Maps current image if it isn't mapped yet. Old image is unmapped, so values got from it
+   mustn't be used after refresh which changed generation */
+hash_error SharedTable_refresh(SharedTable *ths)
+{
+    for (size_t i = 0; i < SHARED_TABLE_TRIES; i++)
+    {
+        uint64_t generation = ths->control->generation.load(std::memory_order_acquire);
+
+        /* Nothing is published yet */
+        if (generation == 0 && ths->image == NULL)
+            return HASH_ERROR;
+
+        if (generation == ths->generation)
+            return HASH_OK;
+
+        char segment_name[SHARED_TABLE_NAME_MAX] = {};
+        if (generation == 0 || !SharedTable_segment_name(ths->name, generation, segment_name))
+            return HASH_ERROR;
+
+        /* Segment is unlinked when the next one is published, then number is read again */
+        int fd = shm_open(segment_name, O_RDONLY, 0);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                continue;
+
+            return HASH_ERROR;
+        }
+
+        struct stat info = {};
+        void *image = MAP_FAILED;
+
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            image = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (image == MAP_FAILED)
+            return HASH_ERROR;
+
+        CompactTable table = {};
+        if (CompactTable_image_view(&table, (const char *)image, info.st_size, ths->table.hash_function) != HASH_OK)
+        {
+            munmap(image, info.st_size);
+            return HASH_ERROR;
+        }
+
+        if (ths->image != NULL)
+            munmap((void *)ths->image, ths->image_size);
+
+        ths->generation = generation;
+        ths->image      = (const char *)image;
+        ths->image_size = info.st_size;
+        ths->table      = table;
+
+        return HASH_OK;
+    }
+
+    return HASH_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Value in mapped image or NULL, like CompactTable_get */
+const char* SharedTable_get(SharedTable *ths, KeyType key)
+{
+    if (ths->image == NULL)
+        return NULL;
+
+    return CompactTable_get(&ths->table, key);
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error SharedTable_detach(SharedTable *ths)
+{
+    if (ths->image != NULL)
+        munmap((void *)ths->image, ths->image_size);
+
+    if (ths->control != NULL)
+        munmap((void *)ths->control, sizeof(SharedControl));
+
+    *ths = {};
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Removes names of control and current image, processes which map them keep reading */
+hash_error SharedTable_unlink(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return HASH_ERROR;
+
+    struct stat info = {};
+    void *mapped = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SharedControl))
+        mapped = mmap(NULL, sizeof(SharedControl), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapped != MAP_FAILED)
+    {
+        char segment_name[SHARED_TABLE_NAME_MAX] = {};
+        uint64_t generation = ((const SharedControl *)mapped)->generation.load();
+
+        if (generation != 0 && SharedTable_segment_name(name, generation, segment_name))
+            shm_unlink(segment_name);
+
+        munmap(mapped, sizeof(SharedControl));
+    }
+
+    return (shm_unlink(name) == 0) ? HASH_OK : HASH_ERROR;
+}
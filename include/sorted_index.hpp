@@ -0,0 +1,405 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <nmmintrin.h>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+
+/*
+Static index of sorted keys, the smallest engine for the same dictionary: 24 bytes per word.
+Every element has first 8 bytes of key as big endian number (prefix), so most compares don't touch keys.
+Eytzinger layout keeps keys in order of BFS over binary search tree: search goes without branches
+and descendants of next levels lie together, so they are prefetched beforehand.
+B+ tree layout keeps keys in sorted order with levels of 8 separators (one cache line) above,
+every level is searched with SSE compares. Both layouts give keys in order, so prefix queries work too.
+Keys must be padded with zeros to 8 bytes and outlive the index.
+*/
+
+typedef enum sorted_layout_en
+{
+    SORTED_EYTZINGER = 0,
+    SORTED_BTREE     = 1
+} sorted_layout;
+
+const size_t SORTED_BLOCK_SIZE      = 8;     /* separators in one node of B+ tree */
+const size_t SORTED_MAX_LEVELS      = 32;
+const size_t SORTED_PREFETCH_STRIDE = 8;     /* prefixes of node 3 levels below */
+
+struct SortedIndex
+{
+    sorted_layout layout;
+    size_t size;
+
+    /* Positions start from 1, 0 is end. Eytzinger order or sorted order for B+ tree */
+    HashTableEl        *elements;
+    unsigned long long *prefixes;
+
+    /* B+ tree only: level 0 is prefixes in sorted order with sign bit flipped (for signed SSE compare),
+       every next level has the last prefix of every block of level below */
+    size_t     levels_count;
+    long long *levels[SORTED_MAX_LEVELS];
+    size_t     level_sizes[SORTED_MAX_LEVELS];
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error SortedIndex_construct(SortedIndex *ths, DoubleWord *translates, size_t words_count,
+                                 sorted_layout layout = SORTED_EYTZINGER);
+
+ValueType* SortedIndex_get(SortedIndex *ths, KeyType key);
+
+size_t SortedIndex_lower_bound(SortedIndex *ths, KeyType key);
+
+size_t SortedIndex_begin(SortedIndex *ths);
+
+size_t SortedIndex_next(SortedIndex *ths, size_t position);
+
+size_t SortedIndex_prefix(SortedIndex *ths, const char* prefix, HashTableEl *found, size_t limit);
+
+size_t SortedIndex_bytes(SortedIndex *ths);
+
+hash_error SortedIndex_destruct(SortedIndex *ths);
+
+//=============================================================================
+
+/* Key must be padded to 8 bytes */
+inline unsigned long long SortedKeyPrefix(KeyType key)
+{
+    unsigned long long prefix = 0;
+    memcpy(&prefix, key, sizeof(prefix));
+
+    return __builtin_bswap64(prefix);
+}
+
+//-----------------------------------------------------------------------------
+
+/* For any string, reads not more than its length */
+unsigned long long SortedKeyPrefixSafe(KeyType key)
+{
+    unsigned long long prefix = 0;
+
+    for (size_t i = 0; i < sizeof(prefix) && key[i]; i++)
+        prefix |= (unsigned long long)(unsigned char)key[i] << (56 - 8 * i);
+
+    return prefix;
+}
+
+//-----------------------------------------------------------------------------
+
+struct SortedWord
+{
+    KeyType   key;
+    ValueType value;
+    size_t    number;
+};
+
+int SortedWord_compare(const void *first, const void *second)
+{
+    const SortedWord *first_word  = (const SortedWord *)first;
+    const SortedWord *second_word = (const SortedWord *)second;
+
+    int key_cmp = strcmp(first_word->key, second_word->key);
+    if (key_cmp != 0)
+        return key_cmp;
+
+    return (first_word->number > second_word->number) - (first_word->number < second_word->number);
+}
+
+//-----------------------------------------------------------------------------
+
+/* In-order walk of implicit tree puts sorted words to Eytzinger positions */
+void SortedIndex_fill_eytzinger(SortedIndex *ths, SortedWord *words, size_t *next_word, size_t position)
+{
+    if (position > ths->size)
+        return;
+
+    SortedIndex_fill_eytzinger(ths, words, next_word, 2 * position);
+
+    ths->elements[position].key   = words[*next_word].key;
+    ths->elements[position].value = words[*next_word].value;
+    ths->prefixes[position]       = SortedKeyPrefix(words[*next_word].key);
+    (*next_word)++;
+
+    SortedIndex_fill_eytzinger(ths, words, next_word, 2 * position + 1);
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error SortedIndex_build_levels(SortedIndex *ths)
+{
+    size_t level_size = (ths->size + SORTED_BLOCK_SIZE - 1) / SORTED_BLOCK_SIZE * SORTED_BLOCK_SIZE;
+
+    for (ths->levels_count = 0; ths->levels_count < SORTED_MAX_LEVELS; ths->levels_count++)
+    {
+        size_t level = ths->levels_count;
+        if (level_size == 0)
+            level_size = SORTED_BLOCK_SIZE;
+
+        long long *curr = (long long *)aligned_alloc(64, level_size * sizeof(long long));
+        if (curr == NULL)
+            return HASH_REALLOC_ERROR;
+
+        ths->levels[level]      = curr;
+        ths->level_sizes[level] = level_size;
+
+        for (size_t i = 0; i < level_size; i++)
+        {
+            if (level == 0)
+                curr[i] = (i < ths->size) ? (long long)(ths->prefixes[i + 1] ^ (1ULL << 63)) : INT64_MAX;
+            else
+                curr[i] = (i * SORTED_BLOCK_SIZE < ths->level_sizes[level - 1]) ?
+                          ths->levels[level - 1][i * SORTED_BLOCK_SIZE + SORTED_BLOCK_SIZE - 1] : INT64_MAX;
+        }
+
+        if (level_size == SORTED_BLOCK_SIZE)
+        {
+            ths->levels_count++;
+            return HASH_OK;
+        }
+
+        size_t blocks_count = level_size / SORTED_BLOCK_SIZE;
+        level_size = (blocks_count + SORTED_BLOCK_SIZE - 1) / SORTED_BLOCK_SIZE * SORTED_BLOCK_SIZE;
+    }
+
+    return HASH_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+
+/* If key appears several times, the last value is taken like in HashTable_put */
+hash_error SortedIndex_construct(SortedIndex *ths, DoubleWord *translates, size_t words_count, sorted_layout layout)
+{
+    *ths = {};
+    ths->layout = layout;
+
+    SortedWord *words = (SortedWord *)calloc(words_count + 1, sizeof(SortedWord));
+    if (words == NULL)
+        return HASH_REALLOC_ERROR;
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        words[i].key    = translates[i].primary_word;
+        words[i].value  = translates[i].translated_word;
+        words[i].number = i;
+    }
+
+    qsort(words, words_count, sizeof(SortedWord), SortedWord_compare);
+
+    for (size_t i = 0; i < words_count; i++)
+    {
+        if (i + 1 < words_count && !strcmp(words[i].key, words[i + 1].key))
+            continue;
+
+        words[ths->size++] = words[i];
+    }
+
+    /* Prefixes of one node of Eytzinger tree and its descendants start at cache line */
+    ths->elements = (HashTableEl *)calloc(ths->size + 1, sizeof(HashTableEl));
+    ths->prefixes = (unsigned long long *)aligned_alloc(64, (ths->size + 8) / 8 * 8 * sizeof(unsigned long long));
+
+    if (ths->elements == NULL || ths->prefixes == NULL)
+    {
+        free(words);
+        SortedIndex_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    if (layout == SORTED_EYTZINGER)
+    {
+        size_t next_word = 0;
+        SortedIndex_fill_eytzinger(ths, words, &next_word, 1);
+    }
+    else
+    {
+        for (size_t i = 0; i < ths->size; i++)
+        {
+            ths->elements[i + 1].key   = words[i].key;
+            ths->elements[i + 1].value = words[i].value;
+            ths->prefixes[i + 1]       = SortedKeyPrefix(words[i].key);
+        }
+    }
+
+    free(words);
+
+    if (layout == SORTED_BTREE && SortedIndex_build_levels(ths) != HASH_OK)
+    {
+        SortedIndex_destruct(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Count of block values less than key */
+__attribute__((target("sse4.2")))
+size_t SortedIndex_rank(const long long *block, long long key)
+{
+    __m128i key_vector = _mm_set1_epi64x(key);
+    size_t rank = 0;
+
+    for (size_t i = 0; i < SORTED_BLOCK_SIZE; i += 2)
+    {
+        __m128i less = _mm_cmpgt_epi64(key_vector, _mm_load_si128((const __m128i *)(block + i)));
+        rank += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(less)));
+    }
+
+    return rank;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Position of the first key not less than given one, 0 if there's no such key */
+size_t SortedIndex_lower_bound_prefixed(SortedIndex *ths, KeyType key, unsigned long long prefix)
+{
+    if (ths->layout == SORTED_EYTZINGER)
+    {
+        size_t position = 1;
+
+        while (position <= ths->size)
+        {
+            /* Prefetch beyond the array doesn't fault, so it isn't checked */
+            __builtin_prefetch(ths->prefixes + position * SORTED_PREFETCH_STRIDE);
+
+            unsigned long long curr = ths->prefixes[position];
+            bool less = curr < prefix || (curr == prefix && strcmp(ths->elements[position].key, key) < 0);
+
+            position = 2 * position + less;
+        }
+
+        /* Go up while we went right, then one more step */
+        return position >> __builtin_ffsll(~position);
+    }
+
+    long long signed_prefix = prefix ^ (1ULL << 63);
+    size_t block = 0;
+
+    for (size_t level = ths->levels_count - 1; level > 0; level--)
+    {
+        block = block * SORTED_BLOCK_SIZE + SortedIndex_rank(ths->levels[level] + block * SORTED_BLOCK_SIZE, signed_prefix);
+
+        if (block * SORTED_BLOCK_SIZE >= ths->level_sizes[level - 1])
+            return 0;
+    }
+
+    size_t position = block * SORTED_BLOCK_SIZE + SortedIndex_rank(ths->levels[0] + block * SORTED_BLOCK_SIZE, signed_prefix) + 1;
+
+    /* Keys with the same prefix are compared entirely */
+    while (position <= ths->size && ths->prefixes[position] == prefix && strcmp(ths->elements[position].key, key) < 0)
+        position++;
+
+    return (position <= ths->size) ? position : 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key may be not padded */
+size_t SortedIndex_lower_bound(SortedIndex *ths, KeyType key)
+{
+    return SortedIndex_lower_bound_prefixed(ths, key, SortedKeyPrefixSafe(key));
+}
+
+//-----------------------------------------------------------------------------
+
+ValueType* SortedIndex_get(SortedIndex *ths, KeyType key)
+{
+    unsigned long long prefix = SortedKeyPrefix(key);
+    size_t position = SortedIndex_lower_bound_prefixed(ths, key, prefix);
+
+    if (position == 0 || ths->prefixes[position] != prefix || strcmp(ths->elements[position].key, key))
+        return NULL;
+
+    return &ths->elements[position].value;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SortedIndex_begin(SortedIndex *ths)
+{
+    if (ths->size == 0)
+        return 0;
+
+    if (ths->layout == SORTED_BTREE)
+        return 1;
+
+    size_t position = 1;
+    while (2 * position <= ths->size)
+        position *= 2;
+
+    return position;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Next position in order of keys, 0 after the last one */
+size_t SortedIndex_next(SortedIndex *ths, size_t position)
+{
+    if (ths->layout == SORTED_BTREE)
+        return (position < ths->size) ? position + 1 : 0;
+
+    if (2 * position + 1 <= ths->size)
+    {
+        position = 2 * position + 1;
+        while (2 * position <= ths->size)
+            position *= 2;
+
+        return position;
+    }
+
+    /* Up while we come from right child */
+    while (position & 1)
+        position >>= 1;
+
+    return position >> 1;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SortedIndex_prefix(SortedIndex *ths, const char* prefix, HashTableEl *found, size_t limit)
+{
+    size_t prefix_len  = strlen(prefix);
+    size_t found_count = 0;
+
+    for (size_t position = SortedIndex_lower_bound(ths, prefix);
+         position != 0 && found_count < limit; position = SortedIndex_next(ths, position))
+    {
+        if (strncmp(ths->elements[position].key, prefix, prefix_len))
+            break;
+
+        found[found_count++] = ths->elements[position];
+    }
+
+    return found_count;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SortedIndex_bytes(SortedIndex *ths)
+{
+    size_t bytes = (ths->size + 1) * (sizeof(HashTableEl) + sizeof(unsigned long long));
+
+    for (size_t i = 0; i < ths->levels_count; i++)
+        bytes += ths->level_sizes[i] * sizeof(long long);
+
+    return bytes;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error SortedIndex_destruct(SortedIndex *ths)
+{
+    free(ths->elements);
+    free(ths->prefixes);
+
+    for (size_t i = 0; i < ths->levels_count; i++)
+        free(ths->levels[i]);
+
+    ths->elements     = NULL;
+    ths->prefixes     = NULL;
+    ths->levels_count = 0;
+    ths->size         = 0;
+
+    return HASH_OK;
+}
@@ -0,0 +1,443 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+#include "parallel_build.hpp"
+
+/*
+Loading of dictionary as pipeline: reader thread reads file by chunks, parser threads split
+chunks to words and hash keys, calling thread puts words to table in order of file (so repeated
+key gets the last value, like with HashTable_build). Stages are joined by bounded queues, so
+not more than STREAM_QUEUE_SIZE + parsers count chunks are read ahead of table whatever size
+of file is, and reading overlaps with the rest.
+Reader moves unfinished last line of chunk to the beginning of the next one, so parsers see
+only whole lines. Words are parsed in place: chunks stay in StreamStorage while table is used.
+*/
+
+const size_t STREAM_CHUNK_SIZE = 1 << 20;
+const size_t STREAM_QUEUE_SIZE = 4;
+const size_t STREAM_LINE_BYTES = 24;           /* to guess capacity of table by size of file */
+
+struct BoundedQueue
+{
+    void **items;
+    size_t capacity;
+    size_t head;
+    size_t size;
+    bool closed;
+
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+struct StreamChunk
+{
+    size_t number;
+    char *buffer;
+    size_t size;
+
+    DoubleWord *translates;
+    unsigned long long *hashes;
+    size_t words_count;
+};
+
+/* Buffers of chunks, keys and values of table point to them */
+struct StreamStorage
+{
+    char **buffers;
+    size_t count;
+    size_t capacity;
+};
+
+struct StreamLoader
+{
+    FILE *file;
+    size_t chunk_size;
+    HashFunction hash_function;
+
+    BoundedQueue raw;
+    BoundedQueue parsed;
+
+    std::atomic<size_t> parsers_left;
+    std::atomic<bool>   failed;
+
+    /* Chunks given by reader and not put to table yet */
+    std::mutex flight_lock;
+    std::condition_variable flight_done;
+    size_t in_flight;
+    size_t max_in_flight;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error BoundedQueue_construct(BoundedQueue *ths, size_t capacity);
+
+void BoundedQueue_push(BoundedQueue *ths, void *item);
+
+void* BoundedQueue_pop(BoundedQueue *ths);
+
+void BoundedQueue_close(BoundedQueue *ths);
+
+void BoundedQueue_destruct(BoundedQueue *ths);
+
+hash_error HashTable_load_stream(HashTable *ths, StreamStorage *storage, const char *file_name, size_t parsers_count,
+                                 size_t chunk_size = STREAM_CHUNK_SIZE, hash_alloc_policy policy = HASH_ALLOC_DEFAULT);
+
+void StreamStorage_free(StreamStorage *ths);
+
+//=============================================================================
+
+hash_error BoundedQueue_construct(BoundedQueue *ths, size_t capacity)
+{
+    ths->items    = (void **)calloc(capacity, sizeof(void *));
+    ths->capacity = capacity;
+    ths->head     = 0;
+    ths->size     = 0;
+    ths->closed   = false;
+
+    return (ths->items == NULL) ? HASH_REALLOC_ERROR : HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Waits while queue is full */
+void BoundedQueue_push(BoundedQueue *ths, void *item)
+{
+    std::unique_lock<std::mutex> guard(ths->lock);
+    ths->not_full.wait(guard, [ths] { return ths->size < ths->capacity; });
+
+    ths->items[(ths->head + ths->size) % ths->capacity] = item;
+    ths->size++;
+
+    ths->not_empty.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+
+/* Waits while queue is empty, NULL if it's empty and closed */
+void* BoundedQueue_pop(BoundedQueue *ths)
+{
+    std::unique_lock<std::mutex> guard(ths->lock);
+    ths->not_empty.wait(guard, [ths] { return ths->size > 0 || ths->closed; });
+
+    if (ths->size == 0)
+        return NULL;
+
+    void *item = ths->items[ths->head];
+    ths->head = (ths->head + 1) % ths->capacity;
+    ths->size--;
+
+    ths->not_full.notify_one();
+    return item;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoundedQueue_close(BoundedQueue *ths)
+{
+    std::lock_guard<std::mutex> guard(ths->lock);
+    ths->closed = true;
+
+    ths->not_empty.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+
+void BoundedQueue_destruct(BoundedQueue *ths)
+{
+    free(ths->items);
+    ths->items = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+void StreamLoader_read(StreamLoader *ths)
+{
+    posix_fadvise(fileno(ths->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    size_t number    = 0;
+    size_t tail_size = 0;
+    char *buffer = (char *)malloc(ths->chunk_size + 1);
+
+    while (buffer != NULL)
+    {
+        size_t read_size = fread(buffer + tail_size, sizeof(char), ths->chunk_size, ths->file);
+        size_t size = tail_size + read_size;
+        bool eof = read_size < ths->chunk_size;
+
+        buffer[size] = '\0';
+
+        /* Chunk ends after the last '\n', line longer than chunk is read further */
+        size_t end = size;
+        if (!eof)
+        {
+            const char *eol = (const char *)memrchr(buffer, '\n', size);
+            end = (eol == NULL) ? 0 : eol - buffer + 1;
+        }
+
+        /* Tail is copied before chunk is given away: chunk may be freed by then */
+        char *next_buffer = NULL;
+        if (!eof)
+        {
+            next_buffer = (char *)malloc(size - end + ths->chunk_size + 1);
+            if (next_buffer != NULL)
+                memcpy(next_buffer, buffer + end, size - end);
+        }
+
+        StreamChunk *chunk = (end == 0 || (!eof && next_buffer == NULL)) ? NULL
+                           : (StreamChunk *)calloc(1, sizeof(StreamChunk));
+
+        if (chunk == NULL)
+        {
+            free(buffer);
+        }
+        else
+        {
+            chunk->number = number++;
+            chunk->buffer = buffer;
+            chunk->size   = end;
+
+            std::unique_lock<std::mutex> guard(ths->flight_lock);
+            ths->flight_done.wait(guard, [ths] { return ths->in_flight < ths->max_in_flight; });
+            ths->in_flight++;
+            guard.unlock();
+
+            BoundedQueue_push(&ths->raw, chunk);
+        }
+
+        if (eof)
+            break;
+
+        if (next_buffer == NULL || (end != 0 && chunk == NULL))
+        {
+            free(next_buffer);
+            ths->failed = true;
+            break;
+        }
+
+        buffer    = next_buffer;
+        tail_size = size - end;
+    }
+
+    if (buffer == NULL)
+        ths->failed = true;
+
+    BoundedQueue_close(&ths->raw);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Lines are "key=value", key is padded with zeros like in dictionary for get.asm */
+void StreamChunk_parse(StreamChunk *ths, HashFunction hash_function)
+{
+    char *buffer_end = ths->buffer + ths->size;
+
+    size_t lines_count = 1;
+    for (char *ptr = ths->buffer; (ptr = (char *)memchr(ptr, '\n', buffer_end - ptr)) != NULL; ptr++)
+        lines_count++;
+
+    ths->translates = (DoubleWord *)calloc(lines_count, sizeof(DoubleWord));
+    ths->hashes     = (unsigned long long *)calloc(lines_count, sizeof(unsigned long long));
+    if (ths->translates == NULL || ths->hashes == NULL)
+        return;
+
+    char *line = ths->buffer;
+    while (line < buffer_end)
+    {
+        char *eol = (char *)memchr(line, '\n', buffer_end - line);
+        if (eol == NULL) eol = buffer_end;
+
+        char *eq = (char *)memchr(line, '=', eol - line);
+        if (eq != NULL && eq != line)
+        {
+            *eq  = '\0';
+            *eol = '\0';
+
+            ths->translates[ths->words_count].primary_word    = line;
+            ths->translates[ths->words_count].translated_word = eq + 1;
+            ths->words_count++;
+        }
+
+        line = eol + 1;
+    }
+
+    HashTranslates(hash_function, ths->translates, ths->words_count, ths->hashes);
+}
+
+//-----------------------------------------------------------------------------
+
+void StreamLoader_parse(StreamLoader *ths)
+{
+    StreamChunk *chunk = NULL;
+
+    while ((chunk = (StreamChunk *)BoundedQueue_pop(&ths->raw)) != NULL)
+    {
+        StreamChunk_parse(chunk, ths->hash_function);
+        BoundedQueue_push(&ths->parsed, chunk);
+    }
+
+    if (ths->parsers_left.fetch_sub(1) == 1)
+        BoundedQueue_close(&ths->parsed);
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error StreamStorage_add(StreamStorage *ths, char *buffer)
+{
+    if (ths->count == ths->capacity)
+    {
+        size_t new_capacity = (ths->capacity == 0) ? 16 : ths->capacity * 2;
+        char **new_buffers = (char **)realloc(ths->buffers, new_capacity * sizeof(char *));
+        if (new_buffers == NULL)
+            return HASH_REALLOC_ERROR;
+
+        ths->buffers  = new_buffers;
+        ths->capacity = new_capacity;
+    }
+
+    ths->buffers[ths->count++] = buffer;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error StreamLoader_insert(HashTable *ths, StreamStorage *storage, StreamChunk *chunk)
+{
+    hash_error error = (chunk->translates == NULL || chunk->hashes == NULL) ? HASH_REALLOC_ERROR : HASH_OK;
+
+    for (size_t i = 0; i < chunk->words_count && error == HASH_OK; i++)
+        error = HashTable_put_hashed(ths, chunk->translates[i].primary_word, chunk->translates[i].translated_word,
+                                     chunk->hashes[i]);
+
+    if (error == HASH_OK)
+        error = StreamStorage_add(storage, chunk->buffer);
+
+    if (error != HASH_OK)
+        free(chunk->buffer);
+
+    free(chunk->translates);
+    free(chunk->hashes);
+    free(chunk);
+
+    return error;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Table is constructed here. storage must be freed after table even if error is returned */
+hash_error HashTable_load_stream(HashTable *ths, StreamStorage *storage, const char *file_name, size_t parsers_count,
+                                 size_t chunk_size, hash_alloc_policy policy)
+{
+    if (parsers_count == 0) parsers_count = 1;
+    if (chunk_size    == 0) chunk_size    = STREAM_CHUNK_SIZE;
+
+    FILE *file = fopen(file_name, "rb");
+    if (file == NULL)
+        return HASH_ERROR;
+
+    struct stat file_stat = {};
+    fstat(fileno(file), &file_stat);
+
+    if (HashTable_construct(ths, HashTable_build_capacity(file_stat.st_size / STREAM_LINE_BYTES), policy) != HASH_OK)
+    {
+        fclose(file);
+        return HASH_REALLOC_ERROR;
+    }
+
+    StreamLoader loader = {};
+    loader.file          = file;
+    loader.chunk_size    = chunk_size;
+    loader.hash_function = ths->hash_function;
+    loader.parsers_left  = parsers_count;
+
+    loader.max_in_flight = STREAM_QUEUE_SIZE + parsers_count;
+
+    /* Parsed queue and pending hold all chunks in flight, so parsers never wait for table */
+    size_t pending_capacity = loader.max_in_flight;
+    StreamChunk **pending = (StreamChunk **)calloc(pending_capacity, sizeof(StreamChunk *));
+
+    if (pending == NULL || BoundedQueue_construct(&loader.raw,    STREAM_QUEUE_SIZE)    != HASH_OK
+                        || BoundedQueue_construct(&loader.parsed, loader.max_in_flight) != HASH_OK)
+    {
+        free(pending);
+        BoundedQueue_destruct(&loader.raw);
+        BoundedQueue_destruct(&loader.parsed);
+        fclose(file);
+        return HASH_REALLOC_ERROR;
+    }
+
+    std::thread reader(StreamLoader_read, &loader);
+
+    std::thread *parsers = new std::thread[parsers_count];
+    for (size_t i = 0; i < parsers_count; i++)
+        parsers[i] = std::thread(StreamLoader_parse, &loader);
+
+    /* Chunks come out of order, they wait in pending until all previous ones are put */
+    hash_error error = HASH_OK;
+    size_t next_number = 0;
+    StreamChunk *chunk = NULL;
+
+    while ((chunk = (StreamChunk *)BoundedQueue_pop(&loader.parsed)) != NULL)
+    {
+        pending[chunk->number % pending_capacity] = chunk;
+
+        while ((chunk = pending[next_number % pending_capacity]) != NULL && chunk->number == next_number)
+        {
+            pending[next_number % pending_capacity] = NULL;
+            next_number++;
+
+            {
+                std::lock_guard<std::mutex> guard(loader.flight_lock);
+                loader.in_flight--;
+                loader.flight_done.notify_one();
+            }
+
+            if (error == HASH_OK)
+            {
+                error = StreamLoader_insert(ths, storage, chunk);
+            }
+            else
+            {
+                free(chunk->buffer);
+                free(chunk->translates);
+                free(chunk->hashes);
+                free(chunk);
+            }
+        }
+    }
+
+    reader.join();
+    for (size_t i = 0; i < parsers_count; i++)
+        parsers[i].join();
+
+    if (error == HASH_OK && (loader.failed || ferror(file)))
+        error = HASH_REALLOC_ERROR;
+
+    delete[] parsers;
+    free(pending);
+    BoundedQueue_destruct(&loader.raw);
+    BoundedQueue_destruct(&loader.parsed);
+    fclose(file);
+
+    return error;
+}
+
+//-----------------------------------------------------------------------------
+
+void StreamStorage_free(StreamStorage *ths)
+{
+    for (size_t i = 0; i < ths->count; i++)
+        free(ths->buffers[i]);
+
+    free(ths->buffers);
+    *ths = {};
+}
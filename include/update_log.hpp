@@ -0,0 +1,800 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nmmintrin.h>
+#include "hash_table.hpp"
+#include "dictionary.hpp"
+#include "hash_multimap.hpp"
+
+/*
+Persistent log of runtime edits of dictionary. Every put or remove is appended to log file as
+record with crc32 checksum, and it's applied to table only after the record is on disk.
+Group commit: thread which waits for its record and finds no write in progress becomes leader,
+it writes all records appended by that time with one write and one fdatasync, the others wait.
+So throughput comes from batches, while every acknowledged edit is durable.
+On open log is replayed on top of table made from base dictionary, torn record at the end
+(crash during write) is cut off. Compaction renames log to path.old, starts new log and
+writes table to base dictionary from background thread, then path.old is removed. After crash
+in the middle path.old is replayed before log: replaying edits twice gives the same table.
+If base isn't written, path.old stays and the next compaction writes base before replacing it.
+Keys and values of edits are copied to arena of log, table points to them. Table is changed
+by committing thread under lock of log, so other threads mustn't read it at the same time.
+*/
+
+const uint32_t UPDATE_LOG_MAGIC        = 0x474F4C55;     /* "ULOG" */
+const uint32_t UPDATE_LOG_VERSION      = 1;
+const size_t   UPDATE_LOG_MAX_WORD     = 1 << 16;
+const size_t   UPDATE_LOG_BUFFER       = 1 << 16;
+const size_t   UPDATE_LOG_COMPACT_SIZE = 64 << 20;       /* log is compacted after it's bigger */
+const size_t   UPDATE_LOG_ALIGN        = 8;
+
+typedef enum update_op_en
+{
+    UPDATE_PUT    = 1,
+    UPDATE_REMOVE = 2
+} update_op;
+
+struct UpdateLogHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+/* Key and value without zero follow it */
+struct UpdateRecord
+{
+    uint32_t checksum;             /* crc32 of the rest of record */
+    uint32_t op;
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+struct UpdateBuffer
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+struct UpdateLog
+{
+    HashTable *table;
+    char *path;
+    char *old_path;                /* log which is being compacted */
+    char *base_path;
+    int fd;
+
+    MultiArena strings;
+    char *scratch;                 /* key padded with zeros for lookups */
+    size_t scratch_size;
+
+    std::mutex lock;
+    std::condition_variable committed;
+
+    UpdateBuffer pending;          /* appended, not written yet */
+    UpdateBuffer writing;          /* written by leader now */
+    unsigned long long appended_sequence;
+    unsigned long long durable_sequence;
+    bool flushing;
+    bool failed;
+
+    size_t log_size;
+    size_t compact_size;
+    bool compacting;
+    std::thread compactor;
+
+    size_t records_count;
+    size_t commits_count;          /* fdatasync calls */
+    size_t replayed_count;
+    size_t compactions_count;
+};
+
+//-----------------------------------------------------------------------------
+
+hash_error UpdateLog_open(UpdateLog *ths, const char *path, const char *base_path, HashTable *table,
+                          size_t compact_size = UPDATE_LOG_COMPACT_SIZE);
+
+hash_error UpdateLog_put(UpdateLog *ths, KeyType key, ValueType value);
+
+hash_error UpdateLog_remove(UpdateLog *ths, KeyType key);
+
+hash_error UpdateLog_append(UpdateLog *ths, update_op op, KeyType key, ValueType value, unsigned long long *sequence);
+
+hash_error UpdateLog_commit(UpdateLog *ths, unsigned long long sequence);
+
+hash_error UpdateLog_compact(UpdateLog *ths);
+
+hash_error UpdateLog_close(UpdateLog *ths);
+
+//=============================================================================
+
+__attribute__((target("sse4.2")))
+uint32_t UpdateChecksum(const char *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(uint64_t));
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+    }
+
+    for (; size > 0; data++, size--)
+        crc = _mm_crc32_u8(crc, *data);
+
+    return ~crc;
+}
+
+
+//-----------------------------------------------------------------------------
+
+bool UpdateBuffer_reserve(UpdateBuffer *ths, size_t size)
+{
+    if (ths->size + size <= ths->capacity)
+        return true;
+
+    size_t capacity = (ths->capacity == 0) ? UPDATE_LOG_BUFFER : ths->capacity;
+    while (capacity < ths->size + size)
+        capacity *= 2;
+
+    char *data = (char *)realloc(ths->data, capacity);
+    if (data == NULL)
+        return false;
+
+    ths->data     = data;
+    ths->capacity = capacity;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool UpdateLog_write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+            return false;
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Rename and unlink are durable only after directory is synced */
+bool UpdateLog_sync_dir(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+
+    char *dir = (slash == NULL) ? strdup(".") : strndup(path, (slash == path) ? 1 : slash - path);
+    if (dir == NULL)
+        return false;
+
+    int fd = open(dir, O_RDONLY);
+    free(dir);
+
+    if (fd < 0)
+        return false;
+
+    bool synced = (fsync(fd) == 0);
+    close(fd);
+
+    return synced;
+}
+
+//-----------------------------------------------------------------------------
+
+char* UpdateLog_path(const char *path, const char *suffix)
+{
+    char *result = (char *)calloc(strlen(path) + strlen(suffix) + 1, sizeof(char));
+    if (result == NULL)
+        return NULL;
+
+    strcpy(result, path);
+    strcat(result, suffix);
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+/* New empty log with header */
+int UpdateLog_create(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0)
+        return -1;
+
+    UpdateLogHeader header = {UPDATE_LOG_MAGIC, UPDATE_LOG_VERSION};
+
+    if (!UpdateLog_write_all(fd, (const char *)&header, sizeof(header)) || fdatasync(fd) != 0 ||
+        !UpdateLog_sync_dir(path))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key of get.asm: padded with zeros to 8 bytes and one more zero word */
+size_t UpdateLog_key_size(size_t key_len)
+{
+    return (key_len + UPDATE_LOG_ALIGN - 1) / UPDATE_LOG_ALIGN * UPDATE_LOG_ALIGN + UPDATE_LOG_ALIGN;
+}
+
+//-----------------------------------------------------------------------------
+
+const char* UpdateLog_scratch_key(UpdateLog *ths, const char *key, size_t key_len)
+{
+    size_t size = UpdateLog_key_size(key_len);
+
+    if (size > ths->scratch_size)
+    {
+        char *scratch = (char *)realloc(ths->scratch, size);
+        if (scratch == NULL)
+            return NULL;
+
+        ths->scratch      = scratch;
+        ths->scratch_size = size;
+    }
+
+    memset(ths->scratch, 0, size);
+    memcpy(ths->scratch, key, key_len);
+
+    return ths->scratch;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Record is already checked. Lock is taken or there are no other threads yet */
+hash_error UpdateLog_apply(UpdateLog *ths, const UpdateRecord *record)
+{
+    const char *key   = (const char *)(record + 1);
+    const char *value = key + record->key_len;
+
+    const char *padded_key = UpdateLog_scratch_key(ths, key, record->key_len);
+    if (padded_key == NULL)
+        return HASH_REALLOC_ERROR;
+
+    if (record->op == UPDATE_REMOVE)
+    {
+        HashTable_remove(ths->table, padded_key);
+        return HASH_OK;
+    }
+
+    char *value_copy = MultiArena_alloc(&ths->strings, record->value_len + 1);
+    if (value_copy == NULL)
+        return HASH_REALLOC_ERROR;
+
+    memcpy(value_copy, value, record->value_len);
+    value_copy[record->value_len] = '\0';
+
+    bool inserted = false;
+    HashTableEl *el = HashTable_find_or_insert(ths->table, padded_key, ths->table->hash_function(padded_key), &inserted);
+    if (el == NULL)
+        return HASH_REALLOC_ERROR;
+
+    if (inserted)
+    {
+        char *key_copy = MultiArena_alloc(&ths->strings, UpdateLog_key_size(record->key_len));
+        if (key_copy == NULL)
+        {
+            HashTable_remove(ths->table, padded_key);
+            return HASH_REALLOC_ERROR;
+        }
+
+        memcpy(key_copy, padded_key, UpdateLog_key_size(record->key_len));
+        el->key = key_copy;
+    }
+
+    el->value = value_copy;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Size of right record at data or 0 */
+size_t UpdateRecord_check(const char *data, size_t size)
+{
+    if (size < sizeof(UpdateRecord))
+        return 0;
+
+    UpdateRecord record = {};
+    memcpy(&record, data, sizeof(UpdateRecord));
+
+    if ((record.op != UPDATE_PUT && record.op != UPDATE_REMOVE) || record.key_len == 0 ||
+        record.key_len > UPDATE_LOG_MAX_WORD || record.value_len > UPDATE_LOG_MAX_WORD)
+        return 0;
+
+    size_t record_size = sizeof(UpdateRecord) + record.key_len + record.value_len;
+    if (record_size > size || UpdateChecksum(data + sizeof(uint32_t), record_size - sizeof(uint32_t)) != record.checksum)
+        return 0;
+
+    return record_size;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Applies right records, returns size of right part of file or 0 if it's not a log.
+   Missing file is an empty log */
+size_t UpdateLog_replay(UpdateLog *ths, const char *path, bool *exists)
+{
+    char *buffer = NULL;
+    size_t size = ReadDataBase(path, &buffer);
+
+    UpdateLogHeader header = {};
+
+    /* Log cut before its header was written is the same as missing one */
+    *exists = (buffer != NULL && size >= sizeof(header));
+    if (!*exists)
+    {
+        free(buffer);
+        return 0;
+    }
+
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic != UPDATE_LOG_MAGIC || header.version != UPDATE_LOG_VERSION)
+    {
+        free(buffer);
+        return 0;
+    }
+
+    /* Records are copied to aligned place: fields of record are read directly */
+    UpdateBuffer record = {};
+    size_t offset = sizeof(header);
+
+    for (size_t record_size = 0; (record_size = UpdateRecord_check(buffer + offset, size - offset)) != 0;
+         offset += record_size)
+    {
+        record.size = 0;
+        if (!UpdateBuffer_reserve(&record, record_size))
+            break;
+
+        memcpy(record.data, buffer + offset, record_size);
+        if (UpdateLog_apply(ths, (const UpdateRecord *)record.data) != HASH_OK)
+            break;
+
+        ths->replayed_count++;
+    }
+
+    free(record.data);
+    free(buffer);
+
+    return offset;
+}
+
+//-----------------------------------------------------------------------------
+
+bool UpdateLog_write_word(FILE *file, const char *word, char end)
+{
+    static const char zeros[UPDATE_LOG_ALIGN] = {};
+
+    size_t len = strlen(word);
+    size_t pad = (UPDATE_LOG_ALIGN - len % UPDATE_LOG_ALIGN) % UPDATE_LOG_ALIGN;
+
+    return fwrite(word, 1, len, file) == len && fwrite(zeros, 1, pad, file) == pad && fputc(end, file) != EOF;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Lines of dictionary like made by dic_changer: key and value padded with zeros to 8 bytes.
+   Base is replaced by rename, so it's old or new one after crash */
+bool UpdateLog_write_base(const char *base_path, HashTableEl *elements, size_t count)
+{
+    char *tmp_path = UpdateLog_path(base_path, ".tmp");
+    if (tmp_path == NULL)
+        return false;
+
+    FILE *file = fopen(tmp_path, "wb");
+    bool written = (file != NULL);
+
+    for (size_t i = 0; i < count && written; i++)
+        written = UpdateLog_write_word(file, elements[i].key, '=') && UpdateLog_write_word(file, elements[i].value, '\n');
+
+    if (file != NULL)
+    {
+        written = fflush(file) == 0 && fsync(fileno(file)) == 0 && written;
+        written = fclose(file) == 0 && written;
+    }
+
+    written = written && rename(tmp_path, base_path) == 0 && UpdateLog_sync_dir(base_path);
+
+    if (!written)
+        remove(tmp_path);
+
+    free(tmp_path);
+    return written;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Elements of table, strings stay in place: base buffer and arena aren't changed */
+HashTableEl* UpdateLog_snapshot(HashTable *table)
+{
+    HashTableEl *elements = (HashTableEl *)calloc(table->size + 1, sizeof(HashTableEl));
+    if (elements == NULL)
+        return NULL;
+
+    size_t count = 0;
+    for (size_t i = 0; i < table->capacity; i++)
+    for (size_t j = 0; j < table->buckets[i].size; j++)
+        elements[count++] = table->buckets[i].data[j].value;
+
+    return elements;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error UpdateLog_open(UpdateLog *ths, const char *path, const char *base_path, HashTable *table, size_t compact_size)
+{
+    ths->table        = table;
+    ths->fd           = -1;
+    ths->compact_size = compact_size;
+    ths->strings      = {};
+    ths->scratch      = NULL;
+    ths->scratch_size = 0;
+    ths->pending      = {};
+    ths->writing      = {};
+    ths->failed       = false;
+    ths->flushing     = false;
+    ths->compacting   = false;
+
+    ths->appended_sequence = ths->durable_sequence  = 0;
+    ths->records_count     = ths->commits_count     = 0;
+    ths->replayed_count    = ths->compactions_count = 0;
+
+    ths->path      = UpdateLog_path(path, "");
+    ths->old_path  = UpdateLog_path(path, ".old");
+    ths->base_path = UpdateLog_path(base_path, "");
+
+    if (ths->path == NULL || ths->old_path == NULL || ths->base_path == NULL)
+    {
+        UpdateLog_close(ths);
+        return HASH_REALLOC_ERROR;
+    }
+
+    bool old_exists = false;
+    bool exists     = false;
+
+    UpdateLog_replay(ths, ths->old_path, &old_exists);
+    size_t right_size = UpdateLog_replay(ths, ths->path, &exists);
+
+    /* Compaction was broken: table has all edits now, base is written again before old log is removed */
+    if (old_exists)
+    {
+        HashTableEl *elements = UpdateLog_snapshot(table);
+
+        bool written = elements != NULL && UpdateLog_write_base(ths->base_path, elements, table->size) &&
+                       unlink(ths->old_path) == 0 && UpdateLog_sync_dir(ths->old_path);
+        free(elements);
+
+        if (!written)
+        {
+            UpdateLog_close(ths);
+            return HASH_ERROR;
+        }
+    }
+
+    if (right_size == 0)
+    {
+        if (exists)
+        {
+            /* Not a log: it isn't overwritten */
+            UpdateLog_close(ths);
+            return HASH_ERROR;
+        }
+
+        ths->fd = UpdateLog_create(ths->path);
+        right_size = sizeof(UpdateLogHeader);
+    }
+    else
+    {
+        /* Torn record is cut off, next records are appended after right ones */
+        ths->fd = open(ths->path, O_WRONLY | O_APPEND);
+        if (ths->fd >= 0 && (ftruncate(ths->fd, right_size) != 0 || fdatasync(ths->fd) != 0))
+        {
+            close(ths->fd);
+            ths->fd = -1;
+        }
+    }
+
+    if (ths->fd < 0)
+    {
+        UpdateLog_close(ths);
+        return HASH_ERROR;
+    }
+
+    ths->log_size = right_size;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Key is zero terminated, it mustn't be empty. Words can't have '=' and '\n': they're written to base */
+bool UpdateLog_word_is_right(const char *word, size_t len)
+{
+    return len <= UPDATE_LOG_MAX_WORD && memchr(word, '=', len) == NULL && memchr(word, '\n', len) == NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Record isn't durable and isn't in table before UpdateLog_commit of its sequence */
+hash_error UpdateLog_append(UpdateLog *ths, update_op op, KeyType key, ValueType value, unsigned long long *sequence)
+{
+    if (value == NULL)
+        value = "";
+
+    size_t key_len   = strlen(key);
+    size_t value_len = (op == UPDATE_PUT) ? strlen(value) : 0;
+
+    if (key_len == 0 || !UpdateLog_word_is_right(key, key_len) || !UpdateLog_word_is_right(value, value_len))
+        return HASH_ERROR;
+
+    UpdateRecord record = {};
+    record.op        = op;
+    record.key_len   = key_len;
+    record.value_len = value_len;
+
+    size_t record_size = sizeof(UpdateRecord) + key_len + value_len;
+
+    std::lock_guard<std::mutex> guard(ths->lock);
+
+    if (ths->failed || !UpdateBuffer_reserve(&ths->pending, record_size))
+        return HASH_ERROR;
+
+    char *place = ths->pending.data + ths->pending.size;
+    memcpy(place, &record, sizeof(UpdateRecord));
+    memcpy(place + sizeof(UpdateRecord), key, key_len);
+    memcpy(place + sizeof(UpdateRecord) + key_len, value, value_len);
+
+    record.checksum = UpdateChecksum(place + sizeof(uint32_t), record_size - sizeof(uint32_t));
+    memcpy(place, &record.checksum, sizeof(uint32_t));
+
+    ths->pending.size += record_size;
+    ths->records_count++;
+
+    *sequence = ++ths->appended_sequence;
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Records of writing buffer are applied in order of log */
+hash_error UpdateLog_apply_batch(UpdateLog *ths)
+{
+    UpdateBuffer record = {};
+    hash_error error = HASH_OK;
+
+    for (size_t offset = 0; offset < ths->writing.size && error == HASH_OK; )
+    {
+        UpdateRecord header = {};
+        memcpy(&header, ths->writing.data + offset, sizeof(UpdateRecord));
+
+        size_t record_size = sizeof(UpdateRecord) + header.key_len + header.value_len;
+
+        record.size = 0;
+        if (!UpdateBuffer_reserve(&record, record_size))
+            error = HASH_REALLOC_ERROR;
+        else
+        {
+            memcpy(record.data, ths->writing.data + offset, record_size);
+            error = UpdateLog_apply(ths, (const UpdateRecord *)record.data);
+        }
+
+        offset += record_size;
+    }
+
+    free(record.data);
+    return error;
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error UpdateLog_start_compaction(UpdateLog *ths);
+
+//-----------------------------------------------------------------------------
+
+/* Waits until record of sequence is on disk and in table, maybe writing records of other threads */
+hash_error UpdateLog_commit(UpdateLog *ths, unsigned long long sequence)
+{
+    std::unique_lock<std::mutex> guard(ths->lock);
+
+    while (ths->durable_sequence < sequence && !ths->failed)
+    {
+        if (ths->flushing)
+        {
+            ths->committed.wait(guard);
+            continue;
+        }
+
+        ths->flushing = true;
+
+        UpdateBuffer batch = ths->pending;
+        ths->pending = ths->writing;
+        ths->pending.size = 0;
+        ths->writing = batch;
+
+        unsigned long long batch_sequence = ths->appended_sequence;
+        int fd = ths->fd;
+
+        guard.unlock();
+        bool written = UpdateLog_write_all(fd, ths->writing.data, ths->writing.size) && fdatasync(fd) == 0;
+        guard.lock();
+
+        if (!written || UpdateLog_apply_batch(ths) != HASH_OK)
+            ths->failed = true;
+        else
+        {
+            ths->durable_sequence = batch_sequence;
+            ths->log_size += ths->writing.size;
+            ths->commits_count++;
+
+            if (ths->compact_size != 0 && ths->log_size > ths->compact_size && !ths->compacting)
+                UpdateLog_start_compaction(ths);
+        }
+
+        ths->flushing = false;
+        ths->committed.notify_all();
+    }
+
+    return ths->failed ? HASH_ERROR : HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Returns after edit is durable */
+hash_error UpdateLog_put(UpdateLog *ths, KeyType key, ValueType value)
+{
+    unsigned long long sequence = 0;
+
+    hash_error error = UpdateLog_append(ths, UPDATE_PUT, key, value, &sequence);
+    if (error != HASH_OK)
+        return error;
+
+    return UpdateLog_commit(ths, sequence);
+}
+
+//-----------------------------------------------------------------------------
+
+hash_error UpdateLog_remove(UpdateLog *ths, KeyType key)
+{
+    unsigned long long sequence = 0;
+
+    hash_error error = UpdateLog_append(ths, UPDATE_REMOVE, key, NULL, &sequence);
+    if (error != HASH_OK)
+        return error;
+
+    return UpdateLog_commit(ths, sequence);
+}
+
+//-----------------------------------------------------------------------------
+
+void UpdateLog_compact_loop(UpdateLog *ths, HashTableEl *elements, size_t count)
+{
+    bool written = UpdateLog_write_base(ths->base_path, elements, count) &&
+                   unlink(ths->old_path) == 0 && UpdateLog_sync_dir(ths->old_path);
+    free(elements);
+
+    std::lock_guard<std::mutex> guard(ths->lock);
+
+    /* If base isn't written, old log stays and it's replayed on next open */
+    if (written)
+        ths->compactions_count++;
+
+    ths->compacting = false;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Lock is taken, there's no write in progress. Records which aren't written yet go to new log */
+hash_error UpdateLog_start_compaction(UpdateLog *ths)
+{
+    if (ths->compactor.joinable())
+        ths->compactor.join();
+
+    HashTableEl *elements = UpdateLog_snapshot(ths->table);
+    if (elements == NULL)
+        return HASH_REALLOC_ERROR;
+
+    /* Previous compaction didn't write base, so its old log has edits which are only there.
+       It mustn't be replaced by current log: base gets them now, while lock is taken */
+    if (access(ths->old_path, F_OK) == 0 &&
+        !(UpdateLog_write_base(ths->base_path, elements, ths->table->size) &&
+          unlink(ths->old_path) == 0 && UpdateLog_sync_dir(ths->old_path)))
+    {
+        free(elements);
+        return HASH_ERROR;
+    }
+
+    if (rename(ths->path, ths->old_path) != 0)
+    {
+        free(elements);
+        return HASH_ERROR;
+    }
+
+    int fd = UpdateLog_create(ths->path);
+    if (fd < 0)
+    {
+        /* Old log is still whole, it's used until next compaction */
+        rename(ths->old_path, ths->path);
+        free(elements);
+        return HASH_ERROR;
+    }
+
+    close(ths->fd);
+    ths->fd         = fd;
+    ths->log_size   = sizeof(UpdateLogHeader);
+    ths->compacting = true;
+
+    ths->compactor = std::thread(UpdateLog_compact_loop, ths, elements, ths->table->size);
+
+    return HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Base is written in background, HASH_ERROR if compaction is already going or old log
+   of failed one can't be written to base */
+hash_error UpdateLog_compact(UpdateLog *ths)
+{
+    std::unique_lock<std::mutex> guard(ths->lock);
+    ths->committed.wait(guard, [ths] { return !ths->flushing; });
+
+    if (ths->compacting || ths->failed)
+        return HASH_ERROR;
+
+    return UpdateLog_start_compaction(ths);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Commits appended records and waits for compaction. Strings of edits are freed,
+   so table mustn't be used after it. Log which wasn't opened (zeroed) is only skipped */
+hash_error UpdateLog_close(UpdateLog *ths)
+{
+    hash_error error = HASH_OK;
+    bool opened = (ths->path != NULL && ths->fd >= 0);
+
+    if (opened)
+        error = UpdateLog_commit(ths, ths->appended_sequence);
+
+    if (ths->compactor.joinable())
+        ths->compactor.join();
+
+    if (opened)
+        close(ths->fd);
+
+    free(ths->path);
+    free(ths->old_path);
+    free(ths->base_path);
+    free(ths->scratch);
+    free(ths->pending.data);
+    free(ths->writing.data);
+    MultiArena_free(&ths->strings);
+
+    ths->fd        = -1;
+    ths->path      = NULL;
+    ths->old_path  = NULL;
+    ths->base_path = NULL;
+    ths->scratch   = NULL;
+    ths->scratch_size = 0;
+    ths->pending   = {};
+    ths->writing   = {};
+
+    return error;
+}
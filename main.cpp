@@ -1,79 +1,81 @@
 #include "include/hash_table.hpp"
+#include "include/dictionary.hpp"
+#include "include/parallel_build.hpp"
+#include "include/access_profile.hpp"
+#include "include/fuzzy_index.hpp"
+#include "include/update_log.hpp"
+#include "include/key_folding.hpp"
 #include <cstdio>
 #include <SFML/Graphics.hpp>
 #include <cassert>
 
-const size_t MAX_LINE = 100;
-
-#ifndef SPEED_TEST_COUNT 
-#define SPEED_TEST_COUNT 1000
+#ifdef RELOAD_TEST
+#include "include/hash_table_reload.hpp"
+#include <chrono>
 #endif
 
-struct DoubleWord
-{
-    const char* primary_word;
-    const char* translated_word;
-};
-
-//-----------------------------------------------------------------------------
+#ifdef NORMALIZED_TEST
+#include <cctype>
+#endif
 
-size_t GetFileSize(FILE* file)
-{
-    size_t size = 0;
-    fseek(file, 0, SEEK_END);
-    size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+#ifdef EMBEDDED_TEST
+#include "include/embedded_words.hpp"    /* made by make embed */
+#endif
 
-    return size;
-}
+#if defined(STREAM_TEST) || defined(STREAM_LOAD)
+#include "include/stream_loader.hpp"
+#endif
 
-//-----------------------------------------------------------------------------
+#if defined(MULTIMAP_TEST) || defined(MULTIMAP)
+#include "include/hash_multimap.hpp"
+#endif
 
-size_t GetEolCount(const char* buffer, size_t buffer_size)
-{
-    assert(buffer != NULL);
+#ifdef COMPACT_TEST
+#include "include/compact_table.hpp"
+#endif
 
-    size_t eol_count = 0;
-    const char* ptr  = buffer;
+#ifdef LATENCY_HISTOGRAMS
+#include "include/latency_histogram.hpp"
+#include <csignal>
+#endif
 
-    while((size_t)(ptr - buffer) < buffer_size)
-    {
-        if (*ptr == '\n') eol_count++;
-        ptr++;
-    }
-    
-    return eol_count;
-}
+#ifdef UPDATE_LOG_TEST
+#include <csignal>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <atomic>
+#endif
 
-//-----------------------------------------------------------------------------
+#if defined(SHARED_TABLE) || defined(SHARED_TABLE_TEST)
+#include "include/compact_table.hpp"
+#include "include/shared_table.hpp"
+#include <sys/wait.h>
+#endif
 
-DoubleWord* Parser(char* buffer, size_t eol_count, size_t file_size)
-{
-    DoubleWord* translates = (DoubleWord *)calloc(eol_count, sizeof(DoubleWord));
-    char* ptr = buffer;
-    size_t curr_word = 1;
+const size_t MAX_LINE = 100;
 
-    translates[0].primary_word = buffer;
+/* QUERY_LOG records words asked in DictionaryHandler, REORDER sorts buckets by this log on start,
+   MOVE_TO_FRONT moves every found word to the front of its bucket.
+   FUZZY suggests similar words when word isn't found.
+   LATENCY_HISTOGRAMS records time of every get, put and rehash, histograms are printed
+   by LATENCY command, on EXIT, on SIGUSR1 and after speed test.
+   UPDATE_LOG keeps edits made by PUT key=value and REMOVE key in log, COMPACT writes them to dictionary.
+   SHARED_TABLE reads table from shared memory segment, PUBLISH rebuilds it for all processes.
+   NORMALIZED folds words of dictionary and asked words, so case and accents don't matter */
+const char *QUERY_LOG_PATH    = "src/queries.log";
+const char *UPDATE_LOG_PATH   = "src/dictionary.log";
+const char *SHARED_TABLE_NAME = "/dictionary";
 
-    while((size_t)(ptr - buffer) < file_size)
-    {
-        if (*ptr == '=')
-        {
-            *ptr = '\0';
-            translates[curr_word - 1].translated_word = ptr + 1;
-        }
-        if (*ptr == '\n'){
-            *ptr = '\0';
-            if (curr_word < eol_count)
-                translates[curr_word++].primary_word = ptr + 1;
-        }
-        ptr++;
-    }
+#ifndef SPEED_TEST_COUNT 
+#define SPEED_TEST_COUNT 1000
+#endif
 
-    return translates;
-}
+#ifndef RELOAD_TEST_COUNT
+#define RELOAD_TEST_COUNT 50
+#endif
 
-//-----------------------------------------------------------------------------
+const size_t RELOAD_READERS    = 2;
+const size_t RELOAD_BATCH_SIZE = 1000;
 
 bool MainTest(HashTable *hash_table, DoubleWord *translates, size_t eol_count)
 {
@@ -104,26 +106,188 @@ bool MainTest(HashTable *hash_table, DoubleWord *translates, size_t eol_count)
 
 //-----------------------------------------------------------------------------
 
-bool DictionaryHandler(HashTable *hash_table)
+const size_t FUZZY_SUGGESTIONS    = 5;
+const size_t FUZZY_TEST_STEP      = 100;
+
+//-----------------------------------------------------------------------------
+
+void PrintSuggestions(FuzzyIndex *fuzzy, const char *key)
+{
+    FuzzySuggestion suggestions[FUZZY_SUGGESTIONS] = {};
+    size_t count = FuzzyIndex_suggest(fuzzy, key, suggestions, FUZZY_SUGGESTIONS);
+
+    if (count == 0)
+        return;
+
+    printf("did you mean:");
+    for (size_t i = 0; i < count; i++)
+        printf((i == 0) ? " %s" : ", %s", suggestions[i].word);
+
+    printf("\n");
+}
+
+//-----------------------------------------------------------------------------
+
+/* false if input isn't command of update log. Edit is printed OK after it's on disk */
+bool UpdateCommand(UpdateLog *update_log, char *input)
+{
+    hash_error error = HASH_OK;
+
+    if (!strncmp(input, "PUT ", 4))
+    {
+        char *eq = strchr(input + 4, '=');
+        if (eq == NULL)
+            error = HASH_ERROR;
+        else
+        {
+            *eq = '\0';
+            error = UpdateLog_put(update_log, input + 4, eq + 1);
+        }
+    }
+    else if (!strncmp(input, "REMOVE ", 7))
+        error = UpdateLog_remove(update_log, input + 7);
+    else if (!strcmp(input, "COMPACT"))
+        error = UpdateLog_compact(update_log);
+    else
+        return false;
+
+    printf((error == HASH_OK) ? "OK\n" : "ERROR\n");
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/* query_log, fuzzy and update_log may be NULL */
+bool DictionaryHandler(HashTable *hash_table, QueryLog *query_log, FuzzyIndex *fuzzy = NULL, UpdateLog *update_log = NULL)
 {
-    char input[MAX_LINE + 1] = {0};
+    /* Query is folded in place with its padding to 8 bytes and the first byte of the next word */
+    char input[MAX_LINE + 16] = {0};
     fgets(input, MAX_LINE, stdin);
     
     char* eol = strchr(input, '\n');
     if (eol) *eol = '\0'; 
 
-    if (!strcmp(input, "EXIT")) return false;
+    if (!strcmp(input, "EXIT"))
+    {
+#ifdef LATENCY_HISTOGRAMS
+        Latency_dump(stdout);
+#endif
+        return false;
+    }
+
+    if (update_log != NULL && UpdateCommand(update_log, input))
+        return true;
+
+#ifdef LATENCY_HISTOGRAMS
+    if (!strcmp(input, "LATENCY"))
+    {
+        Latency_dump(stdout);
+        return true;
+    }
+
+    unsigned long long start = LatencyNow();
+#endif
+
+    if (!strcmp(input, "STATS"))
+    {
+        HashTableStats stats = {};
+        HashTable_stats(hash_table, &stats);
+        HashTable_dump_stats(&stats, stdout, "dictionary");
+        return true;
+    }
+
+    if (query_log != NULL)
+        QueryLog_write(query_log, input);
 
+#ifdef MOVE_TO_FRONT
+    const char** get_translate = HashTable_get_mtf(hash_table, input);
+#elif defined(NORMALIZED)
+    const char** get_translate = HashTable_get_folded(hash_table, input);
+#else
     const char** get_translate = HashTable_get(hash_table, input);
+#endif
+
+#ifdef LATENCY_HISTOGRAMS
+    Latency_record((get_translate != NULL) ? LATENCY_GET_HIT : LATENCY_GET_MISS, LatencyNow() - start);
+#endif
 
     if (get_translate == NULL) printf("NULL\n");
     else                       printf("%s\n", *get_translate);
 
+    if (get_translate == NULL && fuzzy != NULL)
+        PrintSuggestions(fuzzy, input);
+
     return true;
 }
 
 //-----------------------------------------------------------------------------
 
+void ReorderByQueryLog(HashTable *hash_table)
+{
+    char  *queries_buffer = NULL;
+    size_t queries_count  = 0;
+    KeyType *queries = QueryLog_read(QUERY_LOG_PATH, &queries_count, &queries_buffer);
+
+    if (queries == NULL)
+        return;
+
+    HashTable_reorder(hash_table, queries, queries_count);
+
+    free(queries);
+    free(queries_buffer);
+}
+
+//-----------------------------------------------------------------------------
+
+#ifdef REORDER
+
+const size_t CUCKOO_REORDER_HOT = 7;         /* every such word is asked more */
+
+/* Reorder moves slots inside buckets of CuckooTable, every word must be found after it
+   with the same value */
+bool CuckooReorderTest(DoubleWord *translates, size_t words_count)
+{
+    KeyType *queries = (KeyType *)calloc(2 * words_count + 1, sizeof(KeyType));
+    if (queries == NULL)
+        return false;
+
+    CuckooTable cuckoo = {};
+    CuckooTable_construct(&cuckoo, words_count);
+
+    size_t queries_count = 0;
+    for (size_t i = 0; i < words_count; i++)
+    {
+        CuckooTable_put(&cuckoo, translates[i].primary_word, translates[i].translated_word);
+
+        queries[queries_count++] = translates[i].primary_word;
+        if (i % CUCKOO_REORDER_HOT == 0)
+            queries[queries_count++] = translates[i].primary_word;
+    }
+
+    bool passed = (CuckooTable_reorder(&cuckoo, queries, queries_count) == HASH_OK);
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        ValueType *value = CuckooTable_get(&cuckoo, translates[i].primary_word);
+
+        if (value == NULL || *value != translates[i].translated_word)
+        {
+            printf("CUCKOO REORDER PRIMARY:%s\n", translates[i].primary_word);
+            passed = false;
+        }
+    }
+
+    CuckooTable_destruct(&cuckoo);
+    free(queries);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
 void PrintCollisions(HashTable *hash_table)
 {
     FILE *file = fopen("collisions.txt", "wb");
@@ -142,31 +306,23 @@ int SpeedTest(HashTable *hash_table, DoubleWord *translates, size_t words_count)
 
     for (int j = 0; j < SPEED_TEST_COUNT; j++)
     for (size_t i = 0; i < words_count;   i++)
+    {
+#ifdef LATENCY_HISTOGRAMS
+        unsigned long long start = LatencyNow();
+        get_translate = HashTable_get(hash_table, translates[i].primary_word);
+        Latency_record((get_translate != NULL) ? LATENCY_GET_HIT : LATENCY_GET_MISS, LatencyNow() - start);
+
+        if (!get_translate) return 1;
+#else
             if (!(get_translate = HashTable_get(hash_table, translates[i].primary_word))) return 1;
+#endif
+    }
     
     return 0;
 }
 
 //-----------------------------------------------------------------------------
 
-size_t ReadDataBase(const char* file_name, char** buffer)
-{
-    assert(file_name != NULL);
-    assert(buffer    != NULL);
-
-    FILE* file = fopen(file_name, "rb");
-    if (file == NULL) return 0;
-
-    size_t file_size = GetFileSize(file);
-    *buffer = (char *)calloc(file_size + 1, sizeof(char));
-    fread(*buffer, sizeof(char), file_size, file);
-    fclose(file);
-
-    return file_size;
-}
-
-//-----------------------------------------------------------------------------
-
 void GetGraph(const char* dictionary_path)
 {
     assert(dictionary_path != NULL);
@@ -207,39 +363,1542 @@ void GetGraph(const char* dictionary_path)
 
 //-----------------------------------------------------------------------------
 
-int main()
+#ifdef RELOAD_TEST
+
+struct ReloadTestReader
 {
+    HashTableReloader *reloader;
+    DoubleWord        *translates;
+    size_t             words_count;
+    std::atomic<bool> *stop;
 
-#ifdef PLOT
-    GetGraph("src/dictionary.dic");
+    /* Time of every batch of RELOAD_BATCH_SIZE lookups in nanoseconds */
+    long long *batch_times;
+    size_t     batch_count;
+    size_t     batch_capacity;
+    bool       failed;
+};
 
-    return 0;
-#else
+//-----------------------------------------------------------------------------
+
+void ReloadTestReaderLoop(ReloadTestReader *test)
+{
+    size_t reader = HashTableReloader_register(test->reloader);
+    size_t word   = 0;
+
+    while (!test->stop->load(std::memory_order_relaxed))
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < RELOAD_BATCH_SIZE; i++, word = (word + 1) % test->words_count)
+        {
+            HashTable *hash_table = HashTableReloader_read_lock(test->reloader, reader);
+            const char** get_translate = HashTable_get(hash_table, test->translates[word].primary_word);
+
+            if (get_translate == NULL || strcmp(*get_translate, test->translates[word].translated_word))
+                test->failed = true;
+
+            HashTableReloader_read_unlock(test->reloader, reader);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        if (test->batch_count == test->batch_capacity)
+        {
+            test->batch_capacity = (test->batch_capacity == 0) ? 1024 : test->batch_capacity * 2;
+            test->batch_times = (long long *)realloc(test->batch_times, test->batch_capacity * sizeof(long long));
+        }
+        test->batch_times[test->batch_count++] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+int CompareLongLong(const void *first, const void *second)
+{
+    long long a = *(const long long *)first;
+    long long b = *(const long long *)second;
+
+    return (a > b) - (a < b);
+}
+
+//-----------------------------------------------------------------------------
+
+bool ReloadTest(const char* dictionary_path)
+{
+    assert(dictionary_path != NULL);
 
     char *buffer = NULL;
-    size_t buffer_size = ReadDataBase("src/dictionary.dic", &buffer);
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
     if (buffer == NULL)
     {
         printf("Couldn't read database\n");
-        return 0;
+        return false;
     }
-    
+
     size_t      words_count = GetEolCount(buffer, buffer_size);
     DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
-    
+
+    HashTableReloader reloader = {};
+    if (HashTableReloader_construct(&reloader, dictionary_path) != HASH_OK)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    std::atomic<bool> stop(false);
+    ReloadTestReader readers[RELOAD_READERS] = {};
+    std::thread      threads[RELOAD_READERS];
+
+    for (size_t i = 0; i < RELOAD_READERS; i++)
+    {
+        readers[i].reloader    = &reloader;
+        readers[i].translates  = translates;
+        readers[i].words_count = words_count;
+        readers[i].stop        = &stop;
+        threads[i] = std::thread(ReloadTestReaderLoop, &readers[i]);
+    }
+
+    bool passed = true;
+    for (int i = 0; i < RELOAD_TEST_COUNT; i++)
+        if (HashTableReloader_reload(&reloader, dictionary_path) != HASH_OK)
+            passed = false;
+
+    stop.store(true);
+
+    size_t     batch_count = 0;
+    long long *batch_times = NULL;
+
+    for (size_t i = 0; i < RELOAD_READERS; i++)
+    {
+        threads[i].join();
+
+        if (readers[i].failed)
+            passed = false;
+
+        batch_times = (long long *)realloc(batch_times, (batch_count + readers[i].batch_count) * sizeof(long long));
+        memcpy(batch_times + batch_count, readers[i].batch_times, readers[i].batch_count * sizeof(long long));
+        batch_count += readers[i].batch_count;
+        free(readers[i].batch_times);
+    }
+
+    if (batch_count != 0)
+    {
+        qsort(batch_times, batch_count, sizeof(long long), CompareLongLong);
+
+        printf("RELOADS:%zu BATCHES:%zu (%zu lookups each)\n"
+               "BATCH TIME ns p50:%lld p99:%lld p99.9:%lld max:%lld\n",
+               reloader.reloads_count, batch_count, RELOAD_BATCH_SIZE,
+               batch_times[batch_count / 2],
+               batch_times[batch_count * 99  / 100],
+               batch_times[batch_count * 999 / 1000],
+               batch_times[batch_count - 1]);
+    }
+
+    HashTableReloader_destruct(&reloader);
+    free(batch_times);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef STREAM_TEST
+
+const size_t STREAM_TEST_CHUNKS[] = {7, 4096, STREAM_CHUNK_SIZE};
+
+double SecondsSince(timespec start)
+{
+    timespec end = {};
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Streaming loader must give the same words as read + parse + build, small chunks check lines
+   which cross chunks and lines longer than chunk */
+bool StreamTest(const char* dictionary_path)
+{
+    timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
     HashTable hash_table = {};
-    HashTable_construct(&hash_table, 100);
+    HashTable_build(&hash_table, translates, words_count);
 
-    for (size_t i = 0; i < words_count; i++)
-        HashTable_put(&hash_table, translates[i].primary_word, translates[i].translated_word);
+    printf("sequential load %10.3f ms\n", SecondsSince(start) * 1000);
 
-#ifdef SPEED_TEST
-    int pls_dont_optimize = SpeedTest(&hash_table, translates, words_count);
-    if (pls_dont_optimize) printf("Get returned NULL in Speed test\n");
-#elif  MAIN_TEST
-    MainTest(&hash_table, translates, words_count);
-#else  
-    while (DictionaryHandler(&hash_table)) {}
+    size_t threads_count = std::thread::hardware_concurrency();
+    bool passed = true;
+
+    for (size_t i = 0; i < sizeof(STREAM_TEST_CHUNKS) / sizeof(STREAM_TEST_CHUNKS[0]) && passed; i++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        StreamStorage storage = {};
+        HashTable stream_table = {};
+        passed = (HashTable_load_stream(&stream_table, &storage, dictionary_path, threads_count,
+                                        STREAM_TEST_CHUNKS[i]) == HASH_OK);
+
+        printf("stream load     %10.3f ms (chunk %zu)\n", SecondsSince(start) * 1000, STREAM_TEST_CHUNKS[i]);
+
+        passed = passed && (stream_table.size == hash_table.size);
+
+        for (size_t j = 0; j < words_count && passed; j++)
+        {
+            const char** expected = HashTable_get(&hash_table,   translates[j].primary_word);
+            const char** given    = HashTable_get(&stream_table, translates[j].primary_word);
+
+            if (given == NULL || strcmp(*given, *expected))
+            {
+                printf("PRIMARY:%s\n", translates[j].primary_word);
+                passed = false;
+            }
+        }
+
+        HashTable_destruct(&stream_table);
+        StreamStorage_free(&storage);
+    }
+
+    HashTable_destruct(&hash_table);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef STREAM_LOAD
+
+/* Interactive mode, dictionary is loaded by pipeline */
+void StreamDictionary(const char* dictionary_path)
+{
+    StreamStorage storage = {};
+    HashTable hash_table = {};
+
+    if (HashTable_load_stream(&hash_table, &storage, dictionary_path, std::thread::hardware_concurrency()) != HASH_OK)
+        printf("Couldn't read database\n");
+    else
+        while (DictionaryHandler(&hash_table, NULL)) {}
+
+    HashTable_destruct(&hash_table);
+    StreamStorage_free(&storage);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef MULTIMAP_TEST
+
+const size_t MULTIMAP_TEST_EXTRA = 5;
+
+/* Dictionary with unique words loaded to multimap, words of every tenth line get extra translations */
+bool MultiMapLoad(HashMultiMap *multimap, DoubleWord *translates, size_t words_count)
+{
+    if (HashMultiMap_build(multimap, translates, words_count) != HASH_OK)
+        return false;
+
+    for (size_t i = 0; i < words_count; i += 10)
+    for (size_t j = 0; j < MULTIMAP_TEST_EXTRA; j++)
+        if (HashMultiMap_append(multimap, translates[i].primary_word, translates[(i + j + 1) % words_count].translated_word) != HASH_OK)
+            return false;
+
+    return true;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef MULTIMAP_TEST
+
+/* All translations come back in order of append */
+bool MultiMapTest(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    HashMultiMap multimap = {};
+    bool passed = MultiMapLoad(&multimap, translates, words_count);
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        ValueSpan span = HashMultiMap_get(&multimap, translates[i].primary_word);
+        size_t expected_count = (i % 10 == 0) ? 1 + MULTIMAP_TEST_EXTRA : 1;
+
+        const char *value = ValueSpan_first(span);
+        for (size_t j = 0; j < expected_count && passed; j++, value = ValueSpan_next(span, value))
+        {
+            const char *expected = translates[(i + j) % words_count].translated_word;
+            passed = (value != NULL && !strcmp(value, expected) && ValueSpan_length(value) == strlen(expected));
+        }
+
+        passed = passed && span.count == expected_count && value == NULL;
+
+        if (!passed)
+            printf("PRIMARY:%s\n", translates[i].primary_word);
+    }
+
+    char missing[MAX_LINE + 1] = "no such word in dictionary";
+    passed = passed && HashMultiMap_get(&multimap, missing).count == 0;
+
+    printf("values: %zu, arena: %zu bytes, moved runs: %zu bytes\n",
+           multimap.values_count, multimap.arena.allocated, multimap.arena.abandoned);
+
+    HashMultiMap_destruct(&multimap);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef MULTIMAP
+
+/* Interactive mode which prints all translations of word */
+void MultiMapDictionary(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    /* Repeated words of dictionary are all their translations */
+    HashMultiMap multimap = {};
+    if (HashMultiMap_build(&multimap, translates, words_count) != HASH_OK)
+        printf("Couldn't load database\n");
+
+    while (true)
+    {
+        char input[MAX_LINE + 1] = {0};
+        if (fgets(input, MAX_LINE, stdin) == NULL) break;
+
+        char* eol = strchr(input, '\n');
+        if (eol) *eol = '\0';
+
+        if (!strcmp(input, "EXIT")) break;
+
+        ValueSpan span = HashMultiMap_get(&multimap, input);
+        if (span.count == 0) printf("NULL");
+
+        for (const char *value = ValueSpan_first(span); value != NULL; value = ValueSpan_next(span, value))
+            printf((value == ValueSpan_first(span)) ? "%s" : "; %s", value);
+
+        printf("\n");
+    }
+
+    HashMultiMap_destruct(&multimap);
+    free(translates);
+    free(buffer);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef COMPACT_TEST
+
+const char COMPACT_TEST_IMAGE[] = "src/compact_test.bin";
+
+/* Compact table and its image must answer the same as HashTable, memory of both is printed */
+bool CompactTest(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    HashTable hash_table = {};
+    HashTable_build(&hash_table, translates, words_count);
+
+    CompactTable compact = {};
+    bool passed = (CompactTable_build(&compact, translates, words_count) == HASH_OK && compact.size == hash_table.size);
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        const char** expected = HashTable_get(&hash_table, translates[i].primary_word);
+        const char*  given    = CompactTable_get(&compact, translates[i].primary_word);
+
+        if (given == NULL || strcmp(given, *expected))
+        {
+            printf("PRIMARY:%s\n", translates[i].primary_word);
+            passed = false;
+        }
+    }
+
+    char missing[MAX_LINE + 1] = "no such word in dictionary";
+    passed = passed && CompactTable_get(&compact, missing) == NULL;
+
+    /* Loaded image must be the same table */
+    CompactTable loaded = {};
+    passed = passed && CompactTable_save(&compact, COMPACT_TEST_IMAGE) == HASH_OK &&
+                       CompactTable_load(&loaded, COMPACT_TEST_IMAGE) == HASH_OK;
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        const char* given = CompactTable_get(&loaded, translates[i].primary_word);
+
+        if (given == NULL || strcmp(given, CompactTable_get(&compact, translates[i].primary_word)))
+        {
+            printf("LOADED PRIMARY:%s\n", translates[i].primary_word);
+            passed = false;
+        }
+    }
+
+    CompactTable_destruct(&loaded);
+    remove(COMPACT_TEST_IMAGE);
+
+    printf("bytes per entry: HashTable %.1f, CompactTable %.1f (%.1f with copied strings)\n",
+           (double)HashTable_bytes(&hash_table) / hash_table.size,
+           (double)CompactTable_index_bytes(&compact) / compact.size, (double)CompactTable_bytes(&compact) / compact.size);
+
+    CompactTable_destruct(&compact);
+    HashTable_destruct(&hash_table);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef FUZZY_TEST
+
+const char   FUZZY_TEST_FIRST  = '!';
+const size_t FUZZY_TEST_SYMBOLS = '~' - '!' + 1;
+
+/* Every "ab??" word shares delete "ab" with "abcd", there are more of them than FUZZY_MAX_CANDIDATES,
+   so suggest must say that it's truncated. With one symbol after "ab" they fit */
+bool FuzzyTruncationTest()
+{
+    size_t words_count = FUZZY_TEST_SYMBOLS * FUZZY_TEST_SYMBOLS;
+
+    char       *words      = (char *)calloc(words_count, 8);
+    DoubleWord *translates = (DoubleWord *)calloc(words_count, sizeof(DoubleWord));
+    if (words == NULL || translates == NULL)
+    {
+        free(words);
+        free(translates);
+        return false;
+    }
+
+    bool passed = true;
+
+    for (size_t length = 3; length <= 4 && passed; length++)
+    {
+        size_t count = (length == 3) ? FUZZY_TEST_SYMBOLS : words_count;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            char *word = words + 8 * i;
+            memcpy(word, "ab", 2);
+
+            word[2] = FUZZY_TEST_FIRST + i % FUZZY_TEST_SYMBOLS;
+            word[3] = (length == 4) ? FUZZY_TEST_FIRST + i / FUZZY_TEST_SYMBOLS : '\0';
+
+            translates[i].primary_word = word;
+        }
+
+        FuzzyIndex fuzzy = {};
+        passed = (FuzzyIndex_construct(&fuzzy, translates, count) == HASH_OK);
+
+        FuzzySuggestion suggestions[FUZZY_SUGGESTIONS] = {};
+        bool truncated = false;
+        size_t found = FuzzyIndex_suggest(&fuzzy, "abcd", suggestions, FUZZY_SUGGESTIONS, &truncated);
+
+        if (passed && (found == 0 || truncated != (count > FUZZY_MAX_CANDIDATES)))
+        {
+            printf("FUZZY TRUNCATION: %zu words, %s\n", count, truncated ? "truncated" : "not truncated");
+            passed = false;
+        }
+
+        FuzzyIndex_destruct(&fuzzy);
+    }
+
+    free(words);
+    free(translates);
+
+    return passed;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Every FUZZY_TEST_STEP-th word is asked with one or two typos (misses go to suggestions like in
+   DictionaryHandler), the word itself must be suggested */
+bool FuzzyTest(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    HashTable hash_table = {};
+    HashTable_build(&hash_table, translates, words_count);
+
+    FuzzyIndex fuzzy = {};
+    bool passed = FuzzyTruncationTest() && (FuzzyIndex_construct(&fuzzy, translates, words_count) == HASH_OK);
+
+    size_t misses = 0, truncated_count = 0;
+    double total_us = 0, max_us = 0;
+
+    srand(FUZZY_TEST_STEP);
+    for (size_t i = 0; i < words_count && passed; i += FUZZY_TEST_STEP)
+    {
+        char typo[MAX_LINE + 1] = {0};
+        strncpy(typo, translates[i].primary_word, MAX_LINE - 2);
+        size_t len = strlen(typo);
+
+        /* Replace one character and delete or duplicate another one */
+        typo[rand() % len] = 'a' + rand() % 26;
+        size_t position = rand() % len;
+        if (i % 2) memmove(typo + position, typo + position + 1, len - position);
+        else       memmove(typo + position + 1, typo + position, len - position + 1);
+
+        if (HashTable_get(&hash_table, typo) != NULL)
+            continue;
+
+        misses++;
+
+        timespec start = {}, end = {};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        FuzzySuggestion suggestions[FUZZY_SUGGESTIONS] = {};
+        bool truncated = false;
+        size_t count = FuzzyIndex_suggest(&fuzzy, typo, suggestions, FUZZY_SUGGESTIONS, &truncated);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        truncated_count += truncated;
+
+        double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        total_us += us;
+        if (us > max_us) max_us = us;
+
+        bool found = false;
+        for (size_t j = 0; j < count; j++)
+            found = found || !strcmp(suggestions[j].word, translates[i].primary_word);
+
+        /* Suggestions are cut to FUZZY_SUGGESTIONS, so the word may be pushed out by not farther ones */
+        size_t distance = EditDistance(typo, translates[i].primary_word);
+
+        if (!found && (count < FUZZY_SUGGESTIONS || suggestions[count - 1].distance > distance))
+        {
+            printf("PRIMARY:%s\nTYPO:%s\n", translates[i].primary_word, typo);
+            passed = false;
+        }
+    }
+
+    printf("misses: %zu (%zu truncated), suggest: %.1f us average, %.1f us max, index: %.1f bytes per word\n",
+           misses, truncated_count, (misses) ? total_us / misses : 0, max_us,
+           (double)FuzzyIndex_bytes(&fuzzy) / words_count);
+
+    FuzzyIndex_destruct(&fuzzy);
+    HashTable_destruct(&hash_table);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef UPDATE_LOG_TEST
+
+const char   UPDATE_TEST_LOG[]       = "src/update_test.log";
+const char   UPDATE_TEST_OLD_LOG[]   = "src/update_test.log.old";
+const char   UPDATE_TEST_BASE[]      = "src/update_test.dic";
+const size_t UPDATE_TEST_THREADS     = 4;
+const size_t UPDATE_TEST_EDITS       = 3000;        /* of every thread */
+const size_t UPDATE_TEST_COMPACT     = 1 << 16;     /* small log: compactions are killed too */
+const size_t UPDATE_TEST_KILL_AFTER[] = {10, 1000, 9000};     /* acknowledged edits */
+const char   UPDATE_TEST_BASE_TMP[]  = "src/update_test.dic.tmp";     /* directory here breaks writing of base */
+const size_t UPDATE_TEST_FAILED_EDITS = 200;        /* before and after failed compaction */
+
+/* Edit number of thread: even ones put new word, odd ones remove word of dictionary */
+struct UpdateAck
+{
+    uint32_t thread;
+    uint32_t edit;
+};
+
+struct UpdateTestTable
+{
+    HashTable table;
+    char *buffer;
+    DoubleWord *translates;
+    size_t words_count;
+};
+
+//-----------------------------------------------------------------------------
+
+bool UpdateTestTable_load(UpdateTestTable *ths, const char *path)
+{
+    size_t buffer_size = ReadDataBase(path, &ths->buffer);
+    if (ths->buffer == NULL)
+        return false;
+
+    ths->words_count = GetEolCount(ths->buffer, buffer_size);
+    ths->translates  = Parser(ths->buffer, ths->words_count, buffer_size);
+
+    return HashTable_build(&ths->table, ths->translates, ths->words_count) == HASH_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+void UpdateTestTable_free(UpdateTestTable *ths)
+{
+    HashTable_destruct(&ths->table);
+    free(ths->translates);
+    free(ths->buffer);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Padded like words of dictionary */
+void UpdateTestKey(char *key, size_t thread, size_t edit)
+{
+    memset(key, 0, MAX_LINE + 1);
+    sprintf(key, "update_%zu_%zu", thread, edit);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Edit is done and sent to parent */
+bool UpdateTestEdit(UpdateLog *update_log, DoubleWord *translates, size_t thread, size_t edit, int ack_fd)
+{
+    char key[MAX_LINE + 1]   = {};
+    char value[MAX_LINE + 1] = {};
+
+    hash_error error = HASH_OK;
+
+    if (edit % 2 == 0)
+    {
+        UpdateTestKey(key, thread, edit);
+        sprintf(value, "value_%zu", edit);
+        error = UpdateLog_put(update_log, key, value);
+    }
+    else
+        error = UpdateLog_remove(update_log, translates[edit * UPDATE_TEST_THREADS + thread].primary_word);
+
+    UpdateAck ack = {(uint32_t)thread, (uint32_t)edit};
+
+    return error == HASH_OK && write(ack_fd, &ack, sizeof(ack)) == sizeof(ack);
+}
+
+//-----------------------------------------------------------------------------
+
+void UpdateTestWriter(UpdateLog *update_log, DoubleWord *translates, size_t thread, int ack_fd)
+{
+    for (size_t edit = 0; edit < UPDATE_TEST_EDITS; edit++)
+        if (!UpdateTestEdit(update_log, translates, thread, edit, ack_fd))
+            return;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Child process: edits go to log from several threads, every acknowledged one is sent to parent */
+void UpdateTestChild(int ack_fd)
+{
+    UpdateTestTable base = {};
+    UpdateLog update_log = {};
+
+    if (!UpdateTestTable_load(&base, UPDATE_TEST_BASE) ||
+        UpdateLog_open(&update_log, UPDATE_TEST_LOG, UPDATE_TEST_BASE, &base.table, UPDATE_TEST_COMPACT) != HASH_OK)
+        _exit(1);
+
+    std::thread writers[UPDATE_TEST_THREADS];
+    for (size_t i = 0; i < UPDATE_TEST_THREADS; i++)
+        writers[i] = std::thread(UpdateTestWriter, &update_log, base.translates, i, ack_fd);
+
+    for (size_t i = 0; i < UPDATE_TEST_THREADS; i++)
+        writers[i].join();
+
+    UpdateLog_close(&update_log);
+    _exit(0);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Child process: compaction can't write base, so old log stays. More edits go to log, the next
+   compaction can't write base either and mustn't replace old log. The one after it writes base
+   first, then child is killed before its own base is written */
+void UpdateTestFailedChild(int ack_fd)
+{
+    UpdateTestTable base = {};
+    UpdateLog update_log = {};
+
+    if (!UpdateTestTable_load(&base, UPDATE_TEST_BASE) ||
+        UpdateLog_open(&update_log, UPDATE_TEST_LOG, UPDATE_TEST_BASE, &base.table, 0) != HASH_OK)
+        _exit(1);
+
+    for (size_t edit = 0; edit < 2 * UPDATE_TEST_FAILED_EDITS; edit++)
+    {
+        if (!UpdateTestEdit(&update_log, base.translates, 0, edit, ack_fd))
+            _exit(1);
+
+        if (edit + 1 != UPDATE_TEST_FAILED_EDITS)
+            continue;
+
+        if (UpdateLog_compact(&update_log) != HASH_OK)
+            _exit(1);
+
+        update_log.compactor.join();
+    }
+
+    /* Broken base write removes empty directory as its temporary file, so the third one writes it */
+    if (mkdir(UPDATE_TEST_BASE_TMP, 0755) != 0 || UpdateLog_compact(&update_log) == HASH_OK ||
+        UpdateLog_compact(&update_log) != HASH_OK)
+        _exit(1);
+
+    kill(getpid(), SIGKILL);
+}
+
+//-----------------------------------------------------------------------------
+
+void UpdateTestReader(int ack_fd, bool *acked, std::atomic<size_t> *acked_count)
+{
+    UpdateAck ack = {};
+
+    while (read(ack_fd, &ack, sizeof(ack)) == sizeof(ack))
+    {
+        acked[ack.thread * UPDATE_TEST_EDITS + ack.edit] = true;
+        acked_count->fetch_add(1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Recovered table has every acknowledged edit, the other words of dictionary aren't changed */
+bool UpdateTestCheck(HashTable *table, DoubleWord *translates, size_t words_count, bool *acked)
+{
+    char key[MAX_LINE + 1]   = {};
+    char value[MAX_LINE + 1] = {};
+
+    for (size_t thread = 0; thread < UPDATE_TEST_THREADS; thread++)
+    for (size_t edit   = 0; edit   < UPDATE_TEST_EDITS;   edit++)
+    {
+        if (!acked[thread * UPDATE_TEST_EDITS + edit])
+            continue;
+
+        const char **found = NULL;
+
+        if (edit % 2 == 0)
+        {
+            UpdateTestKey(key, thread, edit);
+            sprintf(value, "value_%zu", edit);
+
+            found = HashTable_get(table, key);
+            if (found == NULL || strcmp(*found, value))
+            {
+                printf("LOST PUT:%s\n", key);
+                return false;
+            }
+        }
+        else if ((found = HashTable_get(table, translates[edit * UPDATE_TEST_THREADS + thread].primary_word)) != NULL)
+        {
+            printf("LOST REMOVE:%s\n", translates[edit * UPDATE_TEST_THREADS + thread].primary_word);
+            return false;
+        }
+    }
+
+    for (size_t i = UPDATE_TEST_THREADS * UPDATE_TEST_EDITS; i < words_count; i++)
+    {
+        const char **found = HashTable_get(table, translates[i].primary_word);
+
+        if (found == NULL || strcmp(*found, translates[i].translated_word))
+        {
+            printf("CHANGED:%s\n", translates[i].primary_word);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Every acknowledged edit of UpdateTestFailedChild is recovered */
+bool UpdateTestFailedCompaction(UpdateTestTable *original, HashTableEl *elements, bool *acked)
+{
+    memset(acked, 0, UPDATE_TEST_THREADS * UPDATE_TEST_EDITS * sizeof(bool));
+    remove(UPDATE_TEST_LOG);
+    remove(UPDATE_TEST_OLD_LOG);
+
+    int ack_pipe[2] = {};
+    fflush(stdout);
+
+    if (!UpdateLog_write_base(UPDATE_TEST_BASE, elements, original->words_count) ||
+        mkdir(UPDATE_TEST_BASE_TMP, 0755) != 0 || pipe(ack_pipe) != 0)
+        return false;
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(ack_pipe[0]);
+        UpdateTestFailedChild(ack_pipe[1]);
+    }
+
+    close(ack_pipe[1]);
+
+    std::atomic<size_t> acked_count(0);
+    UpdateTestReader(ack_pipe[0], acked, &acked_count);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    close(ack_pipe[0]);
+    rmdir(UPDATE_TEST_BASE_TMP);
+
+    UpdateTestTable recovered = {};
+    UpdateLog update_log = {};
+
+    bool passed = WIFSIGNALED(status) && acked_count.load() == 2 * UPDATE_TEST_FAILED_EDITS &&
+                  UpdateTestTable_load(&recovered, UPDATE_TEST_BASE) &&
+                  UpdateLog_open(&update_log, UPDATE_TEST_LOG, UPDATE_TEST_BASE, &recovered.table) == HASH_OK &&
+                  UpdateTestCheck(&recovered.table, original->translates, original->words_count, acked);
+
+    printf("failed compaction: %zu edits acknowledged, %zu replayed\n", acked_count.load(), update_log.replayed_count);
+
+    UpdateLog_close(&update_log);
+    UpdateTestTable_free(&recovered);
+    remove(UPDATE_TEST_OLD_LOG);
+
+    return passed;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Base copy of dictionary is edited by child process which is killed at some moment,
+   then base and log are recovered. At last recovered table is compacted and loaded without log.
+   Then compaction which couldn't write base is followed by another one and kill */
+bool UpdateLogTest(const char* dictionary_path)
+{
+    UpdateTestTable original = {};
+    if (!UpdateTestTable_load(&original, dictionary_path) || original.words_count < UPDATE_TEST_THREADS * UPDATE_TEST_EDITS)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    HashTableEl *elements = (HashTableEl *)calloc(original.words_count, sizeof(HashTableEl));
+    for (size_t i = 0; i < original.words_count; i++)
+        elements[i] = {original.translates[i].primary_word, original.translates[i].translated_word};
+
+    bool *acked  = (bool *)calloc(UPDATE_TEST_THREADS * UPDATE_TEST_EDITS, sizeof(bool));
+    bool passed  = true;
+
+    size_t rounds_count = sizeof(UPDATE_TEST_KILL_AFTER) / sizeof(UPDATE_TEST_KILL_AFTER[0]);
+
+    for (size_t round = 0; round < rounds_count && passed; round++)
+    {
+        memset(acked, 0, UPDATE_TEST_THREADS * UPDATE_TEST_EDITS * sizeof(bool));
+        remove(UPDATE_TEST_LOG);
+        remove(UPDATE_TEST_OLD_LOG);
+        passed = UpdateLog_write_base(UPDATE_TEST_BASE, elements, original.words_count);
+
+        int ack_pipe[2] = {};
+        fflush(stdout);
+
+        if (!passed || pipe(ack_pipe) != 0)
+            break;
+
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close(ack_pipe[0]);
+            UpdateTestChild(ack_pipe[1]);
+        }
+
+        close(ack_pipe[1]);
+
+        std::atomic<size_t> acked_count(0);
+        std::thread reader(UpdateTestReader, ack_pipe[0], acked, &acked_count);
+
+        /* Child may finish before, then it's killed after clean close */
+        while (acked_count.load() < UPDATE_TEST_KILL_AFTER[round] && waitpid(child, NULL, WNOHANG) == 0)
+            usleep(100);
+
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+
+        reader.join();
+        close(ack_pipe[0]);
+
+        UpdateTestTable recovered = {};
+        UpdateLog update_log = {};
+
+        passed = UpdateTestTable_load(&recovered, UPDATE_TEST_BASE) &&
+                 UpdateLog_open(&update_log, UPDATE_TEST_LOG, UPDATE_TEST_BASE, &recovered.table) == HASH_OK &&
+                 UpdateTestCheck(&recovered.table, original.translates, original.words_count, acked);
+
+        printf("killed: %zu edits acknowledged, %zu replayed\n", acked_count.load(), update_log.replayed_count);
+
+        /* The last recovered table is written to base, the same words are there without log */
+        if (passed && round + 1 == rounds_count)
+        {
+            passed = UpdateLog_compact(&update_log) == HASH_OK && UpdateLog_close(&update_log) == HASH_OK;
+            UpdateTestTable_free(&recovered);
+
+            recovered = {};
+            passed = passed && remove(UPDATE_TEST_LOG) == 0 && UpdateTestTable_load(&recovered, UPDATE_TEST_BASE) &&
+                     UpdateTestCheck(&recovered.table, original.translates, original.words_count, acked);
+        }
+
+        UpdateLog_close(&update_log);
+        UpdateTestTable_free(&recovered);
+    }
+
+    passed = passed && UpdateTestFailedCompaction(&original, elements, acked);
+
+    remove(UPDATE_TEST_LOG);
+    remove(UPDATE_TEST_BASE);
+
+    free(acked);
+    free(elements);
+    UpdateTestTable_free(&original);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#if defined(SHARED_TABLE) || defined(SHARED_TABLE_TEST)
+
+/* Compact table of first words_count words is published by name */
+bool SharedTableLoad(const char *name, DoubleWord *translates, size_t words_count)
+{
+    CompactTable compact = {};
+    bool published = CompactTable_build(&compact, translates, words_count) == HASH_OK &&
+                     SharedTable_publish(name, &compact) == HASH_OK;
+
+    CompactTable_destruct(&compact);
+    return published;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef SHARED_TABLE
+
+bool SharedDictionaryLoad(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+        return false;
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    bool published = SharedTableLoad(SHARED_TABLE_NAME, translates, words_count);
+
+    free(translates);
+    free(buffer);
+
+    return published;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Interactive mode of one of many processes: table is built only by the first one which doesn't find it,
+   the others attach. Every word is asked in the latest published table */
+void SharedDictionary(const char* dictionary_path)
+{
+    SharedTable shared = {};
+
+    if (SharedTable_attach(&shared, SHARED_TABLE_NAME) != HASH_OK &&
+        (!SharedDictionaryLoad(dictionary_path) || SharedTable_attach(&shared, SHARED_TABLE_NAME) != HASH_OK))
+    {
+        printf("Couldn't load database\n");
+        return;
+    }
+
+    while (true)
+    {
+        char input[MAX_LINE + 1] = {0};
+        if (fgets(input, MAX_LINE, stdin) == NULL) break;
+
+        char* eol = strchr(input, '\n');
+        if (eol) *eol = '\0';
+
+        if (!strcmp(input, "EXIT")) break;
+
+        if (!strcmp(input, "PUBLISH"))
+        {
+            printf(SharedDictionaryLoad(dictionary_path) ? "OK\n" : "ERROR\n");
+            continue;
+        }
+
+        SharedTable_refresh(&shared);
+
+        const char *value = SharedTable_get(&shared, input);
+        printf("%s\n", (value == NULL) ? "NULL" : value);
+    }
+
+    SharedTable_detach(&shared);
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef SHARED_TABLE_TEST
+
+const char   SHARED_TEST_NAME[]  = "/dictionary_test";
+const size_t SHARED_TEST_WORKERS = 4;
+
+/* Shared table must answer as HashTable of the same words, misses included */
+bool SharedTestCheck(SharedTable *shared, HashTable *expected, DoubleWord *translates, size_t words_count)
+{
+    for (size_t i = 0; i < words_count; i++)
+    {
+        const char** value = HashTable_get(expected, translates[i].primary_word);
+        const char*  given = SharedTable_get(shared, translates[i].primary_word);
+
+        if ((value == NULL) != (given == NULL) || (given != NULL && strcmp(given, *value)))
+        {
+            printf("PRIMARY:%s\n", translates[i].primary_word);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Worker checks the first image, then parent publishes the second one (half of words).
+   Old image must be readable until refresh, after it worker must see the new one */
+bool SharedTestWorker(HashTable *first, HashTable *second, DoubleWord *translates, size_t words_count,
+                      int ready_fd, int go_fd)
+{
+    SharedTable shared = {};
+    if (SharedTable_attach(&shared, SHARED_TEST_NAME) != HASH_OK)
+        return false;
+
+    bool passed = shared.generation == 1 && SharedTestCheck(&shared, first, translates, words_count);
+
+    char byte = passed;
+    passed = write(ready_fd, &byte, 1) == 1 && passed;
+
+    /* End of file when second image is published */
+    while (read(go_fd, &byte, 1) > 0);
+
+    passed = passed && SharedTestCheck(&shared, first, translates, words_count) &&
+             SharedTable_refresh(&shared) == HASH_OK && shared.generation == 2 &&
+             SharedTestCheck(&shared, second, translates, words_count);
+
+    SharedTable_detach(&shared);
+    return passed;
+}
+
+//-----------------------------------------------------------------------------
+
+bool SharedTableTest(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    HashTable first  = {};
+    HashTable second = {};
+    HashTable_build(&first, translates, words_count);
+    HashTable_build(&second, translates, words_count / 2);
+
+    /* Left by killed test */
+    SharedTable_unlink(SHARED_TEST_NAME);
+
+    int ready_pipe[2] = {-1, -1};
+    int go_pipe[2]    = {-1, -1};
+
+    bool passed = SharedTableLoad(SHARED_TEST_NAME, translates, words_count) &&
+                  pipe(ready_pipe) == 0 && pipe(go_pipe) == 0;
+
+    pid_t workers[SHARED_TEST_WORKERS] = {};
+
+    for (size_t i = 0; i < SHARED_TEST_WORKERS && passed; i++)
+    {
+        workers[i] = fork();
+
+        if (workers[i] == 0)
+        {
+            close(ready_pipe[0]);
+            close(go_pipe[1]);
+            _exit(SharedTestWorker(&first, &second, translates, words_count, ready_pipe[1], go_pipe[0]) ? 0 : 1);
+        }
+
+        passed = workers[i] > 0;
+    }
+
+    close(ready_pipe[1]);
+    close(go_pipe[0]);
+
+    for (size_t i = 0; i < SHARED_TEST_WORKERS && passed; i++)
+    {
+        char byte = 0;
+        passed = read(ready_pipe[0], &byte, 1) == 1 && byte;
+    }
+
+    SharedTable shared = {};
+    passed = passed && SharedTableLoad(SHARED_TEST_NAME, translates, words_count / 2) &&
+             SharedTable_attach(&shared, SHARED_TEST_NAME) == HASH_OK && shared.generation == 2;
+
+    /* Name of the first image is removed, its pages live while workers map it */
+    char old_segment[SHARED_TABLE_NAME_MAX] = {};
+    SharedTable_segment_name(SHARED_TEST_NAME, 1, old_segment);
+
+    int old_fd = shm_open(old_segment, O_RDONLY, 0);
+    if (old_fd >= 0)
+    {
+        printf("OLD IMAGE ISN'T UNLINKED\n");
+        close(old_fd);
+        passed = false;
+    }
+
+    close(go_pipe[1]);
+    close(ready_pipe[0]);
+
+    for (size_t i = 0; i < SHARED_TEST_WORKERS; i++)
+    {
+        int status = 0;
+        if (workers[i] > 0 && (waitpid(workers[i], &status, 0) != workers[i] ||
+                               !WIFEXITED(status) || WEXITSTATUS(status) != 0))
+            passed = false;
+    }
+
+    printf("shared image: %.1f MB for %zu workers, private HashTable: %.1f MB each\n",
+           (double)shared.image_size / (1 << 20), SHARED_TEST_WORKERS,
+           (double)HashTable_bytes(&first) / (1 << 20));
+
+    SharedTable_detach(&shared);
+    SharedTable_unlink(SHARED_TEST_NAME);
+
+    HashTable_destruct(&second);
+    HashTable_destruct(&first);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef NORMALIZED_TEST
+
+const size_t KEY_FOLD_TEST_MAX = 64;
+
+/* Every query must be found as its word */
+struct KeyFoldCase
+{
+    const char *word;
+    const char *query;
+};
+
+const KeyFoldCase KEY_FOLD_TEST_CASES[] = {
+    {"apple",        "Apple"},
+    {"apple",        "APPLE"},
+    {"café",         "CAFÉ"},
+    {"café",         "cafe\xCC\x81"},                /* NFD */
+    {"café",         "CAFE\xCC\x81"},
+    {"encyclopédie", "ENCYCLOPÉDIE"},                /* not ASCII in the second word */
+    {"encyclopédie", "Encyclope\xCC\x81" "die"},
+    {"żółw",         "ŻÓŁW"},
+    {"ёжик",         "ЁЖИК"},
+    {"ёжик",         "е\xCC\x88жик"},
+    {"σοφία",        "ΣΟΦΊΑ"},
+    {"über",         "U\xCC\x88" "BER"},
+    {"abcdefgé",     "abcdefge\xCC\x81"},           /* mark begins the next word */
+    {"abcdefgéxyz",  "abcdefgE\xCC\x81" "xyz"},
+    {"abcdefghijklmnoé", "abcdefghijklmnoe\xCC\x81"}
+};
+
+//-----------------------------------------------------------------------------
+
+/* Front end way: every char is lowered before ordinary hashing */
+unsigned long long KeyFoldTest_tolower_hash(const char *key, char *folded)
+{
+    size_t i = 0;
+    for (; key[i]; i++)
+        folded[i] = (key[i] >= 'A' && key[i] <= 'Z') ? key[i] + ('a' - 'A') : key[i];
+
+    memset(folded + i, 0, (i + 7) / 8 * 8 + 1 - i);
+
+    return HashingFunction(folded);
+}
+
+//-----------------------------------------------------------------------------
+
+bool KeyFoldTest(const char* dictionary_path)
+{
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(dictionary_path, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return false;
+    }
+
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+    HashTable original = {};
+    HashTable_build(&original, translates, words_count);
+
+    KeyFold_translates(translates, words_count);
+
+    HashTable hash_table = {};
+    HashTable_build(&hash_table, translates, words_count);
+
+    const size_t cases_count = sizeof(KEY_FOLD_TEST_CASES) / sizeof(KEY_FOLD_TEST_CASES[0]);
+    char words[cases_count][KEY_FOLD_TEST_MAX] = {};
+
+    for (size_t i = 0; i < cases_count; i++)
+    {
+        strcpy(words[i], KEY_FOLD_TEST_CASES[i].word);
+        KeyFold(words[i], words[i]);
+        HashTable_put(&hash_table, words[i], KEY_FOLD_TEST_CASES[i].word);
+    }
+
+    bool passed = true;
+
+    for (size_t i = 0; i < cases_count; i++)
+    {
+        char query[KEY_FOLD_TEST_MAX] = {};
+        strcpy(query, KEY_FOLD_TEST_CASES[i].query);
+
+        /* One pass must give the same key and hash as folding and then hashing */
+        char folded_query[KEY_FOLD_TEST_MAX] = {};
+        char expected_query[KEY_FOLD_TEST_MAX] = {};
+        strcpy(expected_query, KEY_FOLD_TEST_CASES[i].query);
+        KeyFold(expected_query, expected_query);
+
+        bool same_hash = KeyFold_hash(query, folded_query) == HashingFunction(expected_query) &&
+                         !strcmp(folded_query, expected_query);
+
+        const char** value = HashTable_get_folded(&hash_table, query);
+        if (!same_hash || value == NULL || strcmp(*value, KEY_FOLD_TEST_CASES[i].word))
+        {
+            printf("QUERY:%s\n", KEY_FOLD_TEST_CASES[i].query);
+            passed = false;
+        }
+    }
+
+    /* Words of dictionary in upper case and with every other letter capital */
+    char *queries = (char *)calloc(words_count, KEY_FOLD_TEST_MAX);
+    char *folded  = (char *)calloc(words_count, KEY_FOLD_TEST_MAX);
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        const char *word  = translates[i].primary_word;
+        char       *query = queries + i * KEY_FOLD_TEST_MAX;
+
+        if (strlen(word) + 8 >= KEY_FOLD_TEST_MAX)
+            continue;
+
+        for (size_t j = 0; word[j]; j++)
+            query[j] = (i % 2 == 0 || j % 2 == 0) ? toupper(word[j]) : word[j];
+
+        const char** expected = HashTable_get(&original, word);
+        const char** given    = HashTable_get_folded(&hash_table, query);
+
+        if (given == NULL || strcmp(*given, *expected) || strcmp(query, word))
+        {
+            printf("PRIMARY:%s\n", word);
+            passed = false;
+        }
+
+        for (size_t j = 0; word[j]; j++)
+            query[j] = toupper(word[j]);
+    }
+
+    char missing[KEY_FOLD_TEST_MAX] = "NO SUCH WORD IN DICTIONARY";
+    passed = passed && HashTable_get_folded(&hash_table, missing) == NULL;
+
+    unsigned long long check = 0;
+    memset(folded, 0, words_count * KEY_FOLD_TEST_MAX);          /* pages are touched before timing */
+
+    clock_t start = clock();
+    for (size_t i = 0; i < words_count; i++)
+        check += KeyFold_hash(queries + i * KEY_FOLD_TEST_MAX, folded + i * KEY_FOLD_TEST_MAX);
+    clock_t middle = clock();
+    for (size_t i = 0; i < words_count; i++)
+        check -= KeyFoldTest_tolower_hash(queries + i * KEY_FOLD_TEST_MAX, folded + i * KEY_FOLD_TEST_MAX);
+    clock_t end = clock();
+
+    passed = passed && check == 0;
+
+    printf("fold and hash: one pass %.3f ms, tolower loop and hash %.3f ms\n",
+           1000.0 * (middle - start) / CLOCKS_PER_SEC, 1000.0 * (end - middle) / CLOCKS_PER_SEC);
+
+    free(folded);
+    free(queries);
+    HashTable_destruct(&hash_table);
+    HashTable_destruct(&original);
+    free(translates);
+    free(buffer);
+
+    printf(passed ? "TEST HAS PASSED\n" : "TEST HASN'T PASSED\n");
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+#ifdef EMBEDDED_TEST
+
+/* Table made by compiler must answer the same as table built at runtime from the same words */
+bool EmbeddedTest()
+{
+    size_t words_count = sizeof(EMBEDDED_WORDS_elements) / sizeof(EMBEDDED_WORDS_elements[0]);
+
+    HashTable hash_table = {};
+    HashTable_construct(&hash_table, 100);
+
+    for (size_t i = 0; i < words_count; i++)
+        HashTable_put(&hash_table, EMBEDDED_WORDS_elements[i].key, EMBEDDED_WORDS_elements[i].value);
+
+    bool passed = (hash_table.size == EMBEDDED_WORDS.size);
+
+    for (size_t i = 0; i < words_count && passed; i++)
+    {
+        const char** expected = HashTable_get(&hash_table,    EMBEDDED_WORDS_elements[i].key);
+        const char** given    = HashTable_get(&EMBEDDED_WORDS, EMBEDDED_WORDS_elements[i].key);
+
+        if (given == NULL || strcmp(*given, *expected))
+        {
+            printf("TEST HASN'T PASSED\n"
+                   "PRIMARY:%s\n", EMBEDDED_WORDS_elements[i].key);
+            passed = false;
+        }
+    }
+
+    char missing[MAX_LINE + 1] = "no such word in embedded dictionary";
+    if (passed && HashTable_get(&EMBEDDED_WORDS, missing) != NULL)
+    {
+        printf("TEST HASN'T PASSED\n"
+               "MISSING WORD FOUND\n");
+        passed = false;
+    }
+
+    if (passed)
+        printf("TEST HAS PASSED\n");
+
+    HashTable_destruct(&hash_table);
+    return passed;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+
+int main()
+{
+
+#ifdef PLOT
+    GetGraph("src/dictionary.dic");
+
+    return 0;
+#elif RELOAD_TEST
+    ReloadTest("src/dictionary.dic");
+
+    return 0;
+#elif EMBEDDED_TEST
+    EmbeddedTest();
+
+    return 0;
+#elif STREAM_TEST
+    StreamTest("src/dictionary.dic");
+
+    return 0;
+#elif STREAM_LOAD
+    StreamDictionary("src/dictionary.dic");
+
+    return 0;
+#elif MULTIMAP_TEST
+    MultiMapTest("src/dictionary.dic");
+
+    return 0;
+#elif MULTIMAP
+    MultiMapDictionary("src/dictionary.dic");
+
+    return 0;
+#elif COMPACT_TEST
+    CompactTest("src/dictionary.dic");
+
+    return 0;
+#elif FUZZY_TEST
+    FuzzyTest("src/dictionary.dic");
+
+    return 0;
+#elif UPDATE_LOG_TEST
+    UpdateLogTest("src/dictionary.dic");
+
+    return 0;
+#elif SHARED_TABLE
+    SharedDictionary("src/dictionary.dic");
+
+    return 0;
+#elif SHARED_TABLE_TEST
+    SharedTableTest("src/dictionary.dic");
+
+    return 0;
+#elif NORMALIZED_TEST
+    KeyFoldTest("src/dictionary.dic");
+
+    return 0;
+#else
+
+#ifdef LATENCY_HISTOGRAMS
+    /* Before build, so its threads don't take the signal */
+    Latency_dump_on_signal(SIGUSR1);
+#endif
+
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase("src/dictionary.dic", &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return 0;
+    }
+    
+    size_t      words_count = GetEolCount(buffer, buffer_size);
+    DoubleWord *translates  = Parser(buffer, words_count, buffer_size);
+
+#ifdef NORMALIZED
+    KeyFold_translates(translates, words_count);
+#endif
+    
+    size_t threads_count = std::thread::hardware_concurrency();
+
+    HashTable hash_table = {};
+    HashTable_build_parallel(&hash_table, translates, words_count, threads_count);
+
+#ifdef REORDER
+    ReorderByQueryLog(&hash_table);
+#endif
+
+#ifdef SPEED_TEST
+    int pls_dont_optimize = SpeedTest(&hash_table, translates, words_count);
+    if (pls_dont_optimize) printf("Get returned NULL in Speed test\n");
+
+#ifdef LATENCY_HISTOGRAMS
+    Latency_dump(stdout);
+#endif
+#elif  MAIN_TEST
+    HashTable sequential_table = {};
+    HashTable_build(&sequential_table, translates, words_count);
+#ifdef REORDER
+    ReorderByQueryLog(&sequential_table);
+    CuckooReorderTest(translates, words_count);
+#endif
+
+    if (!HashTable_equal(&hash_table, &sequential_table))
+        printf("PARALLEL BUILD DIFFERS FROM SEQUENTIAL ONE\n");
+
+    HashTable_destruct(&sequential_table);
+
+    MainTest(&hash_table, translates, words_count);
+#else  
+    QueryLog query_log = {};
+
+#ifdef QUERY_LOG
+    if (QueryLog_open(&query_log, QUERY_LOG_PATH) != HASH_OK)
+        printf("Couldn't open query log\n");
+#endif
+
+    FuzzyIndex fuzzy = {};
+
+#ifdef FUZZY
+    if (FuzzyIndex_construct(&fuzzy, translates, words_count) != HASH_OK)
+        printf("Couldn't build fuzzy index\n");
+#endif
+
+    UpdateLog update_log = {};
+    bool update_log_opened = false;
+
+#ifdef UPDATE_LOG
+    update_log_opened = (UpdateLog_open(&update_log, UPDATE_LOG_PATH, "src/dictionary.dic", &hash_table) == HASH_OK);
+    if (!update_log_opened)
+        printf("Couldn't open update log\n");
+#endif
+
+    while (DictionaryHandler(&hash_table, (query_log.file) ? &query_log : NULL,
+                             (fuzzy.entries) ? &fuzzy : NULL, (update_log_opened) ? &update_log : NULL)) {}
+
+    UpdateLog_close(&update_log);
+    FuzzyIndex_destruct(&fuzzy);
+    QueryLog_close(&query_log);
 #endif
 
     free(translates);
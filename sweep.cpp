@@ -0,0 +1,590 @@
+#include "include/hash_table.hpp"
+#include "include/dictionary.hpp"
+#include "include/hash_functions.hpp"
+#include "include/cuckoo_table.hpp"
+#include "include/art.hpp"
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <atomic>
+#include <thread>
+
+/*
+Parameter sweep. Dictionary is parsed once, then every combination of engine, hash function,
+load factor, key padding and batch size is built and measured several times. Independent
+configurations run in parallel, results are written to <out>.csv and <out>.json with 95%
+confidence intervals. Usage example:
+    ./sweep --engine chain,cuckoo --hash default,djb2 --lf 1.0:0.2:0.05 --padding 8,32 --threads 4
+*/
+
+const size_t SWEEP_MAX_VALUES = 256;
+const unsigned SWEEP_SEED     = 42;
+
+struct SweepHash
+{
+    const char  *name;
+    HashFunction function;
+};
+
+const SweepHash SweepHashes[] = {
+    {"default",  HashingFunction},
+    {"djb2",     Djb2Hash},
+    {"fnv1a",    Fnv1aHash},
+    {"crc32_u8", Crc32ByteHash}
+};
+
+typedef enum sweep_engine_en
+{
+    SWEEP_CHAIN  = 0,
+    SWEEP_CUCKOO = 1,
+    SWEEP_ART    = 2
+} sweep_engine;
+
+const char* SweepEngines[] = {"chain", "cuckoo", "art"};
+
+struct SweepAxes
+{
+    double load_factors[SWEEP_MAX_VALUES];
+    size_t load_factors_count;
+
+    size_t hashes[SWEEP_MAX_VALUES];
+    size_t hashes_count;
+
+    size_t engines[SWEEP_MAX_VALUES];
+    size_t engines_count;
+
+    size_t paddings[SWEEP_MAX_VALUES];
+    size_t paddings_count;
+
+    size_t batches[SWEEP_MAX_VALUES];
+    size_t batches_count;
+
+    size_t threads;
+    size_t trials;
+    size_t repeat;
+
+    const char *dictionary;
+    const char *out;
+};
+
+struct SweepConfig
+{
+    sweep_engine engine;
+    size_t hash;
+    double load_factor;
+    size_t padding;
+    size_t batch;
+
+    double build_ms;
+    double mean_ns;       /* Per lookup */
+    double stddev_ns;
+    double ci95_ns;
+    bool   failed;
+};
+
+/* Keys of dictionary copied with another padding */
+struct SweepKeys
+{
+    size_t   padding;
+    char    *buffer;
+    KeyType *keys;        /* Dictionary order, for building */
+    KeyType *shuffled;    /* For lookups */
+};
+
+struct SweepContext
+{
+    SweepAxes   *axes;
+    DoubleWord  *translates;
+    size_t       words_count;
+
+    SweepKeys   *keys;
+    SweepConfig *configs;
+    size_t       configs_count;
+
+    std::atomic<size_t> next_config;
+    std::atomic<size_t> done_count;
+};
+
+//-----------------------------------------------------------------------------
+
+double SweepNow()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Two-sided 95% quantile of Student's distribution */
+double StudentQuantile(size_t degrees)
+{
+    static const double quantiles[] = {0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                          2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                          2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+    return (degrees < sizeof(quantiles) / sizeof(quantiles[0])) ? quantiles[degrees] : 1.960;
+}
+
+//-----------------------------------------------------------------------------
+
+void SweepKeys_construct(SweepKeys *ths, DoubleWord *translates, size_t words_count, size_t padding)
+{
+    size_t buffer_size = 0;
+    for (size_t i = 0; i < words_count; i++)
+        buffer_size += (strlen(translates[i].primary_word) / padding + 1) * padding;
+
+    ths->padding  = padding;
+    ths->buffer   = (char *)calloc(buffer_size, sizeof(char));
+    ths->keys     = (KeyType *)calloc(words_count, sizeof(KeyType));
+    ths->shuffled = (KeyType *)calloc(words_count, sizeof(KeyType));
+
+    /* At least one zero after every key, then zeros up to padding */
+    char *ptr = ths->buffer;
+    for (size_t i = 0; i < words_count; i++)
+    {
+        size_t len = strlen(translates[i].primary_word);
+        memcpy(ptr, translates[i].primary_word, len);
+
+        ths->keys[i] = ptr;
+        ths->shuffled[i] = ptr;
+        ptr += (len / padding + 1) * padding;
+    }
+
+    srand(SWEEP_SEED);
+    for (size_t i = words_count - 1; i > 0; i--)
+    {
+        size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+        KeyType tmp = ths->shuffled[i];
+        ths->shuffled[i] = ths->shuffled[j];
+        ths->shuffled[j] = tmp;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void SweepKeys_destruct(SweepKeys *ths)
+{
+    free(ths->buffer);
+    free(ths->keys);
+    free(ths->shuffled);
+}
+
+//-----------------------------------------------------------------------------
+
+void SweepRun(SweepContext *context, SweepConfig *config)
+{
+    SweepAxes  *axes        = context->axes;
+    size_t      words_count = context->words_count;
+    SweepKeys  *keys        = NULL;
+
+    for (size_t i = 0; i < axes->paddings_count; i++)
+        if (context->keys[i].padding == config->padding)
+            keys = &context->keys[i];
+
+    HashTable   chain  = {};
+    CuckooTable cuckoo = {};
+    ArtTree     art    = {};
+
+    double start = SweepNow();
+
+    switch (config->engine)
+    {
+        case SWEEP_CHAIN:
+            HashTable_construct(&chain, words_count / config->load_factor + 1);
+            HashTable_set_hash(&chain, SweepHashes[config->hash].function);
+            /* Load factor is fixed for whole measurement */
+            chain.max_load_factor = INFINITY;
+            for (size_t i = 0; i < words_count; i++)
+                HashTable_put(&chain, keys->keys[i], context->translates[i].translated_word);
+            break;
+
+        case SWEEP_CUCKOO:
+            CuckooTable_allocate(&cuckoo, words_count / (CUCKOO_BUCKET_SIZE * fmin(config->load_factor, CuckooLoadFactor)) + 2);
+            CuckooTable_set_hash(&cuckoo, SweepHashes[config->hash].function);
+            for (size_t i = 0; i < words_count; i++)
+                CuckooTable_put(&cuckoo, keys->keys[i], context->translates[i].translated_word);
+            break;
+
+        case SWEEP_ART:
+            ArtTree_construct(&art);
+            for (size_t i = 0; i < words_count; i++)
+                ArtTree_put(&art, keys->keys[i], context->translates[i].translated_word);
+            break;
+
+        default:
+            break;
+    }
+
+    config->build_ms = (SweepNow() - start) / 1e6;
+
+    ValueType *values[HASH_BATCH_MAX] = {};
+    double sum = 0;
+    double sum_squares = 0;
+
+    for (size_t trial = 0; trial < axes->trials && !config->failed; trial++)
+    {
+        start = SweepNow();
+
+        for (size_t r = 0; r < axes->repeat; r++)
+        for (size_t i = 0; i < words_count; i += config->batch)
+        {
+            size_t batch = (words_count - i < config->batch) ? words_count - i : config->batch;
+
+            switch (config->engine)
+            {
+                case SWEEP_CHAIN:
+                    if (batch == 1)
+                        values[0] = HashTable_get(&chain, keys->shuffled[i]);
+                    else
+                        HashTable_get_batch(&chain, keys->shuffled + i, batch, values);
+                    break;
+                case SWEEP_CUCKOO:
+                    values[0] = CuckooTable_get(&cuckoo, keys->shuffled[i]);
+                    break;
+                case SWEEP_ART:
+                    values[0] = ArtTree_get(&art, keys->shuffled[i]);
+                    break;
+                default:
+                    break;
+            }
+
+            for (size_t j = 0; j < batch; j++)
+                if (values[j] == NULL)
+                    config->failed = true;
+        }
+
+        double ns = (SweepNow() - start) / (axes->repeat * words_count);
+        sum += ns;
+        sum_squares += ns * ns;
+    }
+
+    size_t trials = axes->trials;
+    config->mean_ns   = sum / trials;
+    config->stddev_ns = (trials > 1) ? sqrt(fmax(0, (sum_squares - trials * config->mean_ns * config->mean_ns) / (trials - 1))) : 0;
+    config->ci95_ns   = StudentQuantile(trials - 1) * config->stddev_ns / sqrt(trials);
+
+    HashTable_destruct(&chain);
+    CuckooTable_destruct(&cuckoo);
+    ArtTree_destruct(&art);
+}
+
+//-----------------------------------------------------------------------------
+
+void SweepWorker(SweepContext *context)
+{
+    size_t curr = 0;
+
+    while ((curr = context->next_config.fetch_add(1)) < context->configs_count)
+    {
+        SweepConfig *config = &context->configs[curr];
+        SweepRun(context, config);
+
+        size_t done = context->done_count.fetch_add(1) + 1;
+        printf("[%zu/%zu] %-6s %-8s lf=%.3f padding=%zu batch=%zu: %.2f +- %.2f ns%s\n",
+               done, context->configs_count, SweepEngines[config->engine],
+               (config->engine == SWEEP_ART) ? "none" : SweepHashes[config->hash].name,
+               config->load_factor, config->padding, config->batch, config->mean_ns, config->ci95_ns,
+               (config->failed) ? " FAILED" : "");
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/* Only axes which engine really uses are swept, others take first value */
+size_t SweepGenerate(SweepAxes *axes, SweepConfig *configs)
+{
+    size_t count = 0;
+
+    for (size_t e = 0; e < axes->engines_count; e++)
+    {
+        sweep_engine engine = (sweep_engine)axes->engines[e];
+
+        size_t hashes_count  = (engine == SWEEP_ART)   ? 1 : axes->hashes_count;
+        size_t lf_count      = (engine == SWEEP_ART)   ? 1 : axes->load_factors_count;
+        size_t batches_count = (engine == SWEEP_CHAIN) ? axes->batches_count : 1;
+
+        for (size_t h = 0; h < hashes_count;   h++)
+        for (size_t l = 0; l < lf_count;       l++)
+        for (size_t p = 0; p < axes->paddings_count; p++)
+        for (size_t b = 0; b < batches_count;  b++)
+        {
+            SweepConfig *config = &configs[count++];
+            *config = {};
+
+            config->engine      = engine;
+            config->hash        = axes->hashes[h];
+            config->load_factor = axes->load_factors[l];
+            config->padding     = axes->paddings[p];
+            config->batch       = (engine == SWEEP_CHAIN) ? axes->batches[b] : 1;
+        }
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+void SweepWrite(SweepContext *context)
+{
+    char file_name[FILENAME_MAX] = {};
+
+    snprintf(file_name, FILENAME_MAX, "%s.csv", context->axes->out);
+    FILE *csv = fopen(file_name, "wb");
+
+    snprintf(file_name, FILENAME_MAX, "%s.json", context->axes->out);
+    FILE *json = fopen(file_name, "wb");
+
+    if (csv == NULL || json == NULL)
+    {
+        printf("Couldn't open output files\n");
+        if (csv)  fclose(csv);
+        if (json) fclose(json);
+        return;
+    }
+
+    fprintf(csv, "engine,hash,load_factor,padding,batch,trials,build_ms,mean_ns,stddev_ns,ci95_ns,failed\n");
+    fprintf(json, "[\n");
+
+    for (size_t i = 0; i < context->configs_count; i++)
+    {
+        SweepConfig *config = &context->configs[i];
+        const char *hash = (config->engine == SWEEP_ART) ? "none" : SweepHashes[config->hash].name;
+
+        fprintf(csv, "%s,%s,%.4f,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%d\n",
+                SweepEngines[config->engine], hash, config->load_factor, config->padding, config->batch,
+                context->axes->trials, config->build_ms, config->mean_ns, config->stddev_ns, config->ci95_ns,
+                config->failed);
+
+        fprintf(json, "  {\"engine\": \"%s\", \"hash\": \"%s\", \"load_factor\": %.4f, \"padding\": %zu, \"batch\": %zu, "
+                      "\"trials\": %zu, \"build_ms\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"ci95_ns\": %.3f, "
+                      "\"failed\": %s}%s\n",
+                SweepEngines[config->engine], hash, config->load_factor, config->padding, config->batch,
+                context->axes->trials, config->build_ms, config->mean_ns, config->stddev_ns, config->ci95_ns,
+                (config->failed) ? "true" : "false", (i + 1 == context->configs_count) ? "" : ",");
+    }
+
+    fprintf(json, "]\n");
+
+    fclose(csv);
+    fclose(json);
+}
+
+//-----------------------------------------------------------------------------
+
+/* Parses "a,b,c" list of numbers or "from:to:step" range */
+size_t ParseNumbers(const char* arg, double *values)
+{
+    double from = 0, to = 0, step = 0;
+    size_t count = 0;
+
+    if (sscanf(arg, "%lf:%lf:%lf", &from, &to, &step) == 3 && step > 0)
+    {
+        /* Half of step for float rounding */
+        if (from >= to)
+            for (double x = from; x >= to - step / 2 && count < SWEEP_MAX_VALUES; x -= step)
+                values[count++] = x;
+        else
+            for (double x = from; x <= to + step / 2 && count < SWEEP_MAX_VALUES; x += step)
+                values[count++] = x;
+
+        return count;
+    }
+
+    const char *ptr = arg;
+    int read = 0;
+    while (count < SWEEP_MAX_VALUES && sscanf(ptr, "%lf%n", &values[count], &read) == 1)
+    {
+        count++;
+        ptr += read;
+        if (*ptr != ',')
+            break;
+        ptr++;
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+/* Parses "a,b,c" list of names, returns false if there's unknown name */
+bool ParseNames(const char* arg, const char* const *names, size_t names_count, size_t *values, size_t *count)
+{
+    *count = 0;
+    const char *ptr = arg;
+
+    while (*ptr && *count < SWEEP_MAX_VALUES)
+    {
+        size_t len = strcspn(ptr, ",");
+        size_t i = 0;
+
+        for (; i < names_count; i++)
+            if (strlen(names[i]) == len && !strncmp(ptr, names[i], len))
+                break;
+
+        if (i == names_count)
+        {
+            printf("Unknown name: %.*s\n", (int)len, ptr);
+            return false;
+        }
+
+        values[(*count)++] = i;
+        ptr += len;
+        if (*ptr == ',')
+            ptr++;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ParseArgs(int argc, char* argv[], SweepAxes *axes)
+{
+    double numbers[SWEEP_MAX_VALUES] = {};
+
+    const char* hash_names[sizeof(SweepHashes) / sizeof(SweepHashes[0])] = {};
+    for (size_t i = 0; i < sizeof(SweepHashes) / sizeof(SweepHashes[0]); i++)
+        hash_names[i] = SweepHashes[i].name;
+
+    axes->load_factors_count = ParseNumbers("1.0:0.2:0.05", axes->load_factors);
+    axes->hashes[0]   = 0;  axes->hashes_count   = 1;
+    axes->engines[0]  = 0;  axes->engines_count  = 1;
+    axes->paddings[0] = 8;  axes->paddings_count = 1;
+    axes->batches[0]  = 1;  axes->batches_count  = 1;
+    axes->threads     = (std::thread::hardware_concurrency()) ? std::thread::hardware_concurrency() : 1;
+    axes->trials      = 5;
+    axes->repeat      = 3;
+    axes->dictionary  = "src/dictionary.dic";
+    axes->out         = "sweep";
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char *arg = argv[i + 1];
+        size_t count = 0;
+
+        if (!strcmp(argv[i], "--lf"))
+        {
+            axes->load_factors_count = ParseNumbers(arg, axes->load_factors);
+        }
+        else if (!strcmp(argv[i], "--hash"))
+        {
+            if (!ParseNames(arg, hash_names, sizeof(hash_names) / sizeof(hash_names[0]), axes->hashes, &axes->hashes_count))
+                return false;
+        }
+        else if (!strcmp(argv[i], "--engine"))
+        {
+            if (!ParseNames(arg, SweepEngines, sizeof(SweepEngines) / sizeof(SweepEngines[0]), axes->engines, &axes->engines_count))
+                return false;
+        }
+        else if (!strcmp(argv[i], "--padding"))
+        {
+            count = ParseNumbers(arg, numbers);
+            for (size_t j = 0; j < count; j++)
+                axes->paddings[j] = numbers[j];
+            axes->paddings_count = count;
+        }
+        else if (!strcmp(argv[i], "--batch"))
+        {
+            count = ParseNumbers(arg, numbers);
+            for (size_t j = 0; j < count; j++)
+                axes->batches[j] = numbers[j];
+            axes->batches_count = count;
+        }
+        else if (!strcmp(argv[i], "--threads")) axes->threads    = atoi(arg);
+        else if (!strcmp(argv[i], "--trials"))  axes->trials     = atoi(arg);
+        else if (!strcmp(argv[i], "--repeat"))  axes->repeat     = atoi(arg);
+        else if (!strcmp(argv[i], "--dict"))    axes->dictionary = arg;
+        else if (!strcmp(argv[i], "--out"))     axes->out        = arg;
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < axes->load_factors_count; i++)
+        if (axes->load_factors[i] <= 0)
+        {
+            printf("Load factor must be positive\n");
+            return false;
+        }
+
+    /* Hashing and compare kernels read keys by 8 bytes */
+    for (size_t i = 0; i < axes->paddings_count; i++)
+        if (axes->paddings[i] == 0 || axes->paddings[i] % 8)
+        {
+            printf("Padding must be multiple of 8\n");
+            return false;
+        }
+
+    for (size_t i = 0; i < axes->batches_count; i++)
+        if (axes->batches[i] == 0 || axes->batches[i] > HASH_BATCH_MAX)
+        {
+            printf("Batch size must be from 1 to %zu\n", HASH_BATCH_MAX);
+            return false;
+        }
+
+    if (axes->load_factors_count == 0 || axes->paddings_count == 0 || axes->batches_count == 0 ||
+        axes->threads == 0 || axes->trials == 0 || axes->repeat == 0)
+    {
+        printf("Empty axis\n");
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    SweepAxes axes = {};
+    if (!ParseArgs(argc, argv, &axes))
+        return 1;
+
+    char *buffer = NULL;
+    size_t buffer_size = ReadDataBase(axes.dictionary, &buffer);
+    if (buffer == NULL)
+    {
+        printf("Couldn't read database\n");
+        return 1;
+    }
+
+    SweepContext context = {};
+    context.axes        = &axes;
+    context.words_count = GetEolCount(buffer, buffer_size);
+    context.translates  = Parser(buffer, context.words_count, buffer_size);
+
+    context.keys = (SweepKeys *)calloc(axes.paddings_count, sizeof(SweepKeys));
+    for (size_t i = 0; i < axes.paddings_count; i++)
+        SweepKeys_construct(&context.keys[i], context.translates, context.words_count, axes.paddings[i]);
+
+    context.configs = (SweepConfig *)calloc(axes.engines_count * axes.hashes_count * axes.load_factors_count *
+                                            axes.paddings_count * axes.batches_count, sizeof(SweepConfig));
+    context.configs_count = SweepGenerate(&axes, context.configs);
+
+    printf("words: %zu, configurations: %zu, threads: %zu\n", context.words_count, context.configs_count, axes.threads);
+
+    std::thread *workers = new std::thread[axes.threads];
+    for (size_t i = 0; i < axes.threads; i++)
+        workers[i] = std::thread(SweepWorker, &context);
+
+    for (size_t i = 0; i < axes.threads; i++)
+        workers[i].join();
+
+    delete[] workers;
+
+    SweepWrite(&context);
+
+    for (size_t i = 0; i < axes.paddings_count; i++)
+        SweepKeys_destruct(&context.keys[i]);
+
+    free(context.keys);
+    free(context.configs);
+    free(context.translates);
+    free(buffer);
+
+    return 0;
+}